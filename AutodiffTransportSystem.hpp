@@ -0,0 +1,171 @@
+#ifndef AUTODIFFTRANSPORTSYSTEM_HPP
+#define AUTODIFFTRANSPORTSYSTEM_HPP
+
+#include "TransportSystem.hpp"
+#include "Dual.hpp"
+
+/*
+	TransportSystem with exact derivatives by forward-mode automatic differentiation
+
+	Rather than SigmaFn, Sources and their five derivatives, a class Physics deriving from
+	AutodiffTransportSystem< Physics > writes the flux and source once, as templates on the scalar type
+
+		template< typename T > T Flux( Index i, VectorOf< T > const& u, VectorOf< T > const& q, Position x, Time t );
+		template< typename T > T Source( Index i, VectorOf< T > const& u, VectorOf< T > const& q, VectorOf< T > const& sigma, Position x, Time t );
+
+	and everything else is generated from them. T is double for plain evaluations and a Dual seeded with every
+	component of u & q ( & sigma ) for the derivatives, so a single evaluation of each function gives its value and the whole
+	row of every Jacobian. The fused evaluation is switched on, so the solver builds the Jacobian from these.
+	Call mathematical functions unqualified ( after using std::pow; etc. ) so that both instantiations find them.
+
+	At most MaxVars variables are supported, which keeps all the Dual arithmetic on the stack.
+
+	dSources_du, dSources_dq & dSources_dsigma are not given sigma, so they take it to be the flux at u & q. The solver only
+	calls them if the fused evaluation is switched off again.
+ */
+
+template< typename Physics, int MaxVars = 8 >
+class AutodiffTransportSystem : public TransportSystem
+{
+	public:
+		template< typename T >
+		using VectorOf = Eigen::Matrix< T, Eigen::Dynamic, 1, 0, MaxVars, 1 >;
+		// Enough directions for u, q & sigma together
+		using Real = Dual< 3*MaxVars >;
+
+		Value SigmaFn( Index i, const Values &u, const Values &q, Position x, Time t ) override
+		{
+			checkVars();
+			VectorOf< double > uV( u ), qV( q );
+			return physics().template Flux< double >( i, uV, qV, x, t );
+		};
+		Value Sources( Index i, const Values &u, const Values &q, const Values &sigma, Position x, Time t ) override
+		{
+			checkVars();
+			VectorOf< double > uV( u ), qV( q ), sigmaV( sigma );
+			return physics().template Source< double >( i, uV, qV, sigmaV, x, t );
+		};
+
+		void dSigmaFn_du( Index i, Values& v, const Values &u, const Values &q, Position x, Time t ) override
+		{
+			v = fluxGradient( i, u, q, x, t ).head( nVars );
+		};
+		void dSigmaFn_dq( Index i, Values& v, const Values &u, const Values &q, Position x, Time t ) override
+		{
+			v = fluxGradient( i, u, q, x, t ).segment( nVars, nVars );
+		};
+		void dSources_du( Index i, Values& v, const Values &u, const Values &q, Position x, Time t ) override
+		{
+			v = sourceGradient( i, u, q, x, t ).head( nVars );
+		};
+		void dSources_dq( Index i, Values& v, const Values &u, const Values &q, Position x, Time t ) override
+		{
+			v = sourceGradient( i, u, q, x, t ).segment( nVars, nVars );
+		};
+		void dSources_dsigma( Index i, Values& v, const Values &u, const Values &q, Position x, Time t ) override
+		{
+			v = sourceGradient( i, u, q, x, t ).segment( 2*nVars, nVars );
+		};
+
+		// Values only, without the derivatives
+		void Evaluate( PointValues u, PointValues q, PointValues sigma, Positions x, Time t, PointResults sigmaOut, PointResults sourcesOut ) override
+		{
+			checkVars();
+			VectorOf< double > uV( nVars ), qV( nVars ), sigmaV( nVars );
+			for ( Index p = 0; p < x.size(); ++p )
+			{
+				uV = u.row( p ).transpose();
+				qV = q.row( p ).transpose();
+				sigmaV = sigma.row( p ).transpose();
+				for ( Index i = 0; i < nVars; ++i )
+				{
+					sigmaOut( p, i ) = physics().template Flux< double >( i, uV, qV, x[ p ], t );
+					sourcesOut( p, i ) = physics().template Source< double >( i, uV, qV, sigmaV, x[ p ], t );
+				}
+			}
+		};
+
+		void FluxAndJacobian( const Values &u, const Values &q, Position x, Time t, Values& sigma, Matrix& dSigma_du, Matrix& dSigma_dq ) override
+		{
+			VectorOf< Real > uD, qD;
+			seed( uD, u, 2*nVars, 0 );
+			seed( qD, q, 2*nVars, nVars );
+			for ( Index i = 0; i < nVars; ++i )
+			{
+				Real s = physics().template Flux< Real >( i, uD, qD, x, t );
+				sigma[ i ] = s.value();
+				if ( s.derivatives().size() == 0 )
+					continue;
+				dSigma_du.row( i ) = s.derivatives().head( nVars ).transpose();
+				dSigma_dq.row( i ) = s.derivatives().segment( nVars, nVars ).transpose();
+			}
+		};
+		void SourcesAndJacobian( const Values &u, const Values &q, const Values &sigma, Position x, Time t, Values& S, Matrix& dS_du, Matrix& dS_dq, Matrix& dS_dsigma ) override
+		{
+			VectorOf< Real > uD, qD, sigmaD;
+			seed( uD, u, 3*nVars, 0 );
+			seed( qD, q, 3*nVars, nVars );
+			seed( sigmaD, sigma, 3*nVars, 2*nVars );
+			for ( Index i = 0; i < nVars; ++i )
+			{
+				Real s = physics().template Source< Real >( i, uD, qD, sigmaD, x, t );
+				S[ i ] = s.value();
+				if ( s.derivatives().size() == 0 )
+					continue;
+				dS_du.row( i ) = s.derivatives().head( nVars ).transpose();
+				dS_dq.row( i ) = s.derivatives().segment( nVars, nVars ).transpose();
+				dS_dsigma.row( i ) = s.derivatives().segment( 2*nVars, nVars ).transpose();
+			}
+		};
+
+	protected:
+		AutodiffTransportSystem() { fusedEvaluation = true; };
+
+	private:
+		Physics& physics() { return static_cast< Physics& >( *this ); };
+
+		void checkVars() const
+		{
+			if ( nVars > MaxVars )
+				throw std::logic_error( "Too many variables for this AutodiffTransportSystem, increase MaxVars" );
+		};
+
+		// v[ j ] is independent variable offset + j of nDirections
+		void seed( VectorOf< Real >& v, Eigen::Ref< const Vector > values, Index nDirections, Index offset ) const
+		{
+			checkVars();
+			v.resize( nVars );
+			for ( Index j = 0; j < nVars; ++j )
+				v[ j ] = Real( values[ j ], nDirections, offset + j );
+		};
+
+		// Gradients of flux / source i with respect to u & q ( & sigma ), zero if it is constant
+		typename Real::Derivatives fluxGradient( Index i, const Values &u, const Values &q, Position x, Time t )
+		{
+			VectorOf< Real > uD, qD;
+			seed( uD, u, 2*nVars, 0 );
+			seed( qD, q, 2*nVars, nVars );
+			Real s = physics().template Flux< Real >( i, uD, qD, x, t );
+			if ( s.derivatives().size() == 0 )
+				return Real::Derivatives::Zero( 2*nVars );
+			return s.derivatives();
+		};
+		typename Real::Derivatives sourceGradient( Index i, const Values &u, const Values &q, Position x, Time t )
+		{
+			checkVars();
+			VectorOf< double > uV( u ), qV( q ), sigmaV( nVars );
+			for ( Index j = 0; j < nVars; ++j )
+				sigmaV[ j ] = physics().template Flux< double >( j, uV, qV, x, t );
+
+			VectorOf< Real > uD, qD, sigmaD;
+			seed( uD, u, 3*nVars, 0 );
+			seed( qD, q, 3*nVars, nVars );
+			seed( sigmaD, sigmaV, 3*nVars, 2*nVars );
+			Real s = physics().template Source< Real >( i, uD, qD, sigmaD, x, t );
+			if ( s.derivatives().size() == 0 )
+				return Real::Derivatives::Zero( 3*nVars );
+			return s.derivatives();
+		};
+};
+
+#endif // AUTODIFFTRANSPORTSYSTEM_HPP
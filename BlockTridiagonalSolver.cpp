@@ -0,0 +1,108 @@
+
+#include "BlockTridiagonalSolver.hpp"
+
+#include <stdexcept>
+
+void BlockTridiagonalSolver::resize( Index nBlocks, Index blockSize )
+{
+	if ( nBlocks <= 0 || blockSize <= 0 )
+		throw std::invalid_argument( "Block-tridiagonal system needs a strictly positive number of blocks of strictly positive size" );
+
+	n = nBlocks;
+	m = blockSize;
+
+	D.assign( n, Matrix::Zero( m, m ) );
+	L.assign( n - 1, Matrix::Zero( m, m ) );
+	U.assign( n - 1, Matrix::Zero( m, m ) );
+	W.assign( n - 1, Matrix::Zero( m, m ) );
+	S.assign( n, Eigen::FullPivLU< Matrix >( m, m ) );
+	factorised = false;
+
+	Schur.resize( m, m );
+	blockWork.resize( m, m );
+	rhs.resize( m );
+	rhsWork.resize( m );
+}
+
+void BlockTridiagonalSolver::setZero()
+{
+	for ( auto & X : D )
+		X.setZero();
+	for ( auto & X : L )
+		X.setZero();
+	for ( auto & X : U )
+		X.setZero();
+	factorised = false;
+}
+
+void BlockTridiagonalSolver::factorise()
+{
+	// S_0 = D_0
+	// S_i = D_i - L_{i-1} S_{i-1}^{-1} U_{i-1}
+	S[ 0 ].compute( D[ 0 ] );
+	for ( Index i = 1; i < n; ++i )
+	{
+		LUSolve( S[ i - 1 ], U[ i - 1 ], W[ i - 1 ], blockWork );
+		Schur = D[ i ];
+		Schur.noalias() -= L[ i - 1 ] * W[ i - 1 ];
+		S[ i ].compute( Schur );
+	}
+	factorised = true;
+}
+
+void BlockTridiagonalSolver::solve( Vector &x )
+{
+	if ( !factorised )
+		throw std::logic_error( "BlockTridiagonalSolver::solve called before factorise()" );
+	if ( x.size() != n*m )
+		throw std::invalid_argument( "Right-hand side has the wrong size for this block-tridiagonal system" );
+
+	// Forward elimination, y_i = S_i^{-1} ( b_i - L_{i-1} y_{i-1} )
+	rhs = x.segment( 0, m );
+	LUSolve( S[ 0 ], rhs, x.segment( 0, m ), rhsWork );
+	for ( Index i = 1; i < n; ++i )
+	{
+		rhs = x.segment( i*m, m );
+		rhs.noalias() -= L[ i - 1 ] * x.segment( ( i - 1 )*m, m );
+		LUSolve( S[ i ], rhs, x.segment( i*m, m ), rhsWork );
+	}
+
+	// Back substitution, x_i = y_i - W_i x_{i+1}
+	for ( Index i = n - 1; i > 0; --i )
+		x.segment( ( i - 1 )*m, m ).noalias() -= W[ i - 1 ] * x.segment( i*m, m );
+}
+
+Matrix BlockTridiagonalSolver::toDense() const
+{
+	Matrix dense = Matrix::Zero( n*m, n*m );
+	for ( Index i = 0; i < n; ++i )
+	{
+		dense.block( i*m, i*m, m, m ) = D[ i ];
+		if ( i < n - 1 )
+		{
+			dense.block( ( i + 1 )*m, i*m, m, m ) = L[ i ];
+			dense.block( i*m, ( i + 1 )*m, m, m ) = U[ i ];
+		}
+	}
+	return dense;
+}
+
+void LUSolve( Eigen::FullPivLU< Matrix > const& lu, Eigen::Ref< const Matrix > const& b, Eigen::Ref< Matrix > x, Eigen::Ref< Matrix > work )
+{
+	// A = P^{-1} L U Q^{-1}, as in Eigen's FullPivLU::_solve_impl for square A
+	Index rank = lu.rank();
+	if ( rank == 0 )
+	{
+		x.setZero();
+		return;
+	}
+
+	work = lu.permutationP() * b;
+	lu.matrixLU().triangularView< Eigen::UnitLower >().solveInPlace( work );
+	lu.matrixLU().topLeftCorner( rank, rank ).triangularView< Eigen::Upper >().solveInPlace( work.topRows( rank ) );
+
+	for ( Index i = 0; i < rank; ++i )
+		x.row( lu.permutationQ().indices()( i ) ) = work.row( i );
+	for ( Index i = rank; i < lu.cols(); ++i )
+		x.row( lu.permutationQ().indices()( i ) ).setZero();
+}
@@ -0,0 +1,107 @@
+#ifndef BLOCKTRIDIAGONALSOLVER_HPP
+#define BLOCKTRIDIAGONALSOLVER_HPP
+
+#include "Types.hpp"
+
+#include <Eigen/Dense>
+#include <vector>
+
+/*
+	Storage and direct solver for block-tridiagonal systems
+
+	[ D_0  U_0                  ] [ x_0 ]   [ b_0 ]
+	[ L_0  D_1  U_1             ] [ x_1 ]   [ b_1 ]
+	[      L_1  D_2  U_2        ] [ x_2 ] = [ b_2 ]
+	[            ...  ...  ...  ] [ ... ]   [ ... ]
+
+	with n square blocks of equal size along the diagonal. Used for the global
+	trace (lambda) system, where each block is one face of the grid and each cell
+	couples only its two faces. Memory and time are both O( n * blockSize^3 ).
+
+	Factorisation is a block Thomas algorithm. The Schur complements on the diagonal
+	are factorised with full pivoting, so a face with a decoupled (e.g. Dirichlet)
+	variable -- a zero row and column -- yields a zero component in the solution,
+	just as the dense FullPivLU did.
+ */
+class BlockTridiagonalSolver
+{
+public:
+	BlockTridiagonalSolver() = default;
+	BlockTridiagonalSolver( Index nBlocks, Index blockSize ) { resize( nBlocks, blockSize ); };
+
+	void resize( Index nBlocks, Index blockSize );
+	void setZero();
+
+	Index nBlocks() const { return n; };
+	Index blockSize() const { return m; };
+	Index size() const { return n*m; };
+
+	// D_i
+	Matrix &      diagonal( Index i )       { return D[ i ]; };
+	Matrix const& diagonal( Index i ) const { return D[ i ]; };
+	// L_i is the block at ( i + 1, i )
+	Matrix &      lower( Index i )       { return L[ i ]; };
+	Matrix const& lower( Index i ) const { return L[ i ]; };
+	// U_i is the block at ( i, i + 1 )
+	Matrix &      upper( Index i )       { return U[ i ]; };
+	Matrix const& upper( Index i ) const { return U[ i ]; };
+
+	// Factorise the currently stored blocks. Must be called again if the blocks change.
+	void factorise();
+
+	// Solves the factorised system in place; x holds b on entry, block i in x.segment( i*blockSize, blockSize ).
+	// Uses scratch space held in the object, so does not allocate (and is not const).
+	void solve( Vector &x );
+
+	// Dense copy, only for testing / comparison against the dense path
+	Matrix toDense() const;
+
+private:
+	Index n = 0, m = 0;
+	std::vector< Matrix > D, L, U;
+	// W_i = S_i^{-1} U_i, where S_i is the i'th Schur complement
+	std::vector< Matrix > W;
+	std::vector< Eigen::FullPivLU< Matrix > > S;
+	bool factorised = false;
+
+	// Scratch space, sized in resize()
+	Matrix Schur, blockWork;
+	Vector rhs, rhsWork;
+};
+
+// x = A^{-1} b, for the A factorised in lu. Does the same arithmetic as lu.solve( b ), so gives the same
+// answer for singular A, but uses work ( the same shape as b ) where FullPivLU::solve allocates a temporary.
+void LUSolve( Eigen::FullPivLU< Matrix > const& lu, Eigen::Ref< const Matrix > const& b, Eigen::Ref< Matrix > x, Eigen::Ref< Matrix > work );
+
+// As above with A M x M and b M x C known at compile time, so the triangular solves are done on fixed-size
+// maps of the factors. Uses the dynamic version when either size is Eigen::Dynamic, or A is singular.
+template< int M, int C >
+void LUSolve( Eigen::FullPivLU< Matrix > const& lu, Eigen::Ref< const Matrix > const& b, Eigen::Ref< Matrix > x, Eigen::Ref< Matrix > work )
+{
+	if constexpr ( M == Eigen::Dynamic || C == Eigen::Dynamic )
+	{
+		LUSolve( lu, b, x, work );
+	}
+	else
+	{
+		if ( lu.rank() < M )
+		{
+			LUSolve( lu, b, x, work );
+			return;
+		}
+
+		Eigen::Map< const Eigen::Matrix< double, M, M > > LU( lu.matrixLU().data() );
+		auto const& P = lu.permutationP().indices();
+		auto const& Q = lu.permutationQ().indices();
+
+		Eigen::Matrix< double, M, C > c;
+		for ( Index i = 0; i < M; ++i )
+			c.row( P( i ) ) = b.row( i );
+		LU.template triangularView< Eigen::UnitLower >().solveInPlace( c );
+		LU.template triangularView< Eigen::Upper >().solveInPlace( c );
+		for ( Index i = 0; i < M; ++i )
+			x.row( Q( i ) ) = c.row( i );
+	}
+}
+
+#endif // BLOCKTRIDIAGONALSOLVER_HPP
@@ -0,0 +1,229 @@
+#ifndef CELLMATRICES_HPP
+#define CELLMATRICES_HPP
+
+#include "gridStructures.hpp"
+
+#include <compare>
+#include <map>
+#include <vector>
+
+/*
+	The time-independent HDG cell matrices, stored once per kind of cell rather than once per cell
+
+	On a cell of width h each per-variable block is the one on a cell of unit width scaled by
+		A, H : 1,    B, D : 1/h,    C, E, G : 1/sqrt( h )
+	and beyond that depends only on tau at the two faces and on which faces the boundary conditions
+	decouple. Cells that agree on those share one set of unit-width blocks, so with a constant tau a grid
+	needs a set for its interior and one for each boundary cell, however many cells it has and whatever
+	their widths. Every matrix is block diagonal in the variables, so only the diagonal blocks are kept,
+	and the cell matrices are assembled from them on demand ( see assembleM etc. ) into the caller's memory.
+ */
+class CellMatrices
+{
+public:
+	// Unit-width blocks of one variable of degree k. B & D are ( k + 1 ) x ( k + 1 ), C & G are 2 x ( k + 1 ),
+	// E is ( k + 1 ) x 2 and H is 2 x 2, with the lower face first. A is the identity so is not stored
+	struct Blocks { Matrix B, D, C, E, G, H; };
+
+	// All a cell's blocks depend on besides its width. decoupled holds four flags per variable, indexed by
+	// 4*var + CELower etc., for whether C & E, and G & H, are cut off from the lower and the upper face
+	struct Kind
+	{
+		double tauLower, tauUpper;
+		std::vector< bool > decoupled;
+		auto operator<=>( Kind const& ) const = default;
+	};
+	enum Face : Index { CELower = 0, CEUpper = 1, GHLower = 2, GHUpper = 3 };
+
+	// kind( i ) is the Kind of cell i. A variable of degree below that of basis uses the leading
+	// rows of its tables, so basis must be hierarchical ( Legendre ) if the degrees differ
+	template< typename F >
+	void build( Grid const& grid, std::vector< Index > const& degrees, BasisTable const& basis, F const& kind )
+	{
+		nVars = degrees.size();
+		nCoeffs.clear();
+		offsets.clear();
+		fieldSize = 0;
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			offsets.push_back( fieldSize );
+			nCoeffs.push_back( degrees[ var ] + 1 );
+			fieldSize += degrees[ var ] + 1;
+		}
+
+		Index nCells = grid.getNCells();
+		sets.clear();
+		setOf.assign( nCells, 0 );
+		hInv.resize( nCells );
+		rootHInv.resize( nCells );
+		std::map< Kind, Index > known;
+		for ( Index i = 0; i < nCells; ++i )
+		{
+			hInv[ i ] = 1.0/grid[ i ].h();
+			rootHInv[ i ] = 1.0/::sqrt( grid[ i ].h() );
+
+			Kind k = kind( i );
+			auto it = known.find( k );
+			if ( it == known.end() )
+			{
+				it = known.emplace( k, sets.size() ).first;
+				sets.push_back( unitBlocks( k, basis ) );
+			}
+			setOf[ i ] = it->second;
+		}
+	}
+
+	Blocks const& operator()( Index cell, Index var ) const { return sets[ setOf[ cell ] ][ var ]; }
+	// The scalings of the blocks of a cell, 1/h and 1/sqrt( h )
+	double invH( Index cell ) const { return hInv[ cell ]; }
+	double invRootH( Index cell ) const { return rootHInv[ cell ]; }
+
+	Index nCells() const { return setOf.size(); }
+	// Number of distinct kinds of cell, and which one cell i is
+	Index nSets() const { return sets.size(); }
+	Index set( Index cell ) const { return setOf[ cell ]; }
+
+	/*
+		The cell matrices, with the variables in the order of DGSoln::gatherCell ( blocks of size S = sum( k + 1 ) )
+		and the faces as [ lower( 0 ), upper( 0 ), lower( 1 ), .. ]. The targets must already be the right size
+			M  = [ 0 -A -B^T ; B 0 D ; A 0 0 ]  3S x 3S, the part of the Jacobian cell block that does not change in time
+			CE = [ C^T ; E ; 0 ]                3S x 2nVars
+			CG = [ C 0 G ]                      2nVars x 3S
+			H                                   2nVars x 2nVars
+	 */
+	void assembleM( Index i, Eigen::Ref< Matrix > M ) const
+	{
+		Index S = fieldSize;
+		M.setZero();
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			Blocks const& b = ( *this )( i, var );
+			Index n = nCoeffs[ var ], o = offsets[ var ];
+			M.block( o, S + o, n, n ).diagonal().setConstant( -1.0 );
+			M.block( o, 2*S + o, n, n ) = -hInv[ i ]*b.B.transpose();
+			M.block( S + o, o, n, n ) = hInv[ i ]*b.B;
+			M.block( S + o, 2*S + o, n, n ) = hInv[ i ]*b.D;
+			M.block( 2*S + o, o, n, n ).diagonal().setOnes();
+		}
+	}
+
+	void assembleCE( Index i, Eigen::Ref< Matrix > CE ) const
+	{
+		CE.setZero();
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			Blocks const& b = ( *this )( i, var );
+			Index n = nCoeffs[ var ], o = offsets[ var ];
+			CE.block( o, 2*var, n, 2 ) = rootHInv[ i ]*b.C.transpose();
+			CE.block( fieldSize + o, 2*var, n, 2 ) = rootHInv[ i ]*b.E;
+		}
+	}
+
+	void assembleCG( Index i, Eigen::Ref< Matrix > CG ) const
+	{
+		CG.setZero();
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			Blocks const& b = ( *this )( i, var );
+			Index n = nCoeffs[ var ], o = offsets[ var ];
+			CG.block( 2*var, o, 2, n ) = rootHInv[ i ]*b.C;
+			CG.block( 2*var, 2*fieldSize + o, 2, n ) = rootHInv[ i ]*b.G;
+		}
+	}
+
+	void assembleH( Index i, Eigen::Ref< Matrix > H ) const
+	{
+		H.setZero();
+		for ( Index var = 0; var < nVars; ++var )
+			H.block( 2*var, 2*var, 2, 2 ) = ( *this )( i, var ).H;
+	}
+
+	// The block-diagonal S x S, 2nVars x S & S x 2nVars matrices of cell i, as they used to be stored per cell. For testing
+	Matrix A( Index ) const { return Matrix::Identity( fieldSize, fieldSize ); }
+	Matrix B( Index i ) const { return blockDiagonal( i, hInv[ i ], &Blocks::B ); }
+	Matrix D( Index i ) const { return blockDiagonal( i, hInv[ i ], &Blocks::D ); }
+	Matrix C( Index i ) const { return blockDiagonal( i, rootHInv[ i ], &Blocks::C ); }
+	Matrix E( Index i ) const { return blockDiagonal( i, rootHInv[ i ], &Blocks::E ); }
+	Matrix G( Index i ) const { return blockDiagonal( i, rootHInv[ i ], &Blocks::G ); }
+	Matrix H( Index i ) const { return blockDiagonal( i, 1.0, &Blocks::H ); }
+
+	// Bytes of matrix data held, and what keeping A, B, C, D, E, G, H, CG, CE & M for every cell would take
+	size_t bytes() const
+	{
+		size_t n = hInv.size() + rootHInv.size();
+		for ( auto const& set : sets )
+			for ( auto const& b : set )
+				n += b.B.size() + b.D.size() + b.C.size() + b.E.size() + b.G.size() + b.H.size();
+		return n*sizeof( double ) + setOf.size()*sizeof( Index );
+	}
+	size_t perCellBytes() const
+	{
+		size_t S = fieldSize, T = 2*nVars;
+		size_t perCell = 3*S*S + 3*T*S + T*T + 2*T*3*S + 9*S*S;
+		return perCell*nCells()*sizeof( double );
+	}
+
+private:
+	Index nVars = 0, fieldSize = 0;
+	std::vector< Index > nCoeffs, offsets;
+	std::vector< std::vector< Blocks > > sets;
+	std::vector< Index > setOf;
+	std::vector< double > hInv, rootHInv;
+
+	std::vector< Blocks > unitBlocks( Kind const& kind, BasisTable const& basis ) const
+	{
+		std::vector< Blocks > set( nVars );
+		Interval const unit( 0.0, 1.0 );
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			Blocks& b = set[ var ];
+			Index n = nCoeffs[ var ];
+			auto cut = [ & ]( Face f ) { return kind.decoupled[ 4*var + f ]; };
+
+			// B_ij = ( phi_i, phi_j' ), D_ij = tau phi_i phi_j at either end
+			b.B = basis.derivativeMatrix().topLeftCorner( n, n );
+			b.D = kind.tauLower*basis.lowerEdgeMatrix().topLeftCorner( n, n ) + kind.tauUpper*basis.upperEdgeMatrix().topLeftCorner( n, n );
+
+			b.C.resize( 2, n );
+			b.E.resize( n, 2 );
+			b.G.resize( 2, n );
+			for ( Index j = 0; j < n; ++j )
+			{
+				// C_ij = < psi_i, phi_j * n_x >, the edge degrees of freedom psi_i are just 1 at each end
+				b.C( 0, j ) = cut( CELower ) ? 0.0 : -basis.phiLower( unit, j );
+				b.C( 1, j ) = cut( CEUpper ) ? 0.0 :  basis.phiUpper( unit, j );
+				// E_ij = < phi_i, ( - tau ) lambda >
+				b.E( j, 0 ) = cut( CELower ) ? 0.0 : -kind.tauLower*basis.phiLower( unit, j );
+				b.E( j, 1 ) = cut( CEUpper ) ? 0.0 : -kind.tauUpper*basis.phiUpper( unit, j );
+				b.G( 0, j ) = cut( GHLower ) ? 0.0 : kind.tauLower*basis.phiLower( unit, j );
+				b.G( 1, j ) = cut( GHUpper ) ? 0.0 : kind.tauUpper*basis.phiUpper( unit, j );
+			}
+
+			b.H.setZero( 2, 2 );
+			b.H( 0, 0 ) = cut( GHLower ) ? 0.0 : -kind.tauLower;
+			b.H( 1, 1 ) = cut( GHUpper ) ? 0.0 : -kind.tauUpper;
+		}
+		return set;
+	}
+
+	Matrix blockDiagonal( Index i, double scale, Matrix Blocks::*m ) const
+	{
+		Index rows = 0, cols = 0;
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			rows += ( ( *this )( i, var ).*m ).rows();
+			cols += ( ( *this )( i, var ).*m ).cols();
+		}
+		Matrix out = Matrix::Zero( rows, cols );
+		for ( Index var = 0, r = 0, c = 0; var < nVars; ++var )
+		{
+			Matrix const& b = ( *this )( i, var ).*m;
+			out.block( r, c, b.rows(), b.cols() ) = scale*b;
+			r += b.rows();
+			c += b.cols();
+		}
+		return out;
+	}
+};
+
+#endif // CELLMATRICES_HPP
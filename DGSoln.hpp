@@ -2,40 +2,122 @@
 #define DGSOLN_HPP
 
 #include "Types.hpp"
+#include <algorithm>
 #include <functional>
 #include <cassert>
+#include <vector>
 
+/*
+	Wraps the memory of a SUNDIALS vector as sigma, q & u ( k + 1 coefficients per cell ) and lambda ( one value per face )
+	for each variable. Each variable may have its own degree k, then its fields have that many coefficients on every cell
+	and a field of a cell holds S = sum( k + 1 ) coefficients over all the variables. Where each of these lives in that memory is set by the Layout:
+
+	TracesLast    : per cell [ sigma( 0 ), .., sigma( nVars - 1 ), q( 0 ), .., q( nVars - 1 ), u( 0 ), .., u( nVars - 1 ) ],
+	                then lambda of every face for variable 0, then for variable 1, ..
+	CellMajor     : per cell [ lambda( 0 ), .., lambda( nVars - 1 ) on its lower face, then sigma, q & u as above ],
+	                then lambda on the upper face of the last cell
+	VariableMajor : per variable [ sigma on every cell, q on every cell, u on every cell, lambda on every face ]
+
+	In all of them each block of k + 1 coefficients is contiguous, and the blocks ( and lambdas ) of one field
+	of one variable are equally spaced, so the DGApprox & lambda views are strided maps.
+
+	With mixed degrees the nodal transforms use the leading rows of a modal basis of the highest degree, which are the
+	basis of each lower degree as the Legendre basis is hierarchical. Nodal bases need every variable to have the same degree.
+ */
 class DGSoln {
 	public:
 
-		DGSoln( Index n_var, Grid const& _grid, Index Order ) : nVars( n_var ), grid( _grid ),k( Order ) { };
+		enum class Layout { TracesLast, CellMajor, VariableMajor };
+
+		DGSoln( Index n_var, Grid const& _grid, Index Order, Layout l = Layout::TracesLast ) : DGSoln( n_var, _grid, std::vector< Index >( n_var, Order ), l ) { };
+
+		DGSoln( Index n_var, Grid const& _grid, Index Order, double* memory, Layout l = Layout::TracesLast ) : DGSoln( n_var, _grid, Order, l ) { Map( memory ); };
+
+		// One degree per variable
+		DGSoln( Index n_var, Grid const& _grid, std::vector< Index > const& Orders, Layout l = Layout::TracesLast )
+			: nVars( n_var ), grid( _grid ), k( Orders.empty() ? 0 : *std::max_element( Orders.begin(), Orders.end() ) ), layout( l ), orders( Orders )
+		{
+			if ( static_cast<Index>( orders.size() ) != nVars )
+				throw std::invalid_argument( "A DGSoln needs one polynomial degree per variable" );
+			fieldSize = 0;
+			for ( Index var = 0; var < nVars; ++var ) {
+				if ( orders[ var ] < 0 )
+					throw std::invalid_argument( "Polynomial degrees cannot be negative" );
+				offsets.push_back( fieldSize );
+				fieldSize += orders[ var ] + 1;
+			}
+		};
 
-		DGSoln( Index n_var, Grid const& _grid, Index Order, double* memory ) : nVars( n_var ), grid( _grid ),k( Order ) { Map( memory ); };
+		DGSoln( Index n_var, Grid const& _grid, std::vector< Index > const& Orders, double* memory, Layout l = Layout::TracesLast ) : DGSoln( n_var, _grid, Orders, l ) { Map( memory ); };
 
 		virtual ~DGSoln() = default;
 
 		Index getNumVars() const { return nVars; };
 
+		// Degree of variable var, the highest over all variables, and whether they are all the same
+		Index order( Index var ) const { return orders[ var ]; };
+		Index maxOrder() const { return k; };
+		bool uniformOrder() const { return fieldSize == nVars*( k + 1 ); };
+
 		size_t getDoF() const {
 			// 3 = u + q + sigma
 			// nCells + 1 for lambda because we store values at both ends
-			return grid.getNCells() * nVars * ( k + 1 ) * 3 + 
+			return grid.getNCells() * fieldSize * 3 +
 				( grid.getNCells() + 1 ) * nVars;
 		};
 
+		Layout getLayout() const { return layout; };
+		// Re-maps any memory we already wrap, which is then read in the new layout
+		void setLayout( Layout l ) {
+			layout = l;
+			if ( data_ != nullptr )
+				Map( data_ );
+		};
+
+		// The basis the coefficients of sigma, q & u are in, for the highest degree. Legendre unless set.
+		// Variables of lower degree get the table of their own degree with the same nodes & type
+		BasisTable const& basis() const { return pBasis != nullptr ? *pBasis : BasisTable::Get( k ); };
+		void setBasis( BasisTable const& b ) {
+			if ( b.order() != k )
+				throw std::invalid_argument( "Basis must be of the same order as the solution" );
+			if ( b.isNodal() && !uniformOrder() )
+				throw std::invalid_argument( "A nodal basis needs every variable to have the same degree" );
+			pBasis = &b;
+			for ( Index var = 0; var < static_cast<Index>( u_.size() ); ++var ) {
+				BasisTable const& varBasis = orders[ var ] == k ? b : BasisTable::Get( orders[ var ], b.nNodes(), b.type() );
+				sigma_[ var ].setBasis( varBasis );
+				q_[ var ].setBasis( varBasis );
+				u_[ var ].setBasis( varBasis );
+			}
+		};
+
 		void Map( double* Y ) {
-			u_.clear();     u_.reserve( nVars );
-			q_.clear();     q_.reserve( nVars );
-			sigma_.clear(); sigma_.reserve( nVars );
-			lambda_.clear(); lambda_.reserve( nVars );
 			auto nCells = grid.getNCells();
+			data_ = Y;
+			// Build the per-variable views once, re-mapping just points them at the new memory
+			if ( static_cast<Index>( u_.size() ) != nVars )
+			{
+				u_.clear();     u_.reserve( nVars );
+				q_.clear();     q_.reserve( nVars );
+				sigma_.clear(); sigma_.reserve( nVars );
+				lambda_.clear(); lambda_.reserve( nVars );
+				for(int var = 0; var < nVars; var++)
+				{
+					sigma_.emplace_back( grid, orders[ var ] );
+					q_    .emplace_back( grid, orders[ var ] );
+					u_    .emplace_back( grid, orders[ var ] );
+					lambda_.emplace_back( nullptr, 0, Eigen::InnerStride<>( 1 ) );
+				}
+				if ( pBasis != nullptr )
+					setBasis( *pBasis );
+			}
 			for(int var = 0; var < nVars; var++)
 			{
-				sigma_.emplace_back( grid, k, ( Y +                 var*(k+1) ), 3*nVars*( k+1 ) );
-				q_    .emplace_back( grid, k, ( Y +   nVars*(k+1) + var*(k+1) ), 3*nVars*( k+1 ) );
-				u_    .emplace_back( grid, k, ( Y + 2*nVars*(k+1) + var*(k+1) ), 3*nVars*( k+1 ) );
+				sigma_[ var ].Map( Y + coeffOffset( 0, Sigma, var ), cellStride( var ) );
+				q_[ var ]    .Map( Y + coeffOffset( 0, Q, var ),     cellStride( var ) );
+				u_[ var ]    .Map( Y + coeffOffset( 0, U, var ),     cellStride( var ) );
 
-				lambda_.emplace_back(  Y + nVars*(nCells)*(3*k+3) + var*( nCells + 1 ), (nCells+1) );
+				new ( &lambda_[ var ] ) LambdaWrapper( Y + lambdaOffset( 0, var ), nCells + 1, Eigen::InnerStride<>( lambdaStride() ) );
 			}
 		};
 
@@ -49,8 +131,128 @@ class DGSoln {
 		DGApprox &      sigma( Index i )       { return sigma_[ i ]; };
 		DGApprox const& sigma( Index i ) const { return sigma_[ i ]; };
 
-		VectorWrapper &      lambda( Index i )       { return lambda_[ i ]; };
-		VectorWrapper const& lambda( Index i ) const { return lambda_[ i ]; };
+		using LambdaWrapper = Eigen::Map< Vector, 0, Eigen::InnerStride<> >;
+		LambdaWrapper &      lambda( Index i )       { return lambda_[ i ]; };
+		LambdaWrapper const& lambda( Index i ) const { return lambda_[ i ]; };
+
+		// The fields of each variable, in the order they are stored on a cell
+		enum Field : Index { Sigma = 0, Q = 1, U = 2 };
+
+		// Offsets into the wrapped memory of the coefficients of field f of variable var on cell i, and of lambda of variable var on a face
+		Index coeffOffset( Index i, Field f, Index var ) const {
+			switch ( layout ) {
+				case Layout::TracesLast:
+					return i*cellStride( var ) + f*fieldSize + offsets[ var ];
+				case Layout::CellMajor:
+					return i*cellStride( var ) + nVars + f*fieldSize + offsets[ var ];
+				case Layout::VariableMajor:
+				default:
+					return variableOffset( var ) + ( f*grid.getNCells() + i )*( orders[ var ] + 1 );
+			}
+		};
+		Index lambdaOffset( Index face, Index var ) const {
+			switch ( layout ) {
+				case Layout::TracesLast:
+					return 3*fieldSize*grid.getNCells() + var*( grid.getNCells() + 1 ) + face;
+				case Layout::CellMajor:
+					return face*cellStride( var ) + var;
+				case Layout::VariableMajor:
+				default:
+					return variableOffset( var ) + 3*( orders[ var ] + 1 )*grid.getNCells() + face;
+			}
+		};
+		// Distance between the coefficients of one field of one variable on neighbouring cells, and between neighbouring lambdas
+		Index cellStride( Index var ) const {
+			switch ( layout ) {
+				case Layout::TracesLast:
+					return 3*fieldSize;
+				case Layout::CellMajor:
+					return 3*fieldSize + nVars;
+				case Layout::VariableMajor:
+				default:
+					return orders[ var ] + 1;
+			}
+		};
+		Index lambdaStride() const { return layout == Layout::CellMajor ? cellStride( 0 ) : 1; };
+
+		// sigma, q & u of every variable on cell i, in the order of the cell matrices [ sigma( 0 ), .., sigma( nVars - 1 ), q( 0 ), .., u( nVars - 1 ) ],
+		// where field f of variable var is the k + 1 values from f*S + ( the sum of k + 1 over the variables before var )
+		template< typename V > void gatherCell( Index i, V&& v ) const {
+			for ( Index f = Sigma; f <= U; ++f )
+				for ( Index var = 0; var < nVars; ++var )
+					v.segment( f*fieldSize + offsets[ var ], orders[ var ] + 1 ) = Eigen::Map< const Vector >( data_ + coeffOffset( i, Field( f ), var ), orders[ var ] + 1 );
+		}
+		template< typename V > void scatterCell( Index i, V const& v ) {
+			for ( Index f = Sigma; f <= U; ++f )
+				for ( Index var = 0; var < nVars; ++var )
+					VectorWrapper( data_ + coeffOffset( i, Field( f ), var ), orders[ var ] + 1 ) = v.segment( f*fieldSize + offsets[ var ], orders[ var ] + 1 );
+		}
+
+		// In the TracesLast layout, with every variable of the same degree, the coefficients of all cells are one ( k + 1 ) x ( 3*nVars*nCells ) matrix,
+		// in which field f of variable var on cell i is column coeffColumn( i, f, var )
+		MatrixWrapper cellCoeffs() {
+			if ( layout != Layout::TracesLast || !uniformOrder() )
+				throw std::logic_error( "cellCoeffs() is only available in the TracesLast layout with one degree for every variable" );
+			return MatrixWrapper( data_, k + 1, 3*nVars*grid.getNCells() );
+		};
+		Eigen::Map< const Matrix > cellCoeffs() const {
+			if ( layout != Layout::TracesLast || !uniformOrder() )
+				throw std::logic_error( "cellCoeffs() is only available in the TracesLast layout with one degree for every variable" );
+			return Eigen::Map< const Matrix >( data_, k + 1, 3*nVars*grid.getNCells() );
+		};
+		// The column for field f of variable var on cell i in nodal values ( see below ), in any layout
+		Index coeffColumn( Index i, Field f, Index var ) const { return ( 3*i + f )*nVars + var; };
+
+		/*
+			Modal <-> nodal transforms for every field of every variable on the cells [ first, last ) at once.
+			values holds the values at the nodes of basis, with field f of variable var on cell i in column
+			coeffColumn( i - first, f, var ), so is nNodes x ( 3*nVars*( last - first ) ). On the reference element these are products
+				values = Phi^T C,   C = Phi W values
+			with the 1/sqrt( h ) cell scaling applied afterwards, column by column. C is every coefficient at once in the
+			TracesLast layout with a single degree, and each field of each variable across all the cells otherwise,
+			when Phi is the leading k + 1 rows of the basis for that variable.
+		 */
+		void EvaluateAtNodes( BasisTable const& basis, Eigen::Ref< Matrix > values, Index first, Index last ) const {
+			checkBasis( basis );
+			if ( layout == Layout::TracesLast && uniformOrder() && basis.order() == k )
+				values.noalias() = basis.values().transpose() * cellCoeffs().middleCols( 3*nVars*first, 3*nVars*( last - first ) );
+			else
+				for ( Index f = Sigma; f <= U; ++f )
+					for ( Index var = 0; var < nVars; ++var )
+						fieldValues( values, Field( f ), var, last - first ).noalias() = basis.values().topRows( orders[ var ] + 1 ).transpose() * fieldCoeffs( Field( f ), var, first, last );
+			for ( Index i = first; i < last; ++i )
+				values.middleCols( 3*nVars*( i - first ), 3*nVars ) /= ::sqrt( grid[ i ].h() );
+		};
+		void EvaluateAtNodes( BasisTable const& basis, Eigen::Ref< Matrix > values ) const {
+			EvaluateAtNodes( basis, values, 0, grid.getNCells() );
+		};
+
+		// The transpose of EvaluateAtNodes, overwrites the coefficients of every field on cells [ first, last ) with the projection of values
+		void ProjectFromNodes( BasisTable const& basis, Eigen::Ref< const Matrix > const& values, Index first, Index last ) {
+			if ( layout != Layout::TracesLast || !uniformOrder() || basis.order() != k ) {
+				for ( Index f = Sigma; f <= U; ++f )
+					ProjectFromNodes( basis, values, Field( f ), first, last );
+				return;
+			}
+			auto C = cellCoeffs().middleCols( 3*nVars*first, 3*nVars*( last - first ) );
+			C.noalias() = basis.weightedValues() * values;
+			for ( Index i = first; i < last; ++i )
+				C.middleCols( 3*nVars*( i - first ), 3*nVars ) *= ( grid[ i ].h()/2.0 )/::sqrt( grid[ i ].h() );
+		};
+		void ProjectFromNodes( BasisTable const& basis, Eigen::Ref< const Matrix > const& values ) {
+			ProjectFromNodes( basis, values, 0, grid.getNCells() );
+		};
+
+		// As above, for just the field f of every variable; the other columns of values are not read
+		void ProjectFromNodes( BasisTable const& basis, Eigen::Ref< const Matrix > const& values, Field f, Index first, Index last ) {
+			checkBasis( basis );
+			for ( Index var = 0; var < nVars; ++var ) {
+				auto C = fieldCoeffs( f, var, first, last );
+				C.noalias() = basis.weightedValues().topRows( orders[ var ] + 1 ) * fieldValues( values, f, var, last - first );
+				for ( Index i = first; i < last; ++i )
+					C.col( i - first ) *= ( grid[ i ].h()/2.0 )/::sqrt( grid[ i ].h() );
+			}
+		};
 
 		// Deep copy of the data in other to the memory we are 
 		// wrapping
@@ -60,15 +262,19 @@ class DGSoln {
 				throw std::invalid_argument( "Cannot add two DGSoln's with different numbers of variables" );
 			if ( grid != other.grid )
 				throw std::invalid_argument( "Cannot add two DGSoln's with different grids" );
-			for ( Index i=0; i < nVars; ++i )
-			{
-				u_[ i ].copy( other.u_[ i ] );
-				q_[ i ].copy( other.q_[ i ] );
-
-				sigma_[ i ].copy( other.sigma_[ i ] );
-
-				lambda_[ i ] = other.lambda_[ i ];
-			}
+			if ( orders != other.orders )
+				throw std::invalid_argument( "Cannot add two DGSoln's with different polynomial degrees" );
+			// Every field and lambda are one contiguous block of getDoF() values, which only match up in the same layout
+			if ( layout == other.layout )
+				data() = other.data();
+			else
+				for ( Index i=0; i < nVars; ++i )
+				{
+					u_[ i ].copy( other.u_[ i ] );
+					q_[ i ].copy( other.q_[ i ] );
+					sigma_[ i ].copy( other.sigma_[ i ] );
+					lambda_[ i ] = other.lambda_[ i ];
+				}
 		}
 
 		DGSoln& operator+=( DGSoln const& other )
@@ -77,84 +283,83 @@ class DGSoln {
 				throw std::invalid_argument( "Cannot add two DGSoln's with different numbers of variables" );
 			if ( grid != other.grid )
 				throw std::invalid_argument( "Cannot add two DGSoln's with different grids" );
-			for ( Index i=0; i < nVars; ++i )
-			{
-				u_[ i ] += other.u_[ i ];
-				q_[ i ] += other.q_[ i ];
-
-				sigma_[ i ] += other.sigma_[ i ];
-
-				lambda_[ i ] += other.lambda_[ i ];
-			}
+			if ( orders != other.orders )
+				throw std::invalid_argument( "Cannot add two DGSoln's with different polynomial degrees" );
+			if ( layout == other.layout )
+				data() += other.data();
+			else
+				for ( Index i=0; i < nVars; ++i )
+				{
+					u_[ i ] += other.u_[ i ];
+					q_[ i ] += other.q_[ i ];
+					sigma_[ i ] += other.sigma_[ i ];
+					lambda_[ i ] += other.lambda_[ i ];
+				}
 			return *this;
 		}
 
-		void AssignU( std::function< double( Index, double ) > u_fn ) {
+		// u_fn( var, x ), called directly at each quadrature node
+		template< typename F >
+		void AssignU( F const& u_fn ) {
 			for ( Index i = 0 ; i < nVars; ++i ) {
-				u_[ i ] = std::bind( u_fn, i, std::placeholders::_1 );
+				u_[ i ] = [ &u_fn, i ]( double x ){ return u_fn( i, x ); };
 			}
-		};
+		}
 
-		void AssignQ( std::function< double( Index, double ) > q_fn ) {
+		template< typename F >
+		void AssignQ( F const& q_fn ) {
 			for ( Index i = 0 ; i < nVars; ++i ) {
-				q_[ i ] = std::bind( q_fn, i, std::placeholders::_1 );
+				q_[ i ] = [ &q_fn, i ]( double x ){ return q_fn( i, x ); };
 			}
-		};
+		}
 
 		// Sets lambda = average of u either side of the boundary
 		void EvaluateLambda() {
 			Index nCells = grid.getNCells();
 			for ( Index var = 0; var < nVars; ++var ) {
+				BasisTable const& basis = u_[ var ].basis();
+				lambda_[ var ].setZero();
 				for ( Index i = 0; i < nCells; ++i ) {
 					Interval const& I = grid[ i ];
-					lambda_[ var ]( i ) += LegendreBasis::Evaluate( I, u_[ var ].coeffs[ i ].second, I.x_l ) / 2.0;
-					lambda_[ var ]( i + 1 ) += LegendreBasis::Evaluate( I, u_[ var ].coeffs[ i ].second, I.x_u ) / 2.0;
+					lambda_[ var ]( i ) += basis.EvaluateLower( I, u_[ var ].coeffs().col( i ) ) / 2.0;
+					lambda_[ var ]( i + 1 ) += basis.EvaluateUpper( I, u_[ var ].coeffs().col( i ) ) / 2.0;
 				}
 				// Just set boundaries to the trace value of u. BCs are someone else's job
-				lambda_[ var ]( 0 )      = LegendreBasis::Evaluate( grid[ 0 ],          u_[ var ].coeffs[ 0 ].second,          grid.lowerBoundary() );
-				lambda_[ var ]( nCells ) = LegendreBasis::Evaluate( grid[ nCells - 1 ], u_[ var ].coeffs[ nCells - 1 ].second, grid.upperBoundary() );
+				lambda_[ var ]( 0 )      = basis.EvaluateLower( grid[ 0 ],          u_[ var ].coeffs().col( 0 ) );
+				lambda_[ var ]( nCells ) = basis.EvaluateUpper( grid[ nCells - 1 ], u_[ var ].coeffs().col( nCells - 1 ) );
 			}
 		};
 
-		void AssignSigma( std::function< Value( Index, const Values &, const Values &, Position, Time )> sigmaFn ) {
+		// sigmaFn( var, u, q, x, t ) is any callable with the signature of TransportSystem::SigmaFn
+		template< typename F >
+		void AssignSigma( F const& sigmaFn ) {
+			AssignSigma( sigmaFn, basis() );
+		}
 
-			auto const& x_vals = DGApprox::Integrator().abscissa();
-			auto const& x_wgts = DGApprox::Integrator().weights();
-			const size_t n_abscissa = x_vals.size();
+		// Projects with the quadrature rule of basis, so the solver can use the same nodes as its residual.
+		// u & q are evaluated at every node of every cell at once, and sigma projected back the same way
+		template< typename F >
+		void AssignSigma( F const& sigmaFn, BasisTable const& basis ) {
 
-			for ( Index var = 0; var < nVars; ++var ) {
-				for( auto & coeffPair : sigma_[ var ].coeffs ) {
-					Interval const & I = coeffPair.first;
-					coeffPair.second.setZero();
-					for ( size_t i=0; i < n_abscissa; ++i ) {
-						// Pull the loop over the gaussian integration points
-						// outside so we can evaluate u, q, sigmaFn once and store the values
-
-						// Abscissa only stores positive points, so we have to double up manually
-
-						Values u_vals1( nVars ), q_vals1( nVars );
-						Values u_vals2( nVars ), q_vals2( nVars );
-
-						double y_plus  = I.x_l + ( 1 + x_vals[ i ] ) * I.h()/2.0;
-						double y_minus = I.x_l + ( 1 - x_vals[ i ] ) * I.h()/2.0;
-						double wgt = x_wgts[ i ]*( I.h()/2.0 );
-						for ( Index j = 0 ; j < nVars; ++j ) {
-							u_vals1[ j ] = u_[ j ]( y_plus, I );
-							q_vals1[ j ] = q_[ j ]( y_plus, I );
-							u_vals2[ j ] = u_[ j ]( y_minus, I );
-							q_vals2[ j ] = q_[ j ]( y_minus, I );
-						}
-
-						double sigma_plus  = sigmaFn( var, u_vals1, q_vals1, y_plus,  0.0 );
-						double sigma_minus = sigmaFn( var, u_vals2, q_vals2, y_minus, 0.0 );
-
-						for ( Index j = 0; j < k + 1; ++j ) {
-							coeffPair.second[ j ] += wgt * sigma_plus  * LegendreBasis::Evaluate( I, j, y_plus  );
-							coeffPair.second[ j ] += wgt * sigma_minus * LegendreBasis::Evaluate( I, j, y_minus );
-						}
+			Index nCells = grid.getNCells();
+			Matrix values( basis.nNodes(), 3*nVars*nCells );
+			EvaluateAtNodes( basis, values );
+
+			Values u_vals( nVars ), q_vals( nVars );
+			for ( Index iCell = 0; iCell < nCells; ++iCell ) {
+				Interval const & I = grid[ iCell ];
+				for ( Index q = 0; q < basis.nNodes(); ++q ) {
+					double x = basis.x( I, q );
+					for ( Index j = 0 ; j < nVars; ++j ) {
+						u_vals[ j ] = values( q, coeffColumn( iCell, U, j ) );
+						q_vals[ j ] = values( q, coeffColumn( iCell, Q, j ) );
 					}
+					for ( Index var = 0; var < nVars; ++var )
+						values( q, coeffColumn( iCell, Sigma, var ) ) = sigmaFn( var, u_vals, q_vals, x, 0.0 );
 				}
 			}
+
+			ProjectFromNodes( basis, values, Sigma, 0, nCells );
 		}
 
 		void zeroCoeffs() {
@@ -162,21 +367,49 @@ class DGSoln {
 			assert( nInitialised == 0 || nInitialised == nVars ); 
 			if ( nInitialised == 0 )
 				return;
-			for ( Index i = 0; i < nVars; ++i ) {
-				u_[ i ].zeroCoeffs();
-				q_[ i ].zeroCoeffs();
-				sigma_[ i ].zeroCoeffs();
-				lambda_[ i ].setZero();
-			}
+			data().setZero();
 		}
 
 	private:
+		VectorWrapper data() { return VectorWrapper( data_, getDoF() ); };
+		Eigen::Map< const Vector > data() const { return Eigen::Map< const Vector >( data_, getDoF() ); };
+
+		// Where everything belonging to variable var starts in the VariableMajor layout
+		Index variableOffset( Index var ) const { return 3*offsets[ var ]*grid.getNCells() + var*( grid.getNCells() + 1 ); };
+
+		// The nodal transforms need a table of at least the highest degree, and one of exactly that degree for all the variables if it is nodal
+		void checkBasis( BasisTable const& basis ) const {
+			if ( basis.order() < k || ( basis.isNodal() && ( basis.order() != k || !uniformOrder() ) ) )
+				throw std::invalid_argument( "Basis cannot represent every variable of this DGSoln" );
+		};
+
+		// Field f of variable var on cells [ first, last ), one column per cell
+		DGApprox::CoeffMatrix fieldCoeffs( Field f, Index var, Index first, Index last ) {
+			return DGApprox::CoeffMatrix( data_ + coeffOffset( first, f, var ), orders[ var ] + 1, last - first, Eigen::OuterStride<>( cellStride( var ) ) );
+		};
+		DGApprox::ConstCoeffMatrix fieldCoeffs( Field f, Index var, Index first, Index last ) const {
+			return DGApprox::ConstCoeffMatrix( data_ + coeffOffset( first, f, var ), orders[ var ] + 1, last - first, Eigen::OuterStride<>( cellStride( var ) ) );
+		};
+		// The matching columns of nodal values for nCellsInRange cells
+		Eigen::Map< Matrix, 0, Eigen::OuterStride<> > fieldValues( Eigen::Ref< Matrix > values, Field f, Index var, Index nCellsInRange ) const {
+			return Eigen::Map< Matrix, 0, Eigen::OuterStride<> >( values.data() + coeffColumn( 0, f, var )*values.outerStride(), values.rows(), nCellsInRange, Eigen::OuterStride<>( 3*nVars*values.outerStride() ) );
+		};
+		Eigen::Map< const Matrix, 0, Eigen::OuterStride<> > fieldValues( Eigen::Ref< const Matrix > const& values, Field f, Index var, Index nCellsInRange ) const {
+			return Eigen::Map< const Matrix, 0, Eigen::OuterStride<> >( values.data() + coeffColumn( 0, f, var )*values.outerStride(), values.rows(), nCellsInRange, Eigen::OuterStride<>( 3*nVars*values.outerStride() ) );
+		};
+
 		const Index nVars;
 		const Grid& grid;
 		const Index k;
+		Layout layout;
+		// Degree of each variable, where each starts within a field of a cell, and the size S of that field
+		std::vector< Index > orders, offsets;
+		Index fieldSize = 0;
+		BasisTable const* pBasis = nullptr;
+		double* data_ = nullptr;
 		std::vector< DGApprox > u_;
 		std::vector< DGApprox > q_;
 		std::vector< DGApprox > sigma_;
-		std::vector< VectorWrapper > lambda_;
+		std::vector< LambdaWrapper > lambda_;
 };
 #endif // DGSOLN_HPP
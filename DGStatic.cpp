@@ -3,6 +3,265 @@
 
 #include "gridStructures.hpp"
 
-DGApprox::IntegratorType DGApprox::integrator;
+#include <mutex>
+#include <tuple>
 
+// P_0 .. P_k at every y, by ( j + 1 ) P_{j+1} = ( 2j + 1 ) y P_j - j P_{j-1}, which gives P_j( +-1 ) = ( +-1 )^j exactly
+static void LegendreRecurrence( Index k, Eigen::Ref< const Vector > const& y, Eigen::Ref< Matrix > P )
+{
+	P.col( 0 ).setOnes();
+	if ( k >= 1 )
+		P.col( 1 ) = y;
+	for ( Index j = 1; j < k; ++j )
+		P.col( j + 1 ).array() = ( ( 2.0*j + 1.0 ) * y.array() * P.col( j ).array() - j * P.col( j - 1 ).array() )/( j + 1.0 );
+}
 
+void LegendreBasis::ReferenceValues( Index k, Eigen::Ref< const Vector > const& y, Eigen::Ref< Matrix > Phi )
+{
+	LegendreRecurrence( k, y, Phi );
+	for ( Index j = 0; j <= k; ++j )
+		Phi.col( j ) *= ::sqrt( 2.0*j + 1.0 );
+}
+
+void LegendreBasis::ReferenceAll( Index k, Eigen::Ref< const Vector > const& y, Eigen::Ref< Matrix > Phi, Eigen::Ref< Matrix > DPhi )
+{
+	LegendreRecurrence( k, y, Phi );
+	// P_{j+1}' = P_{j-1}' + ( 2j + 1 ) P_j, done before normalising so the P_j' are the integers ( +-1 )^( j + 1 ) j ( j + 1 ) / 2 at y = +-1
+	DPhi.col( 0 ).setZero();
+	if ( k >= 1 )
+		DPhi.col( 1 ).setOnes();
+	for ( Index j = 1; j < k; ++j )
+		DPhi.col( j + 1 ) = DPhi.col( j - 1 ) + ( 2.0*j + 1.0 ) * Phi.col( j );
+	for ( Index j = 0; j <= k; ++j )
+	{
+		Phi.col( j ) *= ::sqrt( 2.0*j + 1.0 );
+		DPhi.col( j ) *= ::sqrt( 2.0*j + 1.0 );
+	}
+}
+
+void LegendreBasis::EvaluateAll( Interval const& I, Index k, Eigen::Ref< const Vector > const& x, Eigen::Ref< Matrix > values )
+{
+	Vector y = ( 2.0/I.h() ) * ( x.array() - I.x_l ) - 1.0;
+	ReferenceValues( k, y, values );
+	values /= ::sqrt( I.h() );
+}
+
+void LegendreBasis::PrimeAll( Interval const& I, Index k, Eigen::Ref< const Vector > const& x, Eigen::Ref< Matrix > derivatives )
+{
+	Vector y = ( 2.0/I.h() ) * ( x.array() - I.x_l ) - 1.0;
+	Matrix Phi( x.size(), k + 1 );
+	ReferenceAll( k, y, Phi, derivatives );
+	derivatives *= ( 2.0/I.h() )/::sqrt( I.h() );
+}
+
+void BasisTable::GaussLegendre( Index n, Vector& x, Vector& w )
+{
+	if ( n <= 0 )
+		throw std::invalid_argument( "Gauss-Legendre rule needs a strictly positive number of nodes" );
+
+	x.resize( n );
+	w.resize( n );
+	// Newton iteration on P_n, from the usual asymptotic guess; the rule is symmetric so only do half
+	for ( Index i = 0; i < ( n + 1 )/2; ++i )
+	{
+		double y = std::cos( M_PI * ( i + 0.75 )/( n + 0.5 ) );
+		double dP = 0.0;
+		for ( int iter = 0; iter < 100; ++iter )
+		{
+			// P_n( y ) and P_{n-1}( y ) by the three-term recurrence
+			double P = 1.0, PPrev = 0.0;
+			for ( Index j = 1; j <= n; ++j )
+			{
+				double PNext = ( ( 2.0*j - 1.0 )*y*P - ( j - 1.0 )*PPrev )/j;
+				PPrev = P;
+				P = PNext;
+			}
+			dP = n*( y*P - PPrev )/( y*y - 1.0 );
+			double dy = P/dP;
+			y -= dy;
+			if ( std::abs( dy ) < 1e-15 )
+				break;
+		}
+		x[ i ]         = -y;
+		x[ n - 1 - i ] =  y;
+		w[ i ] = w[ n - 1 - i ] = 2.0/( ( 1.0 - y*y )*dP*dP );
+	}
+	if ( n % 2 == 1 )
+		x[ n/2 ] = 0.0;
+}
+
+void BasisTable::GaussLobatto( Index n, Vector& x, Vector& w )
+{
+	if ( n < 2 )
+		throw std::invalid_argument( "Gauss-Lobatto rule needs at least two nodes" );
+
+	x.resize( n );
+	w.resize( n );
+	// The interior nodes are the roots of P_{n-1}'; Newton iteration on ( 1 - y^2 ) P_{n-1}'( y ) = ( n - 1 )( P_{n-2} - y P_{n-1} ),
+	// from the Chebyshev-Gauss-Lobatto nodes. The rule is symmetric so only do half
+	Index N = n - 1;
+	for ( Index i = 0; i < ( n + 1 )/2; ++i )
+	{
+		double y = std::cos( M_PI * i/N );
+		double P = 1.0;
+		for ( int iter = 0; iter < 100; ++iter )
+		{
+			double PPrev = 0.0;
+			P = 1.0;
+			for ( Index j = 1; j <= N; ++j )
+			{
+				double PNext = ( ( 2.0*j - 1.0 )*y*P - ( j - 1.0 )*PPrev )/j;
+				PPrev = P;
+				P = PNext;
+			}
+			if ( i == 0 )
+				break;
+			double dy = ( y*P - PPrev )/( n*P );
+			y -= dy;
+			if ( std::abs( dy ) < 1e-15 )
+				break;
+		}
+		x[ i ]         = -y;
+		x[ n - 1 - i ] =  y;
+		w[ i ] = w[ n - 1 - i ] = 2.0/( N*n*P*P );
+	}
+	if ( n % 2 == 1 )
+		x[ n/2 ] = 0.0;
+}
+
+// Values and derivatives at y of the Lagrange polynomials on the given nodes, with bary the barycentric weights
+static void Lagrange( Vector const& nodes, Vector const& bary, double y, Vector& l, Vector& dl )
+{
+	Index n = nodes.size();
+	l.resize( n );
+	dl.resize( n );
+	for ( Index j = 0; j < n; ++j )
+	{
+		double p = bary[ j ], dp = 0.0;
+		for ( Index m = 0; m < n; ++m )
+		{
+			if ( m == j )
+				continue;
+			dp = dp*( y - nodes[ m ] ) + p;
+			p *= ( y - nodes[ m ] );
+		}
+		l[ j ] = p;
+		dl[ j ] = dp;
+	}
+}
+
+BasisTable::BasisTable( Index Order, Index nNodes, Type t )
+	: k( Order ), basisType( t )
+{
+	if ( nNodes < Order + 1 )
+		throw std::invalid_argument( "Quadrature needs at least k + 1 nodes to integrate the mass matrix exactly" );
+	if ( isNodal() && nNodes != Order + 1 )
+		throw std::invalid_argument( "A nodal basis is collocated with its quadrature, so needs exactly k + 1 nodes" );
+
+	switch ( basisType )
+	{
+		case Type::Legendre:
+		case Type::Gauss:
+			GaussLegendre( nNodes, nodes, weights );
+			break;
+		case Type::GaussLobatto:
+			if ( k == 0 )
+				throw std::invalid_argument( "The Gauss-Lobatto basis needs k >= 1" );
+			GaussLobatto( nNodes, nodes, weights );
+			break;
+	}
+
+	Phi.resize( k + 1, nodes.size() );
+	DPhi.resize( k + 1, nodes.size() );
+	PhiLower.resize( k + 1 );
+	PhiUpper.resize( k + 1 );
+	DPhiLower.resize( k + 1 );
+	DPhiUpper.resize( k + 1 );
+
+	if ( isNodal() )
+	{
+		baryWeights.resize( k + 1 );
+		for ( Index j = 0; j <= k; ++j )
+		{
+			baryWeights[ j ] = 1.0;
+			for ( Index m = 0; m <= k; ++m )
+				if ( m != j )
+					baryWeights[ j ] /= ( nodes[ j ] - nodes[ m ] );
+		}
+
+		Vector norm = ( 2.0/weights.array() ).sqrt();
+		Vector l, dl;
+		for ( Index q = 0; q <= k; ++q )
+		{
+			Lagrange( nodes, baryWeights, nodes[ q ], l, dl );
+			Phi.col( q ) = norm.cwiseProduct( l );
+			DPhi.col( q ) = norm.cwiseProduct( dl );
+		}
+		Lagrange( nodes, baryWeights, -1.0, l, dl );
+		PhiLower = norm.cwiseProduct( l );
+		DPhiLower = norm.cwiseProduct( dl );
+		Lagrange( nodes, baryWeights, 1.0, l, dl );
+		PhiUpper = norm.cwiseProduct( l );
+		DPhiUpper = norm.cwiseProduct( dl );
+
+		PhiW = Phi * weights.asDiagonal();
+		// Phi_i Phi_j' has degree 2k - 1, which both rules integrate exactly
+		RefDerivative = PhiW * DPhi.transpose();
+		RefLowerEdge = PhiLower * PhiLower.transpose();
+		RefUpperEdge = PhiUpper * PhiUpper.transpose();
+		return;
+	}
+
+	// The nodes and then the two endpoints, in one batch
+	Vector y( nodes.size() + 2 );
+	y << nodes, -1.0, 1.0;
+	Matrix PhiAll( y.size(), k + 1 ), DPhiAll( y.size(), k + 1 );
+	LegendreBasis::ReferenceAll( k, y, PhiAll, DPhiAll );
+	Phi = PhiAll.topRows( nodes.size() ).transpose();
+	DPhi = DPhiAll.topRows( nodes.size() ).transpose();
+	PhiLower = PhiAll.row( nodes.size() ).transpose();
+	PhiUpper = PhiAll.row( nodes.size() + 1 ).transpose();
+	DPhiLower = DPhiAll.row( nodes.size() ).transpose();
+	DPhiUpper = DPhiAll.row( nodes.size() + 1 ).transpose();
+	PhiW = Phi * weights.asDiagonal();
+
+	// ( Phi_i, Phi_j' ) = 2 sqrt( ( 2i + 1 )( 2j + 1 ) ) for j > i with i + j odd, and zero otherwise,
+	// as P_j' is a combination of P_{j-1}, P_{j-3}, ... with ( P_i, P_j' ) = 2 for each of them
+	RefDerivative = Matrix::Zero( k + 1, k + 1 );
+	for ( Index i = 0; i <= k; ++i )
+		for ( Index j = i + 1; j <= k; j += 2 )
+			RefDerivative( i, j ) = 2.0 * ::sqrt( ( 2.0*i + 1.0 )*( 2.0*j + 1.0 ) );
+	RefLowerEdge = PhiLower * PhiLower.transpose();
+	RefUpperEdge = PhiUpper * PhiUpper.transpose();
+}
+
+double BasisTable::EvaluateAt( Interval const& I, Eigen::Ref< const Vector > const& c, double x ) const
+{
+	if ( !isNodal() )
+		return LegendreBasis::Evaluate( I, c, x );
+
+	double y = 2.0*( x - I.x_l )/I.h() - 1.0;
+	double result = 0.0;
+	for ( Index j = 0; j <= k; ++j )
+	{
+		double l = baryWeights[ j ];
+		for ( Index m = 0; m <= k; ++m )
+			if ( m != j )
+				l *= ( y - nodes[ m ] );
+		result += c[ j ] * l * ::sqrt( 2.0/weights[ j ] );
+	}
+	return result/::sqrt( I.h() );
+}
+
+BasisTable const& BasisTable::Get( Index Order, Index nNodes, Type t )
+{
+	static std::mutex tableLock;
+	static std::map< std::tuple< Index, Index, Type >, std::unique_ptr< BasisTable > > tables;
+
+	std::lock_guard< std::mutex > lock( tableLock );
+	auto key = std::make_tuple( Order, nNodes, t );
+	auto it = tables.find( key );
+	if ( it == tables.end() )
+		it = tables.emplace( key, std::make_unique< BasisTable >( Order, nNodes, t ) ).first;
+	return *it->second;
+}
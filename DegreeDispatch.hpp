@@ -0,0 +1,61 @@
+#ifndef DEGREEDISPATCH_HPP
+#define DEGREEDISPATCH_HPP
+
+#include "Types.hpp"
+
+#include <type_traits>
+
+/*
+	Compile-time cell sizes for the per-cell kernels
+
+	The polynomial degree k is fixed for a run and small, so the hot cell kernels are templated on
+	N = k + 1, and on V = nVars for scalar problems, and use fixed-size Eigen blocks of those sizes
+	that the compiler can unroll. DispatchOnCellSize picks the instantiation from the runtime k and nVars.
+	Above MaxSpecialisedDegree, or with more than one variable, the corresponding size is Eigen::Dynamic,
+	which is the general dynamically-sized path, so every kernel must also work for Eigen::Dynamic.
+ */
+
+constexpr Index MaxSpecialisedDegree = 4;
+
+template< int N >
+using CellSize = std::integral_constant< int, N >;
+
+// n blocks of size N, Dynamic if either is
+constexpr int BlockSize( int n, int N ) { return ( n == Eigen::Dynamic || N == Eigen::Dynamic ) ? Eigen::Dynamic : n*N; }
+
+// Calls f( CellSize< N >(), CellSize< V >() ) with N = k + 1 and V = nVars where those are specialised, Eigen::Dynamic otherwise
+template< typename F >
+void DispatchOnCellSize( Index k, Index nVars, F&& f )
+{
+	auto withVars = [ & ]( auto N ) {
+		if ( nVars == 1 )
+			f( N, CellSize< 1 >() );
+		else
+			f( N, CellSize< Eigen::Dynamic >() );
+	};
+
+	static_assert( MaxSpecialisedDegree == 4, "Add the new cases to DispatchOnCellSize" );
+	switch ( k )
+	{
+		case 0:
+			withVars( CellSize< 1 >() );
+			break;
+		case 1:
+			withVars( CellSize< 2 >() );
+			break;
+		case 2:
+			withVars( CellSize< 3 >() );
+			break;
+		case 3:
+			withVars( CellSize< 4 >() );
+			break;
+		case 4:
+			withVars( CellSize< 5 >() );
+			break;
+		default:
+			withVars( CellSize< Eigen::Dynamic >() );
+			break;
+	}
+}
+
+#endif // DEGREEDISPATCH_HPP
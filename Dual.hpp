@@ -0,0 +1,129 @@
+#ifndef DUAL_HPP
+#define DUAL_HPP
+
+#include "Types.hpp"
+
+#include <cmath>
+
+/*
+	Forward-mode automatic differentiation
+
+	A Dual carries a value and its derivatives along up to MaxDirections directions at once, e.g. with respect to
+	every component of u, q & sigma, so that one evaluation of a function templated on its scalar type gives the
+	value and its whole gradient. The number of directions is set at run time when the independent variables are
+	seeded, and the derivative storage is fixed at MaxDirections, so arithmetic on Duals never allocates.
+	A Dual with no derivatives is a constant, which is what converting a double gives.
+ */
+
+template< int MaxDirections >
+class Dual
+{
+	public:
+		using Derivatives = Eigen::Matrix< double, Eigen::Dynamic, 1, 0, MaxDirections, 1 >;
+
+		Dual() : val( 0.0 ) {};
+		Dual( double v ) : val( v ) {};
+		Dual( double v, Derivatives const& d ) : val( v ), dv( d ) {};
+		// Independent variable number dir of nDirections
+		Dual( double v, Index nDirections, Index dir ) : val( v ), dv( Derivatives::Unit( nDirections, dir ) ) {};
+
+		double value() const { return val; };
+		Derivatives const& derivatives() const { return dv; };
+		// d/d( direction dir ), zero for constants
+		double derivative( Index dir ) const { return dv.size() == 0 ? 0.0 : dv[ dir ]; };
+
+		Dual& operator+=( Dual const& b ) { addScaled( 1.0, b.dv ); val += b.val; return *this; };
+		Dual& operator-=( Dual const& b ) { addScaled( -1.0, b.dv ); val -= b.val; return *this; };
+		Dual& operator*=( Dual const& b ) { scale( b.val ); addScaled( val, b.dv ); val *= b.val; return *this; };
+		Dual& operator/=( Dual const& b ) { scale( 1.0/b.val ); addScaled( -val/( b.val*b.val ), b.dv ); val /= b.val; return *this; };
+
+		// f( *this ) given f and f'
+		Dual chain( double f, double df ) const { Dual r( f, dv ); r.dv *= df; return r; };
+
+	private:
+		double val;
+		Derivatives dv;
+
+		void scale( double a ) { dv *= a; };
+		void addScaled( double a, Derivatives const& d )
+		{
+			if ( d.size() == 0 )
+				return;
+			if ( dv.size() == 0 )
+				dv = a * d;
+			else
+				dv += a * d;
+		};
+};
+
+template< int M > Dual< M > operator+( Dual< M > a, Dual< M > const& b ) { return a += b; }
+template< int M > Dual< M > operator-( Dual< M > a, Dual< M > const& b ) { return a -= b; }
+template< int M > Dual< M > operator*( Dual< M > a, Dual< M > const& b ) { return a *= b; }
+template< int M > Dual< M > operator/( Dual< M > a, Dual< M > const& b ) { return a /= b; }
+template< int M > Dual< M > operator-( Dual< M > const& a ) { return a.chain( -a.value(), -1.0 ); }
+template< int M > Dual< M > operator+( Dual< M > const& a ) { return a; }
+
+template< int M > Dual< M > operator+( Dual< M > a, double b ) { return a += b; }
+template< int M > Dual< M > operator+( double a, Dual< M > b ) { return b += a; }
+template< int M > Dual< M > operator-( Dual< M > a, double b ) { return a -= b; }
+template< int M > Dual< M > operator-( double a, Dual< M > const& b ) { return Dual< M >( a ) -= b; }
+template< int M > Dual< M > operator*( Dual< M > const& a, double b ) { return a.chain( a.value()*b, b ); }
+template< int M > Dual< M > operator*( double a, Dual< M > const& b ) { return b.chain( a*b.value(), a ); }
+template< int M > Dual< M > operator/( Dual< M > const& a, double b ) { return a.chain( a.value()/b, 1.0/b ); }
+template< int M > Dual< M > operator/( double a, Dual< M > const& b ) { return b.chain( a/b.value(), -a/( b.value()*b.value() ) ); }
+
+// Comparisons are of the values, so that branches in templated physics take the same path as for doubles
+template< int M > bool operator< ( Dual< M > const& a, Dual< M > const& b ) { return a.value() <  b.value(); }
+template< int M > bool operator> ( Dual< M > const& a, Dual< M > const& b ) { return a.value() >  b.value(); }
+template< int M > bool operator<=( Dual< M > const& a, Dual< M > const& b ) { return a.value() <= b.value(); }
+template< int M > bool operator>=( Dual< M > const& a, Dual< M > const& b ) { return a.value() >= b.value(); }
+template< int M > bool operator==( Dual< M > const& a, Dual< M > const& b ) { return a.value() == b.value(); }
+template< int M > bool operator!=( Dual< M > const& a, Dual< M > const& b ) { return a.value() != b.value(); }
+template< int M > bool operator< ( Dual< M > const& a, double b ) { return a.value() <  b; }
+template< int M > bool operator> ( Dual< M > const& a, double b ) { return a.value() >  b; }
+template< int M > bool operator<=( Dual< M > const& a, double b ) { return a.value() <= b; }
+template< int M > bool operator>=( Dual< M > const& a, double b ) { return a.value() >= b; }
+template< int M > bool operator==( Dual< M > const& a, double b ) { return a.value() == b; }
+template< int M > bool operator!=( Dual< M > const& a, double b ) { return a.value() != b; }
+template< int M > bool operator< ( double a, Dual< M > const& b ) { return a <  b.value(); }
+template< int M > bool operator> ( double a, Dual< M > const& b ) { return a >  b.value(); }
+template< int M > bool operator<=( double a, Dual< M > const& b ) { return a <= b.value(); }
+template< int M > bool operator>=( double a, Dual< M > const& b ) { return a >= b.value(); }
+
+// The usual functions, found by argument-dependent lookup so templated physics should call them unqualified after
+// using std::exp; etc., which then works for doubles too
+template< int M > Dual< M > exp( Dual< M > const& a ) { double e = std::exp( a.value() ); return a.chain( e, e ); }
+template< int M > Dual< M > log( Dual< M > const& a ) { return a.chain( std::log( a.value() ), 1.0/a.value() ); }
+template< int M > Dual< M > sqrt( Dual< M > const& a ) { double s = std::sqrt( a.value() ); return a.chain( s, 0.5/s ); }
+template< int M > Dual< M > sin( Dual< M > const& a ) { return a.chain( std::sin( a.value() ), std::cos( a.value() ) ); }
+template< int M > Dual< M > cos( Dual< M > const& a ) { return a.chain( std::cos( a.value() ), -std::sin( a.value() ) ); }
+template< int M > Dual< M > tanh( Dual< M > const& a ) { double t = std::tanh( a.value() ); return a.chain( t, 1.0 - t*t ); }
+template< int M > Dual< M > abs( Dual< M > const& a ) { return a.value() < 0.0 ? -a : a; }
+template< int M > Dual< M > pow( Dual< M > const& a, double n ) { return a.chain( std::pow( a.value(), n ), n*std::pow( a.value(), n - 1.0 ) ); }
+template< int M > Dual< M > pow( double b, Dual< M > const& a ) { double p = std::pow( b, a.value() ); return a.chain( p, p*std::log( b ) ); }
+template< int M > Dual< M > pow( Dual< M > const& a, Dual< M > const& b ) { return exp( b*log( a ) ); }
+
+// So that Eigen vectors and matrices of Duals work
+namespace Eigen {
+	template< int M > struct NumTraits< Dual< M > > : NumTraits< double >
+	{
+		using Real = Dual< M >;
+		using NonInteger = Dual< M >;
+		using Nested = Dual< M >;
+		using Literal = double;
+		enum {
+			IsComplex = 0,
+			IsInteger = 0,
+			IsSigned = 1,
+			RequireInitialization = 1,
+			ReadCost = M + 1,
+			AddCost = M + 1,
+			MulCost = 2*M + 1
+		};
+	};
+
+	template< int M, typename BinaryOp > struct ScalarBinaryOpTraits< Dual< M >, double, BinaryOp > { using ReturnType = Dual< M >; };
+	template< int M, typename BinaryOp > struct ScalarBinaryOpTraits< double, Dual< M >, BinaryOp > { using ReturnType = Dual< M >; };
+}
+
+#endif // DUAL_HPP
@@ -45,11 +45,14 @@ int main( int argc, char** argv )
 	int nCells;
 
 	unsigned int k = 1;
+	// Either one degree for every variable, or an array with the degree of each
+	std::vector< Index > degrees;
 
 	auto polyDegree = toml::find(config, "Polynomial_degree");
 	if( config.count("Polynomial_degree") != 1 ) throw std::invalid_argument( "Polynomial_degree unspecified or specified more than once" );
-	else if( !polyDegree.is_integer() ) throw std::invalid_argument( "Polynomial_degree must be specified as an integer" );
-	else k = polyDegree.as_integer();
+	else if( polyDegree.is_integer() ) k = polyDegree.as_integer();
+	else if( polyDegree.is_array() ) degrees = toml::find< std::vector< Index > >( config, "Polynomial_degree" );
+	else throw std::invalid_argument( "Polynomial_degree must be specified as an integer, or an array of integers with one per variable" );
 
 	if ( config.count( "High_Grid_Boundary" ) != 1 ) highGridBoundary = false;
 	else
@@ -105,7 +108,12 @@ int main( int argc, char** argv )
 		return 1;
 	}
 
-	system = std::make_shared<SystemSolver>( grid, k, dt, pProblem );
+	if ( degrees.empty() )
+		system = std::make_shared<SystemSolver>( grid, k, dt, pProblem );
+	else if ( static_cast<Index>( degrees.size() ) == pProblem->getNumVars() )
+		system = std::make_shared<SystemSolver>( grid, degrees, dt, pProblem );
+	else
+		throw std::invalid_argument( "Polynomial_degree must have one entry per variable" );
 
 	// TODO: stop parsing the config file again inside this function
 	system->runSolver(fname);
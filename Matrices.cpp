@@ -9,20 +9,20 @@
 
 
 
-void SystemSolver::NLqMat( Matrix& NLq, DGSoln const &Y, Interval I ) {
+void SystemSolver::NLqMat( Matrix& NLq, DGSoln const &Y, Index i, CellWorkspace& w ) {
 	//	[ dkappa_1dq1    dkappa_1dq2    dkappa_1dq3 ]
 	//	[ dkappa_2dq1    dkappa_2dq2    dkappa_2dq3 ]
 	//	[ dkappa_3dq1    dkappa_3dq2    dkappa_3dq3 ]
 
-	DerivativeSubMatrix( NLq, &TransportSystem::dSigmaFn_dq, Y, I );
+	DerivativeSubMatrix( NLq, TransportSystem::Derivative::dSigma_dq, Y, i, w );
 }
 
-void SystemSolver::NLuMat( Matrix& NLu, DGSoln const& Y, Interval I ) {
+void SystemSolver::NLuMat( Matrix& NLu, DGSoln const& Y, Index i, CellWorkspace& w ) {
 	//	[ dkappa_1du1    dkappa_1du2    dkappa_1du3 ]
 	//	[ dkappa_2du1    dkappa_2du2    dkappa_2du3 ]
 	//	[ dkappa_3du1    dkappa_3du2    dkappa_3du3 ]
 
-	DerivativeSubMatrix( NLu, &TransportSystem::dSigmaFn_du, Y, I );
+	DerivativeSubMatrix( NLu, TransportSystem::Derivative::dSigma_du, Y, i, w );
 }
 
 // Sets matrices of the form
@@ -32,81 +32,153 @@ void SystemSolver::NLuMat( Matrix& NLu, DGSoln const& Y, Interval I ) {
 //
 // where X is a sigma function or a source function and Z is one of u, q, or sigma.
  
-void SystemSolver::DerivativeSubMatrix( Matrix& mat, void ( TransportSystem::*dX_dZ )( Index, Values&, const Values&, const Values&, Position, double ), DGSoln const& Y, Interval I )
+void SystemSolver::DerivativeSubMatrix( Matrix& mat, TransportSystem::Derivative d, DGSoln const& Y, Index i, CellWorkspace& w )
 {
-	auto const& x_vals = DGApprox::Integrator().abscissa();
-	auto const& x_wgts = DGApprox::Integrator().weights();
-	const size_t n_abscissa = x_vals.size();
+	dispatchCellKernel( [ & ]( auto NSize, auto ) {
+		DerivativeSubMatrix< decltype( NSize )::value >( mat, d, Y, i, w );
+	} );
+}
+
+// The ( XVar, ZVar ) block of mat is ( k_X + 1 ) x ( k_Z + 1 ), these are all N x N, N = k + 1, unless N is Eigen::Dynamic.
+// Blocks outside the coupling the problem declared for d are left zero, and X is not evaluated at all if its row is empty
+template< int N >
+void SystemSolver::DerivativeSubMatrix( Matrix& mat, TransportSystem::Derivative d, DGSoln const& Y, Index i, CellWorkspace& w )
+{
+	using VectorN = Eigen::Matrix< double, N, 1 >;
+
+	BasisTable const& basis = *pBasis;
+	Interval const& I = grid[ i ];
+	double rootH = ::sqrt( I.h() );
 
-	// ASSERT mat.shape == ( nVars * ( k + 1) , nVars * ( k + 1 ) )
-	assert( mat.rows() == nVars * ( k + 1 ) );
-	assert( mat.cols() == nVars * ( k + 1 ) );
+	// ASSERT mat.shape == ( fieldSize, fieldSize ), nVars * ( k + 1 ) if the degrees are all the same
+	assert( mat.rows() == fieldSize );
+	assert( mat.cols() == fieldSize );
 
 	mat.setZero();
+	DerivativeCoupling const& c = coupling( d );
+	if ( !c.any )
+		return;
 
 	// Phi are basis fn's
 	// M( nVars * K + k, nVars * J + j ) = Int_I ( d sigma_fn_K / d u_J * Phi_k * Phi_j )
 
+	// u & q of every variable at every node, then one call into the physics per row of the pattern
+	Matrix & u_nodes = w.u_nodes, & q_nodes = w.q_nodes, & dX_dZ_nodes = w.dX_dZ_nodes;
+	for ( Index j = 0 ; j < nVars; ++j )
+	{
+		Index n = nCoeffs( j );
+		u_nodes.col( j ).noalias() = ( 1.0/rootH ) * basis.values().template topRows< N >( n ).transpose() * Eigen::Map< const VectorN >( Y.u( j ).getCoeff( i ).second.data(), n );
+		q_nodes.col( j ).noalias() = ( 1.0/rootH ) * basis.values().template topRows< N >( n ).transpose() * Eigen::Map< const VectorN >( Y.q( j ).getCoeff( i ).second.data(), n );
+	}
+	basis.x( I, w.x_nodes );
+
 	for ( Index XVar = 0; XVar < nVars; XVar++ )
 	{
-		Values dX_dZ_vals1( nVars );
-		Values dX_dZ_vals2( nVars );
-		for ( size_t i=0; i < n_abscissa; ++i ) {
-			// Pull the loop over the gaussian integration points
-			// outside so we can evaluate u, q, dX_dZ once and store the values
-			
-			// All for loops inside here can be parallelised as they all
-			// write to separate entries in mat
-			
-			Values u_vals1( nVars ), q_vals1( nVars );
-			Values u_vals2( nVars ), q_vals2( nVars );
-
-			double wgt = x_wgts[ i ]*( I.h()/2.0 );
-
-			double y_plus  = I.x_l + ( 1.0 + x_vals[ i ] )*( I.h()/2.0 );
-			double y_minus = I.x_l + ( 1.0 - x_vals[ i ] )*( I.h()/2.0 );
-
-			for ( size_t j = 0 ; j < nVars; ++j )
-			{
-				u_vals1[ j ] = Y.u( j )( y_plus, I );
-				q_vals1[ j ] = Y.q( j )( y_plus, I );
-				u_vals2[ j ] = Y.u( j )( y_minus, I );
-				q_vals2[ j ] = Y.q( j )( y_minus, I );
-			}
+		if ( !c.pattern.row( XVar ).any() )
+			continue;
+		problem->EvaluateDerivative( d, XVar, u_nodes, q_nodes, w.x_nodes, 0.0, dX_dZ_nodes );
+
+		// A nodal basis is collocated with its quadrature, Phi_j( x_q ) = delta_jq sqrt( 2/w_q ), so each block is
+		// diagonal with the derivative at the nodes on the diagonal ( the weights & 1/h cancel )
+		if ( basis.isNodal() )
+		{
+			for ( Index ZVar = 0; ZVar < nVars; ZVar++ )
+				if ( c.pattern( XVar, ZVar ) )
+					mat.block( blockStart[ XVar ], blockStart[ ZVar ], nCoeffs( XVar ), nCoeffs( ZVar ) ).diagonal() = dX_dZ_nodes.col( ZVar );
+			continue;
+		}
 
-			( problem->*dX_dZ )( XVar, dX_dZ_vals1, u_vals1, q_vals1, y_plus, 0.0 );
-			( problem->*dX_dZ )( XVar, dX_dZ_vals2, u_vals2, q_vals2, y_minus, 0.0 );
+		for ( Index q = 0; q < basis.nNodes(); ++q ) {
+			double wgt = basis.weight( I, q );
+			// Reference basis at this node, phi_j = Phi_j / sqrt( h ). A variable of degree k uses the first k + 1
+			auto Phi = basis.values().col( q );
 
+			// Each ( XVar, ZVar ) block gets a rank-one update phi phi^T
 			for(Index ZVar = 0; ZVar < nVars; ZVar++)
 			{
-				for ( Index j=0; j < k + 1; ++j )
+				if ( !c.pattern( XVar, ZVar ) )
+					continue;
+				Index nX = nCoeffs( XVar ), nZ = nCoeffs( ZVar );
+				mat.template block< N, N >( blockStart[ XVar ], blockStart[ ZVar ], nX, nZ ).noalias() += ( wgt * dX_dZ_nodes( q, ZVar )/I.h() ) * Phi.template head< N >( nX ) * Phi.template head< N >( nZ ).transpose();
+			}
+		}
+	}
+}
+
+void SystemSolver::FusedDerivativeMatrices( std::array< Matrix*, 5 > const& mats, DGSoln const& Y, Index i, CellWorkspace& w )
+{
+	dispatchCellKernel( [ & ]( auto NSize, auto ) {
+		FusedDerivativeMatrices< decltype( NSize )::value >( mats, Y, i, w );
+	} );
+}
+
+// As DerivativeSubMatrix, but with the fluxes, sources and all their derivatives at each node from a single call of
+// each of the problem's fused functions, rather than one call per derivative and variable
+template< int N >
+void SystemSolver::FusedDerivativeMatrices( std::array< Matrix*, 5 > const& mats, DGSoln const& Y, Index i, CellWorkspace& w )
+{
+	using VectorN = Eigen::Matrix< double, N, 1 >;
+
+	BasisTable const& basis = *pBasis;
+	Interval const& I = grid[ i ];
+	double rootH = ::sqrt( I.h() );
+
+	for ( Matrix* mat : mats )
+		mat->setZero();
+
+	Matrix & u_nodes = w.u_nodes, & q_nodes = w.q_nodes, & sigma_nodes = w.sigma_nodes;
+	for ( Index j = 0 ; j < nVars; ++j )
+	{
+		Index n = nCoeffs( j );
+		auto Phi = basis.values().template topRows< N >( n ).transpose();
+		u_nodes.col( j ).noalias() = ( 1.0/rootH ) * Phi * Eigen::Map< const VectorN >( Y.u( j ).getCoeff( i ).second.data(), n );
+		q_nodes.col( j ).noalias() = ( 1.0/rootH ) * Phi * Eigen::Map< const VectorN >( Y.q( j ).getCoeff( i ).second.data(), n );
+		sigma_nodes.col( j ).noalias() = ( 1.0/rootH ) * Phi * Eigen::Map< const VectorN >( Y.sigma( j ).getCoeff( i ).second.data(), n );
+	}
+
+	for ( Index q = 0; q < basis.nNodes(); ++q ) {
+		double wgt = basis.weight( I, q );
+		double x   = basis.x( I, q );
+		auto Phi = basis.values().col( q );
+
+		w.u_vals = u_nodes.row( q ).transpose();
+		w.q_vals = q_nodes.row( q ).transpose();
+		w.sigma_vals = sigma_nodes.row( q ).transpose();
+		for ( Matrix& J : w.fusedJacobians )
+			J.setZero();
+		problem->FluxAndJacobian( w.u_vals, w.q_vals, x, 0.0, w.fusedSigma, w.fusedJacobians[ 0 ], w.fusedJacobians[ 1 ] );
+		problem->SourcesAndJacobian( w.u_vals, w.q_vals, w.sigma_vals, x, 0.0, w.fusedSources, w.fusedJacobians[ 2 ], w.fusedJacobians[ 3 ], w.fusedJacobians[ 4 ] );
+
+		for ( size_t d = 0; d < mats.size(); d++ )
+		{
+			DerivativeCoupling const& c = couplings[ d ];
+			if ( !c.any )
+				continue;
+			for ( Index XVar = 0; XVar < nVars; XVar++ )
+				for ( Index ZVar = 0; ZVar < nVars; ZVar++ )
 				{
-					for ( Index l=0; l < k + 1; ++l )
-					{
-						mat( XVar * nVars + j, ZVar * nVars + l ) +=
-							wgt * dX_dZ_vals1[ ZVar ] * LegendreBasis::Evaluate( I, j, y_plus ) * LegendreBasis::Evaluate( I, l, y_plus );
-						mat( XVar * nVars + j, ZVar * nVars + l ) +=
-							wgt * dX_dZ_vals2[ ZVar ] * LegendreBasis::Evaluate( I, j, y_minus ) * LegendreBasis::Evaluate( I, l, y_minus );
-					}
+					if ( !c.pattern( XVar, ZVar ) )
+						continue;
+					Index nX = nCoeffs( XVar ), nZ = nCoeffs( ZVar );
+					mats[ d ]->template block< N, N >( blockStart[ XVar ], blockStart[ ZVar ], nX, nZ ).noalias() += ( wgt * w.fusedJacobians[ d ]( XVar, ZVar )/I.h() ) * Phi.template head< N >( nX ) * Phi.template head< N >( nZ ).transpose();
 				}
-			}
 		}
 	}
 }
 
-void SystemSolver::dSourcedq_Mat(Eigen::MatrixXd& dSourcedqMatrix, DGSoln const& Y, Interval I)
+void SystemSolver::dSourcedq_Mat(Eigen::MatrixXd& dSourcedqMatrix, DGSoln const& Y, Index i, CellWorkspace& w )
 {
-	DerivativeSubMatrix( dSourcedqMatrix, &TransportSystem::dSources_dq, Y, I );
+	DerivativeSubMatrix( dSourcedqMatrix, TransportSystem::Derivative::dSources_dq, Y, i, w );
 }
 
-void SystemSolver::dSourcedu_Mat(Eigen::MatrixXd& dSourceduMatrix, DGSoln const& Y, Interval I)
+void SystemSolver::dSourcedu_Mat(Eigen::MatrixXd& dSourceduMatrix, DGSoln const& Y, Index i, CellWorkspace& w )
 {
-	DerivativeSubMatrix( dSourceduMatrix, &TransportSystem::dSources_du, Y, I );
+	DerivativeSubMatrix( dSourceduMatrix, TransportSystem::Derivative::dSources_du, Y, i, w );
 }
 
-void SystemSolver::dSourcedsigma_Mat(Eigen::MatrixXd& dSourcedsigmaMatrix, DGSoln const& Y, Interval I )
+void SystemSolver::dSourcedsigma_Mat(Eigen::MatrixXd& dSourcedsigmaMatrix, DGSoln const& Y, Index i, CellWorkspace& w )
 {
-	DerivativeSubMatrix( dSourcedsigmaMatrix, &TransportSystem::dSources_dsigma, Y, I );
+	DerivativeSubMatrix( dSourcedsigmaMatrix, TransportSystem::Derivative::dSources_dsigma, Y, i, w );
 }
 
 
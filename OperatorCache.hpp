@@ -0,0 +1,154 @@
+#ifndef OPERATORCACHE_HPP
+#define OPERATORCACHE_HPP
+
+#include "gridStructures.hpp"
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+	Per-cell, per-variable ( k + 1 ) x ( k + 1 ) operators that do not change in time
+
+	Anything that depends only on the grid, the basis and x ( such as the mass matrix weighted by a_i( x ) )
+	is built here once, when the cell matrices are, and the time-dependent parts of the Jacobian are
+	just scalings of it. Operators are registered with a builder, and looked up by the handle add()
+	returned, or by name. The solver registers its own before calling TransportSystem::addOperators,
+	so physics cases can add theirs and find the solver's.
+
+	Operators are built in the basis of the highest degree. A variable of lower degree k uses
+	the leading ( k + 1 ) x ( k + 1 ) block, which is its operator as the Legendre basis is hierarchical.
+
+	An operator that does not depend on x ( such as the mass matrix for a constant a_i ) can be
+	registered as such, and is then built on one cell of each kind and width and shared by the
+	rest, rather than stored for every cell. The solver's kinds are those of CellMatrices.
+ */
+class OperatorCache
+{
+public:
+	// Fills out, already ( k + 1 ) x ( k + 1 ), with the operator for variable var on cell I
+	using Builder = std::function< void( Index var, Interval const& I, BasisTable const& basis, Matrix& out ) >;
+
+	// Registers an operator, which is built on the next build(). Names are unique. If dependsOnX is false the builder
+	// must give the same result on any two cells of the same kind and width, wherever they are
+	Index add( std::string const& name, Builder b, bool dependsOnX = true )
+	{
+		for ( auto const& op : ops )
+			if ( op.name == name )
+				throw std::invalid_argument( "Operator " + name + " is already in the cache" );
+		ops.push_back( { name, std::move( b ), dependsOnX, {} } );
+		return ops.size() - 1;
+	}
+
+	Index find( std::string const& name ) const
+	{
+		for ( Index i = 0; i < static_cast<Index>( ops.size() ); ++i )
+			if ( ops[ i ].name == name )
+				return i;
+		throw std::invalid_argument( "No operator " + name + " in the cache" );
+	}
+
+	bool contains( std::string const& name ) const
+	{
+		for ( auto const& op : ops )
+			if ( op.name == name )
+				return true;
+		return false;
+	}
+
+	Index size() const { return ops.size(); }
+
+	// Forgets every operator, for when the owner is rebuilt
+	void clear() { ops.clear(); }
+
+	// ( Re )builds every registered operator. One that does not depend on x is built on the first cell of each distinct
+	// pair of kind( i ) and width, and shared with the other cells of that pair. Widths are compared to one part in
+	// 10^12 of the domain, so a uniform grid whose cells differ only by rounding shares one
+	template< typename F >
+	void build( Grid const& grid, Index nVars, BasisTable const& basis, F const& kind )
+	{
+		Index nCells = grid.getNCells();
+		n = basis.order() + 1;
+		vars = nVars;
+		cells = nCells;
+
+		// The slot of each cell, and the first cell in each slot, for the shared operators
+		std::map< std::pair< Index, long long >, Index > slots;
+		double scale = 1e12/( grid.upperBoundary() - grid.lowerBoundary() );
+		std::vector< Index > first;
+		cellKind.clear();
+		bool shared = false;
+		for ( auto const& op : ops )
+			shared = shared || !op.dependsOnX;
+		if ( shared )
+			for ( Index i = 0; i < nCells; ++i )
+			{
+				auto s = slots.emplace( std::make_pair( kind( i ), std::llround( grid[ i ].h()*scale ) ), first.size() );
+				if ( s.second )
+					first.push_back( i );
+				cellKind.push_back( s.first->second );
+			}
+
+		Matrix out( n, n );
+		auto fill = [ & ]( Operator& op, Index i, Index slot ) {
+			for ( Index var = 0; var < nVars; ++var )
+			{
+				out.setZero();
+				op.builder( var, grid[ i ], basis, out );
+				op.blocks[ slot*nVars + var ] = out;
+			}
+		};
+		for ( auto& op : ops )
+		{
+			Index nSlots = op.dependsOnX ? nCells : first.size();
+			op.blocks.assign( nSlots*nVars, Matrix( n, n ) );
+			for ( Index slot = 0; slot < nSlots; ++slot )
+				fill( op, op.dependsOnX ? slot : first[ slot ], slot );
+		}
+	}
+
+	// With every cell of one kind
+	void build( Grid const& grid, Index nVars, BasisTable const& basis )
+	{
+		build( grid, nVars, basis, []( Index ){ return 0; } );
+	}
+
+	Matrix const& operator()( Index op, Index cell, Index var ) const
+	{
+		Operator const& o = ops[ op ];
+		return o.blocks[ ( o.dependsOnX ? cell : cellKind[ cell ] )*vars + var ];
+	}
+
+	bool dependsOnX( Index op ) const { return ops[ op ].dependsOnX; }
+
+	// Bytes of matrix data held, and what keeping every operator for every cell would take
+	size_t bytes() const
+	{
+		size_t values = 0;
+		for ( auto const& op : ops )
+			for ( auto const& b : op.blocks )
+				values += b.size();
+		return values*sizeof( double ) + cellKind.size()*sizeof( Index );
+	}
+	size_t perCellBytes() const
+	{
+		return ops.size()*cells*vars*n*n*sizeof( double );
+	}
+
+private:
+	struct Operator
+	{
+		std::string name;
+		Builder builder;
+		bool dependsOnX;
+		std::vector< Matrix > blocks;
+	};
+	std::vector< Operator > ops;
+	std::vector< Index > cellKind;
+	Index vars = 0, cells = 0, n = 0;
+};
+
+#endif // OPERATORCACHE_HPP
@@ -12,6 +12,12 @@ FishersEquation::FishersEquation( toml::value const& config )
 {
 	// Always set nVars in a derived constructor
 	nVars = 1;
+	// SigmaFn, Sources and their derivatives only read the parameters below
+	threadSafe = true;
+
+	// The flux depends only on q and the source only on u
+	for ( auto d : { Derivative::dSigma_du, Derivative::dSources_dq, Derivative::dSources_dsigma } )
+		declareCoupling( d, Coupling::Constant( nVars, nVars, false ) );
 
 	// Construst your problem from user-specified config
 	// throw an exception if you can't. NEVER leave a part-constructed object around
@@ -82,6 +88,20 @@ void FishersEquation::dSources_dsigma( Index, Values&v , const Values &, const V
 	v[ 0 ] = 0.0;
 };
 
+void FishersEquation::Evaluate( PointValues u, PointValues q, PointValues, Positions, Time, PointResults sigmaOut, PointResults sourcesOut )
+{
+	sigmaOut.col( 0 ) = q.col( 0 );
+	sourcesOut.col( 0 ) = u.col( 0 ).array() * ( 1.0 - u.col( 0 ).array() );
+}
+
+void FishersEquation::EvaluateDerivative( Derivative d, Index, PointValues u, PointValues, Positions, Time, PointResults out )
+{
+	if ( d == Derivative::dSources_du )
+		out.col( 0 ) = 1.0 - 2.0*u.col( 0 ).array();
+	else
+		out.col( 0 ).setConstant( d == Derivative::dSigma_dq ? 1.0 : 0.0 );
+}
+
 // This physics model uses an exact solution for testing purposes
 
 Value FishersEquation::InitialValue( Index, Position x ) const
@@ -12,6 +12,12 @@ LinearDiffusion::LinearDiffusion( toml::value const& config )
 {
 	// Always set nVars in a derived constructor
 	nVars = 1;
+	// SigmaFn, Sources and their derivatives only read the parameters below
+	threadSafe = true;
+
+	// Only the flux depends on anything, and only on q
+	for ( auto d : { Derivative::dSigma_du, Derivative::dSources_du, Derivative::dSources_dq, Derivative::dSources_dsigma } )
+		declareCoupling( d, Coupling::Constant( nVars, nVars, false ) );
 
 	// Construst your problem from user-specified config
 	// throw an exception if you can't. NEVER leave a part-constructed object around
@@ -79,6 +85,17 @@ void LinearDiffusion::dSources_dsigma( Index, Values&v , const Values &, const V
 	v[ 0 ] = 0.0;
 };
 
+void LinearDiffusion::Evaluate( PointValues, PointValues q, PointValues, Positions, Time, PointResults sigmaOut, PointResults sourcesOut )
+{
+	sigmaOut.col( 0 ) = kappa * q.col( 0 );
+	sourcesOut.col( 0 ).setZero();
+}
+
+void LinearDiffusion::EvaluateDerivative( Derivative d, Index, PointValues, PointValues, Positions, Time, PointResults out )
+{
+	out.col( 0 ).setConstant( d == Derivative::dSigma_dq ? kappa : 0.0 );
+}
+
 
 
 // We don't need the index variables as nVars is 1, so the index argument should
@@ -35,6 +35,10 @@ class LinearDiffusion : public TransportSystem {
 		void dSources_dq( Index, Values&v , const Values &, const Values &, Position, Time ) override;
 		void dSources_dsigma( Index, Values&v , const Values &, const Values &, Position, Time ) override;
 
+		// The same, for all the quadrature nodes of a cell at once
+		void Evaluate( PointValues, PointValues, PointValues, Positions, Time, PointResults, PointResults ) override;
+		void EvaluateDerivative( Derivative, Index, PointValues, PointValues, Positions, Time, PointResults ) override;
+
 		// Finally one has to provide initial conditions for u & q
 		Value      InitialValue( Index, Position ) const override;
 		Value InitialDerivative( Index, Position ) const override;
@@ -26,7 +26,7 @@ MatrixDiffusion::MatrixDiffusion( toml::value const& config )
 
 	std::vector<double> InitialHeight_v = toml::find< std::vector<double> >( DiffConfig, "InitialHeights" );
 
-	if ( InitialHeight_v.size() != nVars )
+	if ( static_cast<Index>( InitialHeight_v.size() ) != nVars )
 		throw std::invalid_argument( "Initial height vector must have 'nVars' elements" );
 
 	InitialHeights.resize( nVars );
@@ -35,6 +35,15 @@ MatrixDiffusion::MatrixDiffusion( toml::value const& config )
 
 	Kappa = Matrix::Identity( nVars, nVars );
 
+	// Only the fluxes depend on anything, and then only on the q's that Kappa couples them to
+	declareCoupling( Derivative::dSigma_dq, Kappa.array() != 0.0 );
+	for ( auto d : { Derivative::dSigma_du, Derivative::dSources_du, Derivative::dSources_dq, Derivative::dSources_dsigma } )
+		declareCoupling( d, Coupling::Constant( nVars, nVars, false ) );
+
+	// Nothing is modified after construction
+	threadSafe = true;
+	fusedEvaluation = true;
+
 }
 
 // Dirichlet Boundary Conditon
@@ -93,6 +102,23 @@ void MatrixDiffusion::dSources_dsigma( Index, Values&v , const Values &, const V
 	v = Vector::Zero( nVars );
 };
 
+void MatrixDiffusion::Evaluate( PointValues, PointValues q, PointValues, Positions, Time, PointResults sigmaOut, PointResults sourcesOut )
+{
+	sigmaOut.noalias() = q * Kappa.transpose();
+	sourcesOut.setZero();
+}
+
+void MatrixDiffusion::FluxAndJacobian( const Values &, const Values & q, Position, Time, Values & sigma, Matrix &, Matrix & dSigma_dq )
+{
+	sigma.noalias() = Kappa * q;
+	dSigma_dq = Kappa;
+}
+
+void MatrixDiffusion::SourcesAndJacobian( const Values &, const Values &, const Values &, Position, Time, Values & S, Matrix &, Matrix &, Matrix & )
+{
+	S.setZero();
+}
+
 
 
 // We don't need the index variables as nVars is 1, so the index argument should
@@ -35,6 +35,11 @@ class MatrixDiffusion : public TransportSystem {
 		void dSources_dq( Index, Values&v , const Values &, const Values &, Position, Time ) override;
 		void dSources_dsigma( Index, Values&v , const Values &, const Values &, Position, Time ) override;
 
+		// Every flux is a row of Kappa q, so they are all computed together
+		void Evaluate( PointValues, PointValues, PointValues, Positions, Time, PointResults, PointResults ) override;
+		void FluxAndJacobian( const Values &, const Values &, Position, Time, Values &, Matrix &, Matrix & ) override;
+		void SourcesAndJacobian( const Values &, const Values &, const Values &, Position, Time, Values &, Matrix &, Matrix &, Matrix & ) override;
+
 		// Finally one has to provide initial conditions for u & q
 		Value      InitialValue( Index, Position ) const override;
 		Value InitialDerivative( Index, Position ) const override;
@@ -12,6 +12,12 @@ NonlinearDiffusion::NonlinearDiffusion( toml::value const& config )
 {
 	// Always set nVars in a derived constructor
 	nVars = 1;
+	// SigmaFn, Sources and their derivatives only read the parameters below
+	threadSafe = true;
+
+	// There are no sources
+	for ( auto d : { Derivative::dSources_du, Derivative::dSources_dq, Derivative::dSources_dsigma } )
+		declareCoupling( d, Coupling::Constant( nVars, nVars, false ) );
 
 	// Construst your problem from user-specified config
 	// throw an exception if you can't. NEVER leave a part-constructed object around
@@ -42,50 +48,6 @@ bool NonlinearDiffusion::isLowerBoundaryDirichlet( Index ) const { return true;
 bool NonlinearDiffusion::isUpperBoundaryDirichlet( Index ) const { return true; };
 
 
-Value NonlinearDiffusion::SigmaFn( Index, const Values &uV, const Values & qV, Position, Time )
-{
-	double u = uV[ 0 ],q = qV[ 0 ];
-
-	double NonlinearKappa = ( n/2.0 )*::pow( u, n )*( 1.0 - ::pow( u, n )/( n + 1.0 ) );
-	return NonlinearKappa * q;
-}
-
-Value NonlinearDiffusion::Sources( Index, const Values &, const Values &, const Values &, Position, Time )
-{
-	return 0.0;
-}
-
-void NonlinearDiffusion::dSigmaFn_dq( Index, Values& v, const Values& uV, const Values&, Position, Time )
-{
-	double u = uV[ 0 ];
-	double NonlinearKappa = ( n/2.0 )*::pow( u, n )*( 1.0 - ::pow( u, n )/( n + 1.0 ) );
-
-	v[ 0 ] = NonlinearKappa;
-};
-
-void NonlinearDiffusion::dSigmaFn_du( Index, Values& v, const Values& uV, const Values& qV, Position, Time )
-{
-	double u = uV[ 0 ], q = qV[ 0 ];
-	v[ 0 ] = ( ( n*n )/( 2.0*( n + 1.0 ) ) ) * ::pow( u, n - 1.0 ) * ( 1 + n - 2*::pow( u, n ) ) * q;
-};
-
-void NonlinearDiffusion::dSources_du( Index, Values&v , const Values &, const Values &, Position, Time )
-{
-	v[ 0 ] = 0.0;
-};
-
-void NonlinearDiffusion::dSources_dq( Index, Values&v , const Values &, const Values &, Position, Time )
-{
-	v[ 0 ] = 0.0;
-};
-
-void NonlinearDiffusion::dSources_dsigma( Index, Values&v , const Values &, const Values &, Position, Time )
-{
-	v[ 0 ] = 0.0;
-};
-
-
-
 // We don't need the index variables as nVars is 1, so the index argument should
 // always be 0
 
@@ -2,6 +2,7 @@
 #define LINEARDIFFUSION_HPP
 
 #include "PhysicsCases.hpp"
+#include "AutodiffTransportSystem.hpp"
 
 /*
  * Exact solutions for the nonlinear equation
@@ -15,8 +16,8 @@
  * meant to be initialised at t=1
  */
 
-// Always inherit from TransportSystem
-class NonlinearDiffusion : public TransportSystem {
+// Always inherit from TransportSystem, here through AutodiffTransportSystem, which differentiates Flux & Source for us
+class NonlinearDiffusion : public AutodiffTransportSystem< NonlinearDiffusion > {
 	public:
 		// Must provide a constructor that constructs from a toml configuration snippet
 		// you can ignore it, or read problem-dependent parameters from the configuration file
@@ -29,18 +30,18 @@ class NonlinearDiffusion : public TransportSystem {
 		bool isLowerBoundaryDirichlet( Index ) const override;
 		bool isUpperBoundaryDirichlet( Index ) const override;
 
-		// The guts of the physics problem (these are non-const as they
-		// are allowed to alter internal state such as to store computations
-		// for future calls)
-		Value SigmaFn( Index, const Values &, const Values &, Position, Time ) override;
-		Value Sources( Index, const Values &, const Values &, const Values &, Position, Time ) override;
-
-		void dSigmaFn_du( Index, Values &, const Values &, const Values &, Position, Time ) override;
-		void dSigmaFn_dq( Index, Values &, const Values &, const Values &, Position, Time ) override;
-
-		void dSources_du( Index, Values&v , const Values &, const Values &, Position, Time ) override;
-		void dSources_dq( Index, Values&v , const Values &, const Values &, Position, Time ) override;
-		void dSources_dsigma( Index, Values&v , const Values &, const Values &, Position, Time ) override;
+		// The guts of the physics problem, written once for both doubles and the Duals that give their derivatives
+		template< typename T > T Flux( Index, VectorOf< T > const& u, VectorOf< T > const& q, Position, Time ) const
+		{
+			using std::pow;
+			T un = pow( u[ 0 ], n );
+			T NonlinearKappa = ( n/2.0 )*un*( 1.0 - un/( n + 1.0 ) );
+			return NonlinearKappa * q[ 0 ];
+		}
+		template< typename T > T Source( Index, VectorOf< T > const&, VectorOf< T > const&, VectorOf< T > const&, Position, Time ) const
+		{
+			return 0.0;
+		}
 
 		// Finally one has to provide initial conditions for u & q
 		Value      InitialValue( Index, Position ) const override;
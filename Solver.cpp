@@ -16,7 +16,7 @@
 #include "ErrorChecker.hpp"
 
 int residual(realtype tres, N_Vector Y, N_Vector dydt, N_Vector resval, void *user_data);
-int EmptyJac(realtype tt, realtype cj, N_Vector yy, N_Vector yp, N_Vector rr, SUNMatrix Jac, void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3);
+int JacobianState(realtype tt, realtype cj, N_Vector yy, N_Vector yp, N_Vector rr, SUNMatrix Jac, void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3);
 
 void SystemSolver::runSolver( std::string inputFile )
 {
@@ -81,7 +81,61 @@ void SystemSolver::runSolver( std::string inputFile )
 	else if( absTol.is_integer() ) atol = static_cast<double>(absTol.as_floating());
 	else if( absTol.is_floating() ) atol = static_cast<double>(absTol.as_floating());
 	else throw std::invalid_argument( "Absolute_tolerance specified incorrrectly" );
-	
+
+	// Storage for the global lambda system, dense is O(N^2) in memory so only for debugging / comparison
+	if ( config.count( "Lambda_solver" ) == 1 )
+	{
+		std::string lambdaSolverName = config.at( "Lambda_solver" ).as_string();
+		if ( lambdaSolverName == "block_tridiagonal" ) lambdaSolver = LambdaSolverType::BlockTridiagonal;
+		else if ( lambdaSolverName == "dense" ) lambdaSolver = LambdaSolverType::Dense;
+		else throw std::invalid_argument( "Lambda_solver specified incorrrectly, must be \"block_tridiagonal\" or \"dense\"" );
+	}
+
+	// Factorisation of the cell blocks, dense is the whole 3*nVars*(k+1) block and is only for debugging / comparison
+	if ( config.count( "Cell_solver" ) == 1 )
+	{
+		std::string cellSolverName = config.at( "Cell_solver" ).as_string();
+		if ( cellSolverName == "condensed" ) setCellSolver( CellSolverType::Condensed );
+		else if ( cellSolverName == "dense" ) setCellSolver( CellSolverType::Dense );
+		else throw std::invalid_argument( "Cell_solver specified incorrrectly, must be \"condensed\" or \"dense\"" );
+	}
+
+	// Arrangement of sigma, q, u & lambda in the SUNDIALS vectors, see DGSoln.hpp
+	if ( config.count( "State_layout" ) == 1 )
+	{
+		std::string layoutName = config.at( "State_layout" ).as_string();
+		if ( layoutName == "traces_last" ) setStateLayout( DGSoln::Layout::TracesLast );
+		else if ( layoutName == "cell_major" ) setStateLayout( DGSoln::Layout::CellMajor );
+		else if ( layoutName == "variable_major" ) setStateLayout( DGSoln::Layout::VariableMajor );
+		else throw std::invalid_argument( "State_layout specified incorrrectly, must be \"traces_last\", \"cell_major\" or \"variable_major\"" );
+	}
+
+	// Quadrature nodes per cell beyond the k + 1 needed for the mass matrix, raise for strongly nonlinear fluxes
+	if ( config.count( "Quadrature_margin" ) == 1 )
+	{
+		auto margin = config.at( "Quadrature_margin" );
+		if ( !margin.is_integer() || margin.as_integer() < 0 ) throw std::invalid_argument( "Quadrature_margin must be a non-negative integer" );
+		setQuadratureMargin( margin.as_integer() );
+	}
+
+	// Legendre ( modal ) or nodal basis on the Gauss-Lobatto or Gauss points, which are then the quadrature nodes
+	if ( config.count( "Basis" ) == 1 )
+	{
+		std::string basisName = config.at( "Basis" ).as_string();
+		if ( basisName == "legendre" ) setBasisType( BasisTable::Type::Legendre );
+		else if ( basisName == "gauss_lobatto" ) setBasisType( BasisTable::Type::GaussLobatto );
+		else if ( basisName == "gauss" ) setBasisType( BasisTable::Type::Gauss );
+		else throw std::invalid_argument( "Basis specified incorrrectly, must be \"legendre\", \"gauss_lobatto\" or \"gauss\"" );
+	}
+
+	// Threads for the loops over cells, the results are the same for any number
+	if ( config.count( "Threads" ) == 1 )
+	{
+		auto nThreads = config.at( "Threads" );
+		if ( !nThreads.is_integer() || nThreads.as_integer() < 1 ) throw std::invalid_argument( "Threads must be a positive integer" );
+		setThreads( nThreads.as_integer() );
+	}
+
 	//-------------------------------------System Design----------------------------------------------
 	SUNContext ctx;
     retval = SUNContext_Create(nullptr, &ctx);
@@ -96,10 +150,16 @@ void SystemSolver::runSolver( std::string inputFile )
 
 	//-----------------------------Initial conditions-------------------------------
 
-	initialiseMatrices();
+	// The cell matrices were built by the constructor ( and rebuilt by setQuadratureMargin / setBasisType ), so are not rebuilt here
+	std::cerr << "Cell matrices: " << cellMatrices.nSets() << " distinct sets for " << nCells << " cells, "
+	          << cellMatrices.bytes()/1024 << " kB against " << cellMatrices.perCellBytes()/1024 << " kB stored per cell" << std::endl;
+	std::cerr << "Cell operators: " << operators.size() << " ( including the a( x ) mass matrix ), "
+	          << operators.bytes()/1024 << " kB against " << operators.perCellBytes()/1024 << " kB stored per cell" << std::endl;
+	std::cerr << "Total: " << ( cellMatrices.bytes() + operators.bytes() )/1024 << " kB against "
+	          << ( cellMatrices.perCellBytes() + operators.perCellBytes() )/1024 << " kB stored per cell" << std::endl;
 
 	//Set original vector lengths
-	Y = N_VNew_Serial(nVars*3*nCells*(k+1) + nVars*(nCells+1), ctx);
+	Y = N_VNew_Serial( y.getDoF(), ctx );
 	if(ErrorChecker::check_retval((void *)Y, "N_VNew_Serial", 0))
 		throw std::runtime_error("Sundials Initialization Error");
 	
@@ -130,15 +190,10 @@ void SystemSolver::runSolver( std::string inputFile )
 	id = N_VClone(Y);
 	if(ErrorChecker::check_retval((void *)id, "N_VClone", 0))
 		std::runtime_error("Sundials initialization Error, run in debug to find");
-	VectorWrapper idVals( N_VGetArrayPointer( id ), nVars*3*nCells*(k+1) + nVars*(nCells+1) );
-	idVals.setZero();
-	for(Index i=0; i < nCells; i++)
-	{
-		for(Index j=0; j< nVars*(k+1); j++)
-		{
-			idVals[ i*3*nVars*(k+1) + 2*nVars*(k+1) + j ] = 1.0;//U vals
-		}
-	}
+	DGSoln idVals( nVars, grid, degrees, N_VGetArrayPointer( id ), stateLayout );
+	idVals.zeroCoeffs();
+	for ( Index v = 0; v < nVars; ++v )
+		idVals.u( v ).coeffs().setOnes(); //U vals
 	retval = IDASetId(IDA_mem, id);
 	if(ErrorChecker::check_retval(&retval, "IDASetId", 1)) 
 		std::runtime_error("Sundials initialization Error, run in debug to find");
@@ -155,7 +210,7 @@ void SystemSolver::runSolver( std::string inputFile )
 	VectorWrapper absTolVals( N_VGetArrayPointer( absTolVec ), N_VGetLength( absTolVec ) );
 	absTolVals.setZero();
 
-	DGSoln tolerances( nVars, grid, k );
+	DGSoln tolerances( nVars, grid, degrees, stateLayout );
 	tolerances.Map( N_VGetArrayPointer( absTolVec ) );
 	double dx = (grid.upperBoundary() - grid.lowerBoundary())/nCells;
 
@@ -186,7 +241,13 @@ void SystemSolver::runSolver( std::string inputFile )
 	if ( IDASetLinearSolver(IDA_mem, LS, sunMat) != SUNLS_SUCCESS )
 		std::runtime_error("Error in IDASetLinearSolver");
 
-	IDASetJacFn(IDA_mem, EmptyJac);
+	IDASetJacFn(IDA_mem, JacobianState);
+
+	// Reuse the factorisations from the last setup when cj changes, with IDA correcting the solution for the change.
+	// This is the default for a direct solver such as SunLinSolWrapper, but Solve relies on it so it is set explicitly
+	retval = IDASetLinearSolutionScaling(IDA_mem, SUNTRUE);
+	if(ErrorChecker::check_retval(&retval, "IDASetLinearSolutionScaling", 1))
+		throw std::runtime_error("Sundials initialization Error, run in debug to find");
 
 	IDASetMaxNonlinIters(IDA_mem, 10);
 
@@ -274,11 +335,13 @@ void SystemSolver::runSolver( std::string inputFile )
 
 }
 
-int EmptyJac(realtype tt, realtype cj, N_Vector yy, N_Vector yp, N_Vector rr, SUNMatrix Jac, void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3)
+int JacobianState(realtype tt, realtype cj, N_Vector yy, N_Vector yp, N_Vector rr, SUNMatrix Jac, void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3)
 {
-	//This function is purely superficial
 	//Sundials looks for a Jacobian, but our Jacobian equation is solved without computing the jacobian. 
-	//So we pass a fake one to sundials to prevent an error
+	//We don't fill Jac, but IDA calls this immediately before the linear solver setup with the point
+	//the Jacobian should be evaluated at, so hand that on to the system for SunLinSolWrapper::Setup
+	auto system = reinterpret_cast<SystemSolver*>( user_data );
+	system->setJacobianState( yy );
 	return 0;
 }
 
@@ -6,17 +6,23 @@
 #include <sundials/sundials_types.h>   /* definition of type realtype          */
 #include <memory>
 
-int SunLinSolWrapper::Solve( SUNMatrix A, N_Vector x, N_Vector b )
+// Called by IDA only when it decides the Jacobian is stale. Everything that depends
+// on the linearisation point or on cj is assembled and factorised here.
+int SunLinSolWrapper::Setup( SUNMatrix mat)
 {
 	realtype cj = 1.0;
 	IDAGetCurrentCj(IDA_mem, &cj);
 	solver->setAlpha(cj);
-	solver->solveJacEq( b, x);
+	solver->setupJacEq();
 	return 0;
 }
 
-int SunLinSolWrapper::Setup( SUNMatrix mat)
+// Back-substitution only. If cj has drifted since the last Setup, IDA rescales the
+// solution itself (linear solution scaling, which runSolver turns on) until the
+// change exceeds its own tolerance and it calls Setup again.
+int SunLinSolWrapper::Solve( SUNMatrix A, N_Vector x, N_Vector b )
 {
+	solver->solveJacEq( b, x);
 	return 0;
 }
 
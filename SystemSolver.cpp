@@ -4,6 +4,7 @@
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <toml.hpp>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -11,13 +12,130 @@
 #include "gridStructures.hpp"
 
 SystemSolver::SystemSolver(Grid const& Grid, unsigned int polyNum, double Dt, TransportSystem *transpSystem )
-	: grid(Grid), k(polyNum), nCells(Grid.getNCells()),nVars( transpSystem->getNumVars() ), y( nVars, grid, k ), dydt( nVars, grid, k ),
+	: SystemSolver( Grid, std::vector< Index >( transpSystem->getNumVars(), polyNum ), Dt, transpSystem )
+{
+}
+
+SystemSolver::SystemSolver(Grid const& Grid, std::vector< Index > const& Degrees, double Dt, TransportSystem *transpSystem )
+	: grid(Grid), k( Degrees.empty() ? 0 : *std::max_element( Degrees.begin(), Degrees.end() ) ), nCells(Grid.getNCells()),nVars( transpSystem->getNumVars() ), degrees( Degrees ),
+	  y( nVars, grid, degrees ), dydt( nVars, grid, degrees ),
+	  resY( nVars, grid, degrees ), resdYdt( nVars, grid, degrees ), resValues( nVars, grid, degrees ), gSoln( nVars, grid, degrees ), delYSoln( nVars, grid, degrees ), yJac( nVars, grid, degrees ),
 	  dt(Dt), problem( transpSystem )
 {
+	// The DGSoln's have checked there is one non-negative degree per variable
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		blockStart.push_back( fieldSize );
+		fieldSize += nCoeffs( var );
+	}
+	setQuadratureMargin( BasisTable::DefaultQuadratureMargin );
 	initialiseMatrices();
 	initialised = true;
 }
 
+void SystemSolver::setQuadratureMargin( Index margin )
+{
+	if ( margin < 0 )
+		throw std::invalid_argument( "Quadrature margin cannot be negative" );
+	quadratureMargin = margin;
+	selectBasis();
+}
+
+void SystemSolver::setBasisType( BasisTable::Type t )
+{
+	// Lower degrees use the leading rows of the Legendre table for k, which is hierarchical, but a nodal one is not
+	if ( t != BasisTable::Type::Legendre && !uniformDegree() )
+		throw std::invalid_argument( "A nodal basis can only be used if every variable has the same polynomial degree" );
+	basisType = t;
+	selectBasis();
+}
+
+void SystemSolver::selectBasis()
+{
+	// With mixed degrees this is the table for the highest, see setBasisType
+	if ( basisType == BasisTable::Type::Legendre )
+		pBasis = &BasisTable::Get( k, BasisTable::QuadratureNodes( k, quadratureMargin + problem->extraQuadratureNodes( k ) ) );
+	else
+		pBasis = &BasisTable::Get( k, k + 1, basisType );
+
+	// A Legendre solution is the same whatever the quadrature, so keeps the default table for evaluation and projection
+	BasisTable const& solutionBasis = pBasis->isNodal() ? *pBasis : BasisTable::Get( k );
+	for ( DGSoln* soln : { &y, &dydt, &resY, &resdYdt, &resValues, &gSoln, &delYSoln, &yJac } )
+		soln->setBasis( solutionBasis );
+
+	if ( initialised )
+		initialiseMatrices();
+}
+
+void SystemSolver::setThreads( Index n )
+{
+	threads.resize( n );
+	resizeWorkspaces();
+}
+
+void SystemSolver::CellWorkspace::resize( Index nVars, Index k, Index fieldSize, Index nNodes )
+{
+	kappa_nodes.resize( nNodes, nVars );
+	S_nodes.resize( nNodes, nVars );
+	kappa_cellwise.resize( k + 1, nVars );
+	S_cellwise.resize( k + 1, nVars );
+	x_nodes.resize( nNodes );
+	lamCell.resize( 2*nVars );
+
+	NLq.resize( fieldSize, fieldSize );
+	NLu.resize( fieldSize, fieldSize );
+	Ssig.resize( fieldSize, fieldSize );
+	Sq.resize( fieldSize, fieldSize );
+	Su.resize( fieldSize, fieldSize );
+	MX.resize( 3*fieldSize, 3*fieldSize );
+	CE.resize( 3*fieldSize, 2*nVars );
+	CG.resize( 2*nVars, 3*fieldSize );
+	SQU_0_work.resize( 3*fieldSize, 2*nVars );
+	u_nodes.resize( nNodes, nVars );
+	q_nodes.resize( nNodes, nVars );
+	sigma_nodes.resize( nNodes, nVars );
+	dX_dZ_nodes.resize( nNodes, nVars );
+	for ( Values* v : { &u_vals, &q_vals, &sigma_vals, &fusedSigma, &fusedSources } )
+		v->resize( nVars );
+	for ( Matrix& J : fusedJacobians )
+		J.resize( nVars, nVars );
+	schur.resize( fieldSize, fieldSize );
+	P.resize( fieldSize, fieldSize );
+	condensedRhs.resize( fieldSize, 2*nVars );
+	condensedWork.resize( fieldSize, 2*nVars );
+	groupRhs.resize( fieldSize, 2*nVars );
+	groupX.resize( fieldSize, 2*nVars );
+	groupWork.resize( fieldSize, 2*nVars );
+
+	gCell.resize( 3*fieldSize );
+	SQU_f_work.resize( 3*fieldSize );
+	delLambdaCell.resize( 2*nVars );
+	delSQU.resize( 3*fieldSize );
+}
+
+void SystemSolver::resizeWorkspaces()
+{
+	workspaces.resize( threads.size() );
+	for ( auto & w : workspaces )
+		w.resize( nVars, k, fieldSize, pBasis->nNodes() );
+
+	if ( serialPhysics() )
+	{
+		fluxNodes.resize( pBasis->nNodes(), nVars*nCells );
+		sourceNodes.resize( pBasis->nNodes(), nVars*nCells );
+		std::array< Matrix, 5 > blocks;
+		for ( Matrix& b : blocks )
+			b.resize( fieldSize, fieldSize );
+		derivativeBlocks.assign( nCells, blocks );
+	}
+	else
+	{
+		fluxNodes.resize( 0, 0 );
+		sourceNodes.resize( 0, 0 );
+		derivativeBlocks.clear();
+	}
+}
+
 void SystemSolver::setInitialConditions( N_Vector& Y , N_Vector& dYdt )
 {
 
@@ -37,10 +155,17 @@ void SystemSolver::setInitialConditions( N_Vector& Y , N_Vector& dYdt )
 	ApplyDirichletBCs(y); // If dirichlet, overwrite with those boundary conditions
 
 	auto sigma_wrapper = std::bind_front( &TransportSystem::SigmaFn, problem );
-	y.AssignSigma( sigma_wrapper );
-
+	y.AssignSigma( sigma_wrapper, *pBasis );
+
+	BasisTable const& basis = *pBasis;
+	// Every field at every node, for the sources
+	yNodes.resize( basis.nNodes(), 3*nVars*nCells );
+	y.EvaluateAtNodes( basis, yNodes );
+	Values u_vals( nVars ), q_vals( nVars ), sigma_vals( nVars );
+	Eigen::VectorXd S_nodes( basis.nNodes() ), S_cellwise( k + 1 );
 	for( Index var = 0; var < nVars; var++)
 	{
+		Index n = nCoeffs( var ), b = blockStart[ var ];
 		//Solver For dudt with dudt = X^-1( -B*Sig - D*U - E*Lam + F )
 		Eigen::Vector2d lamCell;
 		for ( Index i = 0; i < nCells; i++ )
@@ -48,53 +173,27 @@ void SystemSolver::setInitialConditions( N_Vector& Y , N_Vector& dYdt )
 			Interval I = grid[ i ];
 
 			//Evaluate Source Function
-			Eigen::VectorXd S_cellwise(k+1);
-			S_cellwise.setZero();
-
-			auto const& x_vals = DGApprox::Integrator().abscissa();
-			auto const& x_wgts = DGApprox::Integrator().weights();
-			const size_t n_abscissa = x_vals.size();
-
-			S_cellwise.setZero();
-			for ( size_t i=0; i < n_abscissa; ++i ) {
-				Vector u_vals( nVars ), q_vals( nVars ), sigma_vals( nVars );
-				double x_val = I.x_l + ( 1 + x_vals[ i ] ) * I.h()/2.0;
-				double wgt = x_wgts[ i ]*( I.h()/2.0 );
-				for ( size_t j = 0 ; j < nVars; ++j ) {
-					u_vals[ j ] = y.u( j )( x_val, I );
-					q_vals[ j ] = y.q( j )( x_val, I );
-					sigma_vals[ j ] = y.sigma( j )( x_val, I );
+			for ( Index q = 0; q < basis.nNodes(); ++q ) {
+				for ( Index j = 0 ; j < nVars; ++j ) {
+					u_vals[ j ]     = yNodes( q, y.coeffColumn( i, DGSoln::U, j ) );
+					q_vals[ j ]     = yNodes( q, y.coeffColumn( i, DGSoln::Q, j ) );
+					sigma_vals[ j ] = yNodes( q, y.coeffColumn( i, DGSoln::Sigma, j ) );
 				}
-				double sourceVal = problem->Sources( var, u_vals, q_vals, sigma_vals, x_val, 0 );
-				for ( Eigen::Index j = 0; j < k+1; j++ )
-					S_cellwise( j ) += wgt * sourceVal * LegendreBasis::Evaluate( I, j, x_val );
-			}
-			// And for the other half of the abscissas
-			for ( size_t i=0; i < n_abscissa; ++i ) {
-				Values u_vals( nVars ), q_vals( nVars ), sigma_vals( nVars );
-				double x_val = I.x_l + ( 1 - x_vals[ i ] ) * I.h()/2.0;
-				double wgt = x_wgts[ i ]*( I.h()/2.0 );
-				for ( size_t j = 0 ; j < nVars; ++j ) {
-					u_vals[ j ] = y.u( j )( x_val, I );
-					q_vals[ j ] = y.q( j )( x_val, I );
-					sigma_vals[ j ] = y.sigma( j )( x_val, I );
-				}
-				double sourceVal = problem->Sources( var, u_vals, q_vals, sigma_vals, x_val, 0 );
-				for ( Eigen::Index j = 0; j < k+1; j++ )
-					S_cellwise( j ) += wgt * sourceVal * LegendreBasis::Evaluate( I, j, x_val );
+				S_nodes( q ) = problem->Sources( var, u_vals, q_vals, sigma_vals, basis.x( I, q ), 0 );
 			}
+			basis.Project( I, S_nodes, S_cellwise );
 
-			auto cTInv = Eigen::FullPivLU< Eigen::MatrixXd >(C_cellwise[i].transpose());
 			lamCell[0] = y.lambda( var )[ i ]; lamCell[1] = y.lambda( var )[ i ];
 			//dudt.coeffs[ var ][ i ].second.setZero();
 			auto const& sigma_vec = y.sigma( var ).getCoeff( i ).second;
 			auto const& u_vec     = y.u( var )    .getCoeff( i ).second;
+			CellMatrices::Blocks const& cell = cellMatrices( i, var );
 			dydt.u( var ).getCoeff( i ).second =
-				XMats[i].block(var*(k+1), var*(k+1), k+1, k+1).inverse()*(
-						- B_cellwise[i].block(var*(k+1), var*(k+1), k+1, k+1)*sigma_vec
-						- D_cellwise[i].block(var*(k+1), var*(k+1), k+1, k+1)*u_vec
-						- E_cellwise[i].block(var*(k+1), var*2, k+1, 2)*lamCell
-						+ RF_cellwise[ i ].block( nVars*(k + 1) + var*(k+1), 0, k + 1, 1 ) - S_cellwise);
+				operators( aMass, i, var ).topLeftCorner( n, n ).inverse()*(
+						- cellMatrices.invH( i )*cell.B*sigma_vec
+						- cellMatrices.invH( i )*cell.D*u_vec
+						- cellMatrices.invRootH( i )*cell.E*lamCell
+						+ RF_cellwise[ i ].segment( fieldSize + b, n ) - S_cellwise.head( n ));
 			dydt.q( var ).getCoeff( i ).second.setZero();
 				// <cellwise derivative matrix> * dydt.u( var ).getCoeff( i ).second;
 		}
@@ -112,7 +211,7 @@ void SystemSolver::setInitialConditions( N_Vector& Y , N_Vector& dYdt )
 
 			return sigmaDot;
 		};
-		dydt.AssignSigma( dSigmaFn_dt );
+		dydt.AssignSigma( dSigmaFn_dt, *pBasis );
 	}
 }
 
@@ -132,141 +231,50 @@ void SystemSolver::ApplyDirichletBCs( DGSoln &Y )
 
 void SystemSolver::initialiseMatrices()
 {
-	// These are temporary working space
-	// Matrices we need per cell
-	Eigen::MatrixXd A( nVars*(k + 1), nVars*(k + 1) );
-	Eigen::MatrixXd B( nVars*(k + 1), nVars*(k + 1) );
-	Eigen::MatrixXd D( nVars*(k + 1), nVars*(k + 1) );
-	// Two endpoints per cell
-	Eigen::MatrixXd C( 2*nVars, nVars*(k + 1) );
-	Eigen::MatrixXd E( nVars*(k + 1), 2*nVars );
-
-	// Temporary per-variable matrices that will be assembled into the larger cell matrices as blocks
-	Eigen::MatrixXd Avar( k + 1, k + 1 );
-	Eigen::MatrixXd Bvar( k + 1, k + 1 );
-	Eigen::MatrixXd Dvar( k + 1, k + 1 );
-	Eigen::MatrixXd Cvar( 2, k + 1 );
-	Eigen::MatrixXd Evar( k + 1, 2 );
-
-	Eigen::MatrixXd HGlobalMat( nVars*(nCells+1), nVars*(nCells+1) );
-	HGlobalMat.setZero();
-	K_global.resize( nVars*(nCells + 1), nVars*(nCells + 1) );
-	K_global.setZero();
-	L_global.resize( nVars*(nCells + 1) );
-	L_global.setZero();
+	BasisTable const& basis = *pBasis;
+	setCoupling();
 
-	clearCellwiseVecs();
-	for ( unsigned int i = 0; i < nCells; i++ )
-	{
-		A.setZero();
-		B.setZero();
-		C.setZero();
-		D.setZero();
-		E.setZero();
+	// The cell matrices are the same on every cell of the same kind, up to a scaling by its width
+	auto kind = [ & ]( Index i ) {
 		Interval const& I( grid[ i ] );
-		for( Index var = 0; var < nVars; var++ )
+		CellMatrices::Kind c{ tau( I.x_l ), tau( I.x_u ), std::vector< bool >( 4*nVars, false ) };
+		bool lower = I.x_l == grid.lowerBoundary(), upper = I.x_u == grid.upperBoundary();
+		for ( Index var = 0; var < nVars; var++ )
 		{
-			Avar.setZero();
-			Bvar.setZero();
-			Dvar.setZero();
-			// A_ij = ( phi_j, phi_i )
-			DGApprox::MassMatrix( I, Avar );
-			// B_ij = ( phi_i, phi_j' )
-			DGApprox::DerivativeMatrix( I, Bvar );
-
-			// Now do all the boundary terms
-			for ( Eigen::Index i=0; i<k+1;i++ )
-			{
-				for ( Eigen::Index j=0; j<k+1;j++ )
-				{
-					Dvar( i, j ) += 
-						tau( I.x_l )*LegendreBasis::Evaluate( I, j, I.x_l )*LegendreBasis::Evaluate( I, i, I.x_l ) +
-						tau( I.x_u )*LegendreBasis::Evaluate( I, j, I.x_u )*LegendreBasis::Evaluate( I, i, I.x_u );
-				}
-			}
-
-			A.block(var*(k+1),var*(k+1),k+1,k+1) = Avar;
-			D.block(var*(k+1),var*(k+1),k+1,k+1) = Dvar;
-			B.block(var*(k+1),var*(k+1),k+1,k+1) = Bvar;
+			c.decoupled[ 4*var + CellMatrices::CELower ] = lower && problem->isLowerBoundaryDirichlet( var );
+			c.decoupled[ 4*var + CellMatrices::CEUpper ] = upper && problem->isUpperBoundaryDirichlet( var );
+			c.decoupled[ 4*var + CellMatrices::GHLower ] = lower && problem->isLowerBoundaryDirichlet( var );
+			c.decoupled[ 4*var + CellMatrices::GHUpper ] = upper && problem->isUpperBoundaryDirichlet( var );
 		}
+		return c;
+	};
+	cellMatrices.build( grid, degrees, basis, kind );
 
-		A_cellwise.emplace_back(A);
-		B_cellwise.emplace_back(B);
-		D_cellwise.emplace_back(D);
-
-		Eigen::MatrixXd M( 3*nVars*(k + 1), 3*nVars*(k + 1) );
-		M.setZero();
-		//row1
-		M.block( 0, 0, nVars*(k+1), nVars*(k+1) ).setZero();
-		M.block( 0, nVars*(k+1), nVars*(k+1), nVars*(k+1) ) = -A;
-		M.block( 0, 2*nVars*(k+1), nVars*(k+1), nVars*(k+1) ) = -B.transpose();
-
-		//row2
-		M.block( nVars*(k+1), 0, nVars*(k+1), nVars*(k+1) ) = B;
-		M.block( nVars*(k+1), nVars*(k+1), nVars*(k+1), nVars*(k+1) ).setZero();
-		M.block( nVars*(k+1), 2*nVars*(k+1), nVars*(k+1), nVars*(k+1) ) = D;			//X added at Jac step
-
-		//row3
-		M.block( 2*nVars*(k+1), 0, nVars*(k+1), nVars*(k+1) ) = A;
-		M.block( 2*nVars*(k+1), nVars*(k+1), nVars*(k+1), nVars*(k+1) ).setZero();		//NLq added at Jac step
-		M.block( 2*nVars*(k+1), 2*nVars*(k+1), nVars*(k+1), nVars*(k+1) ).setZero();	//NLu added at Jac step
-
-		// 2*( k + 1) is normally only medium-sized (10 - 20)
-		// so just do a full LU factorization to solve 
-		// ?Now this is nVars*3*(k+1) so maybe this should be changed?
-		MBlocks.emplace_back( M );
-
-		Eigen::MatrixXd CE_vec( 3*nVars*(k + 1), 2*nVars );
-		CE_vec.setZero();
-		for( Index var=0; var < nVars; var++ )
-		{
-			Cvar.setZero();
-			Evar.setZero();
-			for ( Index i=0; i < k + 1; i++ )
-			{
-				// C_ij = < psi_i, phi_j * n_x > , where psi_i are edge degrees of
-				// freedom and n_x is the unit normal in the x direction
-				// for a line, edge degrees of freedom are just 1 at each end
-
-				Cvar( 0, i ) = -LegendreBasis::Evaluate( I, i, I.x_l );
-				Cvar( 1, i ) =  LegendreBasis::Evaluate( I, i, I.x_u );
-
-				// E_ij = < phi_i, (- tau ) lambda >
-				Evar( i, 0 ) = LegendreBasis::Evaluate( I, i, I.x_l ) * ( - tau( I.x_l ) );
-				Evar( i, 1 ) = LegendreBasis::Evaluate( I, i, I.x_u ) * ( - tau( I.x_u ) );
-
-				if ( I.x_l == grid.lowerBoundary() && problem->isLowerBoundaryDirichlet( var ) )
-				{
-					Cvar( 0, i ) = 0;
-					Evar( i, 0 ) = 0;
-				}
-
-				if ( I.x_u == grid.upperBoundary() && problem->isLowerBoundaryDirichlet( var ) )
-				{
-					Cvar( 1, i ) = 0;
-					Evar( i, 1 ) = 0;
-				}
-			}
+	H_blocks.resize( nCells + 1, nVars );
+	L_global.resize( nVars*(nCells + 1) );
+	L_global.setZero();
 
-			// Construct per-cell Matrix solutions
-			// ( 0    A    B^T )    [ C^T ]
-			// ( B    0     D )     [  E  ]
-			// ( A   NLu   NLq )^-1 [  0  ]
-			// These are the homogeneous solution, that depend on lambda
-			C.block(var*2,var*(k+1),2,k+1) = Cvar;
-			E.block(var*(k+1),var*2,k+1,2) = Evar;
-		}
-		
-		CE_vec.block( 0, 0, nVars*(k + 1), nVars*2 ) = C.transpose();
-		CE_vec.block( nVars*(k+1), 0, nVars*(k + 1), nVars*2 ) = E;
-		CE_vec.block( 2*nVars*(k+1), 0, nVars*(k + 1), nVars*2 ).setZero();
-		CEBlocks.emplace_back(CE_vec);
+	// Buffers for the residual & Jacobian solves, so they don't allocate
+	lam.resize( nVars*( nCells + 1 ) );
+	CsGuL_global.resize( nVars*( nCells + 1 ) );
+	F.resize( nVars*( nCells + 1 ) );
+	F_faces.resize( nVars*( nCells + 1 ) );
+	K_cellwise.assign( nCells, Matrix( 2*nVars, 2*nVars ) );
+	SQU_0.assign( nCells, Matrix( 3*fieldSize, 2*nVars ) );
+	SQU_f.assign( nCells, Vector( 3*fieldSize ) );
+	CG_SQU_f.assign( nCells, Vector( 2*nVars ) );
+	yNodes.resize( basis.nNodes(), 3*nVars*nCells );
+	MXSolvers.clear();
+	condensedCells.clear();
 
-		C_cellwise.emplace_back(C);
-		E_cellwise.emplace_back(E);
+	clearCellwiseVecs();
+	reserveCellwiseVecs();
+	for ( unsigned int i = 0; i < nCells; i++ )
+	{
+		Interval const& I( grid[ i ] );
 
 		// To store the RHS
-		RF_cellwise.emplace_back( nVars * 2 * ( k + 1 ) );
+		RF_cellwise.emplace_back( 2 * fieldSize );
 
 		// R is composed of parts of the values of 
 		// u on the total domain boundary
@@ -278,77 +286,36 @@ void SystemSolver::initialiseMatrices()
 		{
 			if ( I.x_l == grid.lowerBoundary() && problem->isLowerBoundaryDirichlet( var ) )
 			{
-				for ( Eigen::Index j = 0; j < k+1; j++ )
+				for ( Eigen::Index j = 0; j < nCoeffs( var ); j++ )
 				{
 					// < g_D , v . n > ~= g_D( x_0 ) * phi_j( x_0 ) * ( n_x = -1 )
-					RF_cellwise[ i ]( j + var*(k+1) ) += -LegendreBasis::Evaluate( I, j, I.x_l ) * ( -1 ) * problem->LowerBoundary( var, 0.0 );
+					RF_cellwise[ i ]( j + blockStart[ var ] ) += -basis.phiLower( I, j ) * ( -1 ) * problem->LowerBoundary( var, 0.0 );
 					// < ( tau ) g_D, w >
-					RF_cellwise[ i ]( nVars*(k + 1) + j + var*(k+1) ) += LegendreBasis::Evaluate( I, j, I.x_l ) * tau( I.x_l ) * problem->LowerBoundary( var, 0.0 );
+					RF_cellwise[ i ]( fieldSize + j + blockStart[ var ] ) += basis.phiLower( I, j ) * tau( I.x_l ) * problem->LowerBoundary( var, 0.0 );
 				}
 			}
 
 			if ( I.x_u == grid.upperBoundary() && problem->isUpperBoundaryDirichlet( var ) )
 			{
-				for ( Eigen::Index j = 0; j < k+1; j++ )
+				for ( Eigen::Index j = 0; j < nCoeffs( var ); j++ )
 				{
 					// < g_D , v . n > ~= g_D( x_1 ) * phi_j( x_1 ) * ( n_x = +1 ) 
-					RF_cellwise[ i ]( j + var*(k+1) ) += -LegendreBasis::Evaluate( I, j, I.x_u ) * ( +1 ) * problem->UpperBoundary( var, 0.0 );
-					RF_cellwise[ i ]( nVars*(k + 1) + j + var*(k+1) ) += LegendreBasis::Evaluate( I, j, I.x_u ) * tau( I.x_u ) * problem->UpperBoundary( var, 0.0 );
+					RF_cellwise[ i ]( j + blockStart[ var ] ) += -basis.phiUpper( I, j ) * ( +1 ) * problem->UpperBoundary( var, 0.0 );
+					RF_cellwise[ i ]( fieldSize + j + blockStart[ var ] ) += basis.phiUpper( I, j ) * tau( I.x_u ) * problem->UpperBoundary( var, 0.0 );
 				}
 			}
 		}
 
-		// Per-cell contributions to the global matrices K and F.
-		// First fill G
-		Eigen::MatrixXd G( 2*nVars, nVars*(k + 1) );
-		G.setZero();
-		for( Index var = 0; var < nVars; var++)
-		{
-			Eigen::MatrixXd Gvar( 2, k + 1 );
-			for ( Index i = 0; i < k+1; i++ )
-			{
-				Gvar( 0, i ) = tau( I.x_l )*LegendreBasis::Evaluate( I, i, I.x_l );
-				if ( I.x_l == grid.lowerBoundary() && problem->isLowerBoundaryDirichlet( var ) )
-					Gvar( 0, i ) = 0.0;
-				Gvar( 1, i ) = tau( I.x_u )*LegendreBasis::Evaluate( I, i, I.x_u );
-				if ( I.x_u == grid.upperBoundary() && problem->isUpperBoundaryDirichlet( var ) )
-					Gvar( 1, i ) = 0.0;
-			}
-			G.block(2*var,(k+1)*var,2, (k + 1)) = Gvar;
-		}
-
-		//[ C 0 G ]
-		CG_cellwise.emplace_back(2 * nVars, 3*nVars*(k+1));
-		CG_cellwise[i].setZero();
-		CG_cellwise[ i ].block( 0, 0, 2*nVars, nVars*(k + 1) ) = C;
-		CG_cellwise[ i ].block( 0, nVars*(k + 1), 2*nVars, nVars*(k + 1) ).setZero();
-		CG_cellwise[ i ].block( 0, 2*nVars*(k + 1), 2*nVars, nVars*(k + 1) ) = G;
-		G_cellwise.emplace_back(G);
-
-		// Now fill H
-		Eigen::MatrixXd H( 2*nVars, 2*nVars );
-		H.setZero();
+		// H couples the two faces of the cell
 		for(Index var = 0; var < nVars; var++)
 		{
-			Eigen::MatrixXd Hvar( 2, 2 );
-			Hvar.setZero();
-			Hvar( 0, 0 ) = -tau( I.x_l );
-			Hvar( 1, 0 ) = 0.0;
-			Hvar( 0, 1 ) = 0.0;
-			Hvar( 1, 1 ) = -tau( I.x_u );
-
-			if ( I.x_l == grid.lowerBoundary() && problem->isLowerBoundaryDirichlet( var ) )
-				Hvar( 0, 0 ) = 0.0;
-
-			if ( I.x_u == grid.upperBoundary() && problem->isUpperBoundaryDirichlet( var ) )
-				Hvar( 1, 1 ) = 0.0;
-
-			H.block(2*var,2*var,2,2) = Hvar;
-			HGlobalMat.block(var*(nCells+1) + i,var*(nCells+1) + i, 2, 2) += Hvar;
+			Matrix const& Hvar = cellMatrices( i, var ).H;
+			H_blocks.diagonal( i )    ( var, var ) += Hvar( 0, 0 );
+			H_blocks.upper( i )       ( var, var ) += Hvar( 0, 1 );
+			H_blocks.lower( i )       ( var, var ) += Hvar( 1, 0 );
+			H_blocks.diagonal( i + 1 )( var, var ) += Hvar( 1, 1 );
 		}
 
-		H_cellwise.emplace_back(H);
-
 		// Finally fill L
 		for(Index var = 0; var < nVars; var++)
 		{
@@ -357,44 +324,46 @@ void SystemSolver::initialiseMatrices()
 			if ( I.x_u == grid.upperBoundary() && /* is b.d. Neumann at upper boundary */ !problem->isUpperBoundaryDirichlet( var ) )
 				L_global( var*(nCells+1) + i + 1 ) += problem->UpperBoundary( var, 0.0 );
 		}
+	}
 
-		Eigen::MatrixXd X(nVars*(k+1), nVars*(k+1));
-		X.setZero();
-		for(Index var = 0; var < nVars; var++)
-		{
-			Eigen::MatrixXd Xvar( k + 1, k + 1 );
-			DGApprox::MassMatrix( I, Xvar, [ this,var ]( double x ){ return problem->aFn( var, x ); });
-			X.block(var*(k+1), var*(k+1), k+1, k+1) = Xvar;
-		}
-		XMats.emplace_back(X);
+	// a( x ) is arbitrary, so this is the one cell matrix that needs quadrature. The quadrature only sees a at the nodes,
+	// so if it takes one value at all of them ( the usual a = 1 ) the mass matrix is kept once per kind and width of cell
+	bool aConstant = true;
+	for ( Index var = 0; var < nVars && aConstant; var++ )
+	{
+		double a0 = problem->aFn( var, basis.x( grid[ 0 ], 0 ) );
+		for ( Index i = 0; i < nCells && aConstant; i++ )
+			for ( Index q = 0; q < basis.nNodes(); q++ )
+				aConstant = aConstant && problem->aFn( var, basis.x( grid[ i ], q ) ) == a0;
 	}
+	operators.clear();
+	aMass = operators.add( "a_mass", [ this ]( Index var, Interval const& I, BasisTable const& b, Matrix& out ) {
+		DGApprox::MassMatrix( I, out, [ this, var ]( double x ){ return problem->aFn( var, x ); }, b );
+	}, !aConstant );
+	problem->addOperators( operators );
+	operators.build( grid, nVars, basis, [ this ]( Index i ){ return cellMatrices.set( i ); } );
+
 	// Factorise the global H matrix
-	H_global.compute( HGlobalMat );
-	H_global_mat = HGlobalMat;
+	H_blocks.factorise();
+	resizeWorkspaces();
 	initialised = true;
 }
 
 void SystemSolver::clearCellwiseVecs()
 {
-	XMats.clear();
-	MBlocks.clear();
-	CG_cellwise.clear();
 	RF_cellwise.clear();
-	A_cellwise.clear();
-	B_cellwise.clear();
-	E_cellwise.clear();
-	C_cellwise.clear();
-	G_cellwise.clear();
-	H_cellwise.clear();
 }
 
-// Memory Layout for a sundials Y is, if i indexes the components of u / q / sigma
-// Y = [ sigma[ cell0, i=0 ], ..., sigma[ cell0, i= nVars - 1], q[ cell0, i = 0 ], ..., q[ cell0, i = nVars-1 ], u[ cell0, i = 0 ], .. u[ cell0, i = nVars - 1], sigma[ cell1, i=0 ], .... , u[ cellN-1, i = nVars - 1 ], Lambda[ cell0, i=0 ],.. ]
-// 
-// This API is now in DGSoln
+void SystemSolver::reserveCellwiseVecs()
+{
+	RF_cellwise.reserve( nCells );
+}
+
+// The memory layout of a sundials Y is chosen by setStateLayout, and only DGSoln knows it
 
 void SystemSolver::updateBoundaryConditions(double t)
 {
+	BasisTable const& basis = *pBasis;
 	L_global.setZero();
 	for ( unsigned int i = 0; i < nCells; i++ )
 	{
@@ -405,22 +374,22 @@ void SystemSolver::updateBoundaryConditions(double t)
 		{
 			if ( I.x_l == grid.lowerBoundary() && problem->isLowerBoundaryDirichlet( var ) )
 			{
-				for ( Eigen::Index j = 0; j < k+1; j++ )
+				for ( Eigen::Index j = 0; j < nCoeffs( var ); j++ )
 				{
 					// < g_D , v . n > ~= g_D( x_0 ) * phi_j( x_0 ) * ( n_x = -1 )
-					RF_cellwise[ i ]( j + var*(k+1) ) += -LegendreBasis::Evaluate( I, j, I.x_l ) * ( -1 ) * problem->LowerBoundary( var, t );
+					RF_cellwise[ i ]( j + blockStart[ var ] ) += -basis.phiLower( I, j ) * ( -1 ) * problem->LowerBoundary( var, t );
 					// < ( tau ) g_D, w >
-					RF_cellwise[ i ]( nVars*(k + 1) + j + var*(k+1) ) += LegendreBasis::Evaluate( I, j, I.x_l ) * tau( I.x_l ) * problem->LowerBoundary( var, t );
+					RF_cellwise[ i ]( fieldSize + j + blockStart[ var ] ) += basis.phiLower( I, j ) * tau( I.x_l ) * problem->LowerBoundary( var, t );
 				}
 			}
 
 			if ( I.x_u == grid.upperBoundary() && problem->isUpperBoundaryDirichlet( var ) )
 			{
-				for ( Eigen::Index j = 0; j < k+1; j++ )
+				for ( Eigen::Index j = 0; j < nCoeffs( var ); j++ )
 				{
 					// < g_D , v . n > ~= g_D( x_1 ) * phi_j( x_1 ) * ( n_x = +1 ) 
-					RF_cellwise[ i ]( j + var*(k+1) ) += -LegendreBasis::Evaluate( I, j, I.x_u ) * ( +1 ) * problem->UpperBoundary( var, t );
-					RF_cellwise[ i ]( nVars*(k + 1) + j + var*(k+1) ) += LegendreBasis::Evaluate( I, j, I.x_u ) * tau( I.x_u ) * problem->UpperBoundary( var, t );
+					RF_cellwise[ i ]( j + blockStart[ var ] ) += -basis.phiUpper( I, j ) * ( +1 ) * problem->UpperBoundary( var, t );
+					RF_cellwise[ i ]( fieldSize + j + blockStart[ var ] ) += basis.phiUpper( I, j ) * tau( I.x_u ) * problem->UpperBoundary( var, t );
 				}
 			}
 
@@ -460,247 +429,586 @@ void SystemSolver::resetCoeffs()
 	dydt.zeroCoeffs();
 }
 
-void SystemSolver::updateMForJacSolve(std::vector< Eigen::FullPivLU< Eigen::MatrixXd > >& MXsolvers, double alpha, DGSoln const & delta )
+void SystemSolver::updateMForJacSolve(std::vector< Eigen::FullPivLU< Eigen::MatrixXd > >& MXsolvers, double alpha, DGSoln const & state )
 {
-	MXsolvers.clear();
-
-	DGSoln newY( nVars, grid, k );
-	double *mem = new double[ newY.getDoF() ];
-	newY.Map( mem );
-
-	// We want to base our matrix off the current guess -- y + delta
-	newY.copy( y );
-	newY += delta;
-
-	Eigen::MatrixXd X( nVars*(k + 1), nVars*(k + 1) );
-	Eigen::MatrixXd NLq(nVars*(k+1), nVars*(k+1));
-	Eigen::MatrixXd NLu(nVars*(k+1), nVars*(k+1));
-	Eigen::MatrixXd Ssig(nVars*(k+1), nVars*(k+1));
-	Eigen::MatrixXd Sq(nVars*(k+1), nVars*(k+1));
-	Eigen::MatrixXd Su(nVars*(k+1), nVars*(k+1));
-
-	for ( unsigned int i = 0; i < nCells; i++ )
-	{
-		X.setZero();
-		NLq.setZero();
-		NLu.setZero();
-		Ssig.setZero();
-		Sq.setZero();
-		Su.setZero();
-
-		Interval const& I( grid[ i ] );
-		Eigen::MatrixXd MX(3*nVars*(k+1),3*nVars*(k+1));
-		MX.setZero();
-		MX = MBlocks[i];
-		//X matrix
-		for( Index var = 0; var < nVars; var++ )
+	if ( cellSolver == CellSolverType::Dense )
+		MXsolvers.resize( nCells );
+	else
+		condensedCells.resize( nCells );
+
+	// The linearised fluxes & sources of cell i, dSigma_du, dSigma_dq, dSources_du, dSources_dq & dSources_dsigma, from one
+	// evaluation of the physics per node if it provides one
+	auto linearise = [ & ]( Index i, CellWorkspace& w, std::array< Matrix*, 5 > const& D ) {
+		if ( problem->hasFusedEvaluation() )
+		{
+			FusedDerivativeMatrices( D, state, i, w );
+		}
+		else
 		{
-			std::function<double( double )> alphaF = [ =,this ]( double x ){ return alpha*problem->aFn(var, x);};
-			Eigen::MatrixXd Xsubmat( (k + 1), (k + 1) );
-			Xsubmat.setZero();
-			DGApprox::MassMatrix( I, Xsubmat, alphaF);
-			X.block(var*(k+1), var*(k+1), k+1, k+1) = Xsubmat;
+			NLuMat( *D[ 0 ], state, i, w );
+			NLqMat( *D[ 1 ], state, i, w );
+			dSourcedu_Mat( *D[ 2 ], state, i, w );
+			dSourcedq_Mat( *D[ 3 ], state, i, w );
+			dSourcedsigma_Mat( *D[ 4 ], state, i, w );
 		}
-		MX.block( nVars*(k+1), 2*nVars*(k+1), nVars*(k+1), nVars*(k+1) ) += X;
+	};
+
+	// The cell block MX of cell i from those, factorised
+	auto factorise = [ & ]( Index i, CellWorkspace& w, std::array< Matrix*, 5 > const& D ) {
+		Matrix & MX = w.MX;
+		cellMatrices.assembleM( i, MX );
+		//X matrix, alpha times the cached a_i( x ) mass matrix
+		for( Index var = 0; var < nVars; var++ )
+			MX.block( fieldSize + blockStart[ var ], 2*fieldSize + blockStart[ var ], nCoeffs( var ), nCoeffs( var ) ) += alpha * operators( aMass, i, var ).topLeftCorner( nCoeffs( var ), nCoeffs( var ) );
 
 		//NLq Matrix
-		NLqMat( NLq, newY, I);
-		MX.block( 2*nVars*(k+1), nVars*(k+1), nVars*(k+1), nVars*(k+1)) = NLq;
+		MX.block( 2*fieldSize, fieldSize, fieldSize, fieldSize ) = *D[ 1 ];
 
 		//NLu Matrix
-		NLuMat( NLu, newY, I);
-		MX.block( 2*nVars*(k+1), 2*nVars*(k+1), nVars*(k+1), nVars*(k+1)) = NLu;
+		MX.block( 2*fieldSize, 2*fieldSize, fieldSize, fieldSize ) = *D[ 0 ];
 
-		//S_sig Matrix
-		dSourcedsigma_Mat( Ssig, newY, I);
-		MX.block( nVars*(k+1), nVars*(k+1), nVars*(k+1), nVars*(k+1) ) = Ssig;
+		//S_sig Matrix, in the sigma column next to B
+		MX.block( fieldSize, 0, fieldSize, fieldSize ) += *D[ 4 ];
 
 		//S_q Matrix
-		dSourcedq_Mat( Sq, newY, I);
-		MX.block( nVars*(k+1), nVars*(k+1), nVars*(k+1), nVars*(k+1) ) = Sq;
+		MX.block( fieldSize, fieldSize, fieldSize, fieldSize ) = *D[ 3 ];
 
 		//S_u Matrix
-		dSourcedu_Mat( Su, newY, I);
-		MX.block( nVars*(k+1), 2*nVars*(k+1), nVars*(k+1), nVars*(k+1) ) += Su;
+		MX.block( fieldSize, 2*fieldSize, fieldSize, fieldSize ) += *D[ 2 ];
 
-		//if(i==0) std::cerr << MX << std::endl << std::endl;
-		//if(i==0)std::cerr << MX.inverse() << std::endl << std::endl;
+		if ( cellSolver == CellSolverType::Dense )
+			MXsolvers[ i ].compute( MX );
+		else
+			condenseCell( i, MX, condensedCells[ i ], w );
+	};
 
-		MXsolvers.emplace_back(MX);
+	if ( serialPhysics() )
+	{
+		forEachCell( true, [ & ]( Index begin, Index end, CellWorkspace& w ) {
+			for ( Index i = begin; i < end; i++ )
+			{
+				auto& D = derivativeBlocks[ i ];
+				linearise( i, w, { &D[ 0 ], &D[ 1 ], &D[ 2 ], &D[ 3 ], &D[ 4 ] } );
+			}
+		} );
+		forEachCell( false, [ & ]( Index begin, Index end, CellWorkspace& w ) {
+			for ( Index i = begin; i < end; i++ )
+			{
+				auto& D = derivativeBlocks[ i ];
+				factorise( i, w, { &D[ 0 ], &D[ 1 ], &D[ 2 ], &D[ 3 ], &D[ 4 ] } );
+			}
+		} );
+		return;
 	}
+
+	forEachCell( true, [ & ]( Index begin, Index end, CellWorkspace& w ) {
+		for ( Index i = begin; i < end; i++ )
+		{
+			linearise( i, w, { &w.NLu, &w.NLq, &w.Su, &w.Sq, &w.Ssig } );
+			factorise( i, w, { &w.NLu, &w.NLq, &w.Su, &w.Sq, &w.Ssig } );
+		}
+	} );
+}
+
+/*
+	The cell block is
+		( 0           -A     -B^T/h )   ( sigma )
+		( B/h + Ssig  Sq      X     ) * (   q   )
+		( A           NLq    NLu    )   (   u   )
+	with A the identity and B block diagonal in the variables. The first row gives q = -B^T u/h - r1 and the last sigma,
+	so only the Schur complement in u
+		X - Sq B^T/h - ( B/h + Ssig )( NLu - NLq B^T/h )
+	of size fieldSize, rather than the whole 3*fieldSize block, is factorised. The products with B are done a variable at a time.
+ */
+template< typename In, typename Out >
+void SystemSolver::coupledProduct( TransportSystem::Derivative d, Matrix const& A, In const& x, Out&& out, double scale ) const
+{
+	DerivativeCoupling const& c = coupling( d );
+	if ( !c.any )
+		return;
+	if ( c.all )
+	{
+		out.noalias() += scale * A * x;
+		return;
+	}
+	for ( Index XVar = 0; XVar < nVars; XVar++ )
+		for ( Index ZVar = 0; ZVar < nVars; ZVar++ )
+			if ( c.pattern( XVar, ZVar ) )
+				out.middleRows( blockStart[ XVar ], nCoeffs( XVar ) ).noalias() +=
+					scale * A.block( blockStart[ XVar ], blockStart[ ZVar ], nCoeffs( XVar ), nCoeffs( ZVar ) ) * x.middleRows( blockStart[ ZVar ], nCoeffs( ZVar ) );
 }
 
-void SystemSolver::mapDGtoSundials( std::vector< VectorWrapper >& SQU_cell, VectorWrapper& lam, realtype* const& Y) const
+void SystemSolver::condenseCell( Index i, Matrix const& MX, CondensedCell& cell, CellWorkspace& w )
 {
-	SQU_cell.clear();
-	for(Index i=0; i<nCells; i++)
+	using Derivative = TransportSystem::Derivative;
+	Index S = fieldSize;
+	double hInv = cellMatrices.invH( i );
+
+	// Only the blocks the problem can make non-zero are kept
+	auto keep = [ & ]( Derivative d, Matrix& stored, Index row, Index col ) {
+		if ( coupling( d ).any )
+			stored = MX.block( row, col, S, S );
+		else
+			stored.resize( 0, 0 );
+	};
+	keep( Derivative::dSources_dq, cell.Sq, S, S );
+	keep( Derivative::dSigma_dq, cell.NLq, 2*S, S );
+	keep( Derivative::dSigma_du, cell.NLu, 2*S, 2*S );
+	keep( Derivative::dSources_dsigma, cell.Ssig, S, 0 );
+	// whose block also holds B/h
+	if ( coupling( Derivative::dSources_dsigma ).any )
+		for ( Index var = 0; var < nVars; var++ )
+			cell.Ssig.block( blockStart[ var ], blockStart[ var ], nCoeffs( var ), nCoeffs( var ) ) -= hInv * cellMatrices( i, var ).B;
+
+	auto const& sq = coupling( Derivative::dSources_dq ).pattern;
+	auto const& nlq = coupling( Derivative::dSigma_dq ).pattern;
+	auto const& nlu = coupling( Derivative::dSigma_du ).pattern;
+
+	// P = NLu - NLq B^T/h, then the Schur complement X - Sq B^T/h - B P/h - Ssig P, a block at a time
+	Matrix & P = w.P, & schur = w.schur;
+	if ( coupling( Derivative::dSigma_du ).any )
+		P = cell.NLu;
+	else
+		P.setZero();
+	schur = MX.block( S, 2*S, S, S );
+	for ( Index XVar = 0; XVar < nVars; XVar++ )
 	{
-		SQU_cell.emplace_back( VectorWrapper( Y + i*3*nVars*(k+1), nVars*3*(k+1) ) );
+		Index nX = nCoeffs( XVar ), bX = blockStart[ XVar ];
+		for ( Index ZVar = 0; ZVar < nVars; ZVar++ )
+		{
+			Matrix const& B = cellMatrices( i, ZVar ).B;
+			Index nZ = nCoeffs( ZVar ), bZ = blockStart[ ZVar ];
+			if ( nlq( XVar, ZVar ) )
+				P.block( bX, bZ, nX, nZ ).noalias() -= hInv * cell.NLq.block( bX, bZ, nX, nZ ) * B.transpose();
+			if ( sq( XVar, ZVar ) )
+				schur.block( bX, bZ, nX, nZ ).noalias() -= hInv * cell.Sq.block( bX, bZ, nX, nZ ) * B.transpose();
+		}
+	}
+	for ( Index XVar = 0; XVar < nVars; XVar++ )
+	{
+		Index nX = nCoeffs( XVar ), bX = blockStart[ XVar ];
+		for ( Index ZVar = 0; ZVar < nVars; ZVar++ )
+		{
+			Index nZ = nCoeffs( ZVar ), bZ = blockStart[ ZVar ];
+			if ( nlq( XVar, ZVar ) || nlu( XVar, ZVar ) )
+				schur.block( bX, bZ, nX, nZ ).noalias() -= hInv * cellMatrices( i, XVar ).B * P.block( bX, bZ, nX, nZ );
+		}
 	}
+	coupledProduct( Derivative::dSources_dsigma, cell.Ssig, P, schur, -1.0 );
 
-	new (&lam) VectorWrapper( Y + nVars*(nCells)*(3*k+3), nVars*(nCells+1) );
+	// Groups of variables the complement does not couple are factorised separately, P is free to hold their blocks
+	cell.schur.resize( schurGroups.size() );
+	if ( schurGroups.size() == 1 )
+	{
+		cell.schur[ 0 ].compute( schur );
+		return;
+	}
+	for ( size_t g = 0; g < schurGroups.size(); g++ )
+	{
+		Index m = schurGroups[ g ].size();
+		auto rows = groupRows( g );
+		P.topLeftCorner( m, m ) = schur( rows, rows );
+		cell.schur[ g ].compute( P.topLeftCorner( m, m ) );
+	}
 }
 
-void SystemSolver::solveJacEq(N_Vector& g, N_Vector& delY)
+template< int M, int C >
+void SystemSolver::cellSolve( Index i, Eigen::Ref< const Matrix > const& b, Eigen::Ref< Matrix > x, Eigen::Ref< Matrix > work, CellWorkspace& w )
 {
-	// DGsoln object that will map the data from delY
-	DGSoln del_y( nVars, grid, k );
+	if ( cellSolver == CellSolverType::Dense )
+	{
+		LUSolve< M, C >( MXSolvers[ i ], b, x, work );
+		return;
+	}
 
-	assert( static_cast<size_t>( N_VGetLength( delY ) ) == del_y.getDoF() );
-	del_y.Map( N_VGetArrayPointer( delY ) );
+	// Back-substitution through the elimination in condenseCell
+	using Derivative = TransportSystem::Derivative;
+	constexpr int Mu = ( M == Eigen::Dynamic ) ? Eigen::Dynamic : M/3;
+	CondensedCell const& cell = condensedCells[ i ];
+	Index S = fieldSize, c = b.cols();
+	double hInv = cellMatrices.invH( i );
+	auto r1 = b.topRows( S ), r2 = b.middleRows( S, S ), r3 = b.bottomRows( S );
+	auto sigma = x.topRows( S ), q = x.middleRows( S, S ), u = x.bottomRows( S );
+	auto rhs = w.condensedRhs.leftCols( c ), tmp = w.condensedWork.leftCols( c );
+
+	// Schur complement RHS r2 - Sq ( -r1 ) - ( B/h + Ssig ) ( r3 + NLq r1 )
+	tmp = r3;
+	coupledProduct( Derivative::dSigma_dq, cell.NLq, r1, tmp, 1.0 );
+	rhs = r2;
+	coupledProduct( Derivative::dSources_dq, cell.Sq, r1, rhs, 1.0 );
+	coupledProduct( Derivative::dSources_dsigma, cell.Ssig, tmp, rhs, -1.0 );
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		Index n = nCoeffs( var ), o = blockStart[ var ];
+		rhs.middleRows( o, n ).noalias() -= hInv * cellMatrices( i, var ).B * tmp.middleRows( o, n );
+	}
 
-	std::vector< VectorWrapper > g1g2g3_cellwise;
-	VectorWrapper g4(nullptr, 0);
+	if ( schurGroups.size() == 1 )
+	{
+		LUSolve< Mu, C >( cell.schur[ 0 ], rhs, u, tmp );
+	}
+	else
+	{
+		for ( size_t g = 0; g < schurGroups.size(); g++ )
+		{
+			Index m = schurGroups[ g ].size();
+			auto groupRhs = w.groupRhs.topLeftCorner( m, c ), groupX = w.groupX.topLeftCorner( m, c );
+			groupRhs = rhs( groupRows( g ), Eigen::all );
+			LUSolve( cell.schur[ g ], groupRhs, groupX, w.groupWork.topLeftCorner( m, c ) );
+			u( groupRows( g ), Eigen::all ) = groupX;
+		}
+	}
 
-	// Eigen::Vector wrapper
-	VectorWrapper delYVec( N_VGetArrayPointer( delY ), N_VGetLength( delY ) );
-	delYVec.setZero();
-	
-	K_global.setZero();
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		Index n = nCoeffs( var ), o = blockStart[ var ];
+		q.middleRows( o, n ).noalias() = -hInv * cellMatrices( i, var ).B.transpose() * u.middleRows( o, n );
+	}
+	q -= r1;
+	sigma = r3;
+	coupledProduct( Derivative::dSigma_dq, cell.NLq, q, sigma, -1.0 );
+	coupledProduct( Derivative::dSigma_du, cell.NLu, u, sigma, -1.0 );
+}
 
-	//assemble temp cellwise M blocks
-	std::vector< Eigen::FullPivLU< Eigen::MatrixXd > > factorisedM{};
-	updateMForJacSolve(factorisedM, alpha, del_y );
+void SystemSolver::setCoupling()
+{
+	for ( Index d = 0; d < static_cast<Index>( couplings.size() ); d++ )
+	{
+		DerivativeCoupling & c = couplings[ d ];
+		c.pattern = problem->coupling( static_cast< TransportSystem::Derivative >( d ) );
+		c.any = c.pattern.any();
+		c.all = c.pattern.all();
+	}
 
-	// Assemble RHS g into cellwise form and solve for SQU blocks
-	mapDGtoSundials(g1g2g3_cellwise, g4, N_VGetArrayPointer( g ));
+	// Variables are coupled in the Schur complement in u through any of the derivatives, directly or through a
+	// product of two of them ( Ssig P, see condenseCell ). Group them by following those couplings both ways
+	TransportSystem::Coupling linked = TransportSystem::Coupling::Constant( nVars, nVars, false );
+	for ( DerivativeCoupling const& c : couplings )
+		linked = linked || c.pattern;
+	linked = linked || linked.transpose().eval();
 
-	std::vector< Eigen::VectorXd > SQU_f( nCells );
-	std::vector< Eigen::MatrixXd > SQU_0( nCells );
-	for ( Index i = 0; i < nCells; i++ )
-	{  
-		// Interval const& I( grid[ i ] );
+	std::vector< Index > groupOf( nVars, -1 );
+	schurGroups.clear();
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		if ( groupOf[ var ] >= 0 )
+			continue;
+		std::vector< Index > vars{ var }, rows;
+		groupOf[ var ] = schurGroups.size();
+		for ( size_t next = 0; next < vars.size(); next++ )
+			for ( Index other = 0; other < nVars; other++ )
+				if ( linked( vars[ next ], other ) && groupOf[ other ] < 0 )
+				{
+					groupOf[ other ] = schurGroups.size();
+					vars.push_back( other );
+				}
+		std::sort( vars.begin(), vars.end() );
+		for ( Index v : vars )
+			for ( Index j = 0; j < nCoeffs( v ); j++ )
+				rows.push_back( blockStart[ v ] + j );
+		schurGroups.push_back( rows );
+	}
+}
 
-		//SQU_f
-		Eigen::VectorXd g1g2g3 = g1g2g3_cellwise[ i ];
+bool SystemSolver::cellsFactorised() const
+{
+	return ( cellSolver == CellSolverType::Dense ? MXSolvers.size() : condensedCells.size() ) == nCells;
+}
+
+void SystemSolver::setJacobianState( N_Vector const& Y )
+{
+	yJac.Map( N_VGetArrayPointer( Y ) );
+	useJacobianState = true;
+}
 
-		SQU_f[ i ] = factorisedM[ i ].solve( g1g2g3 );
+void SystemSolver::setStateLayout( DGSoln::Layout l )
+{
+	stateLayout = l;
+	for ( DGSoln* soln : { &y, &dydt, &resY, &resdYdt, &resValues, &gSoln, &delYSoln, &yJac } )
+		soln->setLayout( l );
+}
+
+void SystemSolver::setLambdaSolver( LambdaSolverType t )
+{
+	lambdaSolver = t;
+	// Cached factorisations are for the other storage scheme
+	MXSolvers.clear();
+	condensedCells.clear();
+}
 
-		//SQU_0
-		Eigen::MatrixXd CE = CEBlocks[ i ];
-		SQU_0[ i ] = factorisedM[ i ].solve( CE );
-		//std::cerr << SQU_0[i] << std::endl << std::endl;
-		//std::cerr << CE << std::endl << std::endl;
+void SystemSolver::setCellSolver( CellSolverType t )
+{
+	cellSolver = t;
+	MXSolvers.clear();
+	condensedCells.clear();
+}
 
+void SystemSolver::setupJacEq()
+{
+	// Linearise about the state IDA gave us, if it has done so since the last setup, otherwise about y
+	DGSoln const& state = useJacobianState ? yJac : y;
+	useJacobianState = false;
+
+	// The lambda system couples each face only to its neighbours, so
+	// is block tridiagonal when ordered face-major (blocks of size nVars).
+	// The dense path keeps the variable-major ordering used in Y.
+	if ( lambdaSolver == LambdaSolverType::Dense )
+	{
+		K_global.resize( nVars*(nCells + 1), nVars*(nCells + 1) );
+		K_global.setZero();
+	}
+	else
+	{
+		if ( K_blocks.nBlocks() != nCells + 1 || K_blocks.blockSize() != nVars )
+			K_blocks.resize( nCells + 1, nVars );
+		K_blocks.setZero();
+	}
 
-		Eigen::MatrixXd K_cell(nVars*2,nVars*2);
-		K_cell.setZero();
-		K_cell = H_cellwise[i] - CG_cellwise[ i ] * SQU_0[i];
+	// assemble & factorise the cellwise M blocks
+	updateMForJacSolve( MXSolvers, alpha, state );
 
-		//std::cerr << SQU_f[i] << std::endl << std::endl;
-		//K
+	// The cell blocks are M x M, M = 3*nVars*(k+1) ( 3*fieldSize with mixed degrees ), with C = 2*nVars trace unknowns
+	dispatchCellKernel( [ & ]( auto NSize, auto VSize ) {
+		constexpr int M = BlockSize( 3, BlockSize( decltype( VSize )::value, decltype( NSize )::value ) );
+		constexpr int C = BlockSize( 2, decltype( VSize )::value );
+		Index m = 3*fieldSize, c = 2*nVars;
+
+		forEachCell( false, [ & ]( Index begin, Index end, CellWorkspace& w ) {
+			for ( Index i = begin; i < end; i++ )
+			{
+				//SQU_0
+				cellMatrices.assembleCE( i, w.CE );
+				cellSolve< M, C >( i, w.CE, SQU_0[ i ], w.SQU_0_work, w );
+				//std::cerr << SQU_0[i] << std::endl << std::endl;
+
+				cellMatrices.assembleH( i, K_cellwise[ i ] );
+				cellMatrices.assembleCG( i, w.CG );
+				K_cellwise[ i ].noalias() -= w.CG.template block< C, M >( 0, 0, c, m ) * SQU_0[ i ].template block< M, C >( 0, 0, m, c );
+			}
+		} );
+	} );
+
+	// Neighbouring cells share a face, so the scatter into K is done in serial
+	for ( Index i = 0; i < nCells; i++ )
+	{
+		Matrix const& K_cell = K_cellwise[ i ];
+
+		//K, including the coupling between different variables on the faces of this cell
 		for(Index var = 0; var < nVars; var++ )
 		{
-			K_global.block( var*(nCells + 1) + i, var*(nCells + 1) + i, 2, 2 ) += K_cell.block(var*2,var*2,2,2);
+			for(Index var2 = 0; var2 < nVars; var2++ )
+			{
+				if ( lambdaSolver == LambdaSolverType::Dense )
+				{
+					K_global.block( var*(nCells + 1) + i, var2*(nCells + 1) + i, 2, 2 ) += K_cell.block(var*2,var2*2,2,2);
+				}
+				else
+				{
+					K_blocks.diagonal( i )    ( var, var2 ) += K_cell( var*2,     var2*2 );
+					K_blocks.upper( i )       ( var, var2 ) += K_cell( var*2,     var2*2 + 1 );
+					K_blocks.lower( i )       ( var, var2 ) += K_cell( var*2 + 1, var2*2 );
+					K_blocks.diagonal( i + 1 )( var, var2 ) += K_cell( var*2 + 1, var2*2 + 1 );
+				}
+			}
 		}
 	}
 
-	// Construct the RHS of K Lambda = F
-	Eigen::VectorXd F( nVars*(nCells + 1) );
+	// A Dirichlet face is cut off from its cell, and its residual is g_D - lambda, so its row is just -lambda
+	auto dirichletRow = [ & ]( Index face, Index var ) {
+		if ( lambdaSolver == LambdaSolverType::Dense )
+			K_global( var*(nCells + 1) + face, var*(nCells + 1) + face ) = -1.0;
+		else
+			K_blocks.diagonal( face )( var, var ) = -1.0;
+	};
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		if ( problem->isLowerBoundaryDirichlet( var ) )
+			dirichletRow( 0, var );
+		if ( problem->isUpperBoundaryDirichlet( var ) )
+			dirichletRow( nCells, var );
+	}
+
+	// Factorise the global matrix ( size n_cells * n_variables )
+	if ( lambdaSolver == LambdaSolverType::Dense )
+	{
+		K_global_lu.compute( K_global );
+		K_global.resize( 0, 0 );
+	}
+	else
+	{
+		K_blocks.factorise();
+	}
+}
+
+void SystemSolver::solveJacEq(N_Vector& g, N_Vector& delY)
+{
+	if ( !cellsFactorised() )
+		throw std::logic_error( "solveJacEq called without a prior call to setupJacEq" );
+
+	// DGsoln object that will map the data from delY
+	DGSoln & del_y = delYSoln;
+
+	assert( static_cast<size_t>( N_VGetLength( delY ) ) == del_y.getDoF() );
+	del_y.Map( N_VGetArrayPointer( delY ) );
+
+	// RHS g in cellwise form, [ g1 g2 g3 ] for cell i is gathered from the sigma, q & u parts, g4 is the lambda part
+	DGSoln & gS = gSoln;
+	gS.Map( N_VGetArrayPointer( g ) );
+
+	// Eigen::Vector wrapper
+	VectorWrapper delYVec( N_VGetArrayPointer( delY ), N_VGetLength( delY ) );
+	delYVec.setZero();
+
+	// Only back-substitutions from here on, all the factorisations were done in setupJacEq.
+	// As there, the cell blocks are M x M with C trace unknowns
+	Index m = 3*fieldSize, c = 2*nVars;
+	dispatchCellKernel( [ & ]( auto NSize, auto VSize ) {
+		constexpr int M = BlockSize( 3, BlockSize( decltype( VSize )::value, decltype( NSize )::value ) );
+		constexpr int C = BlockSize( 2, decltype( VSize )::value );
+
+		forEachCell( false, [ & ]( Index begin, Index end, CellWorkspace& w ) {
+			for ( Index i = begin; i < end; i++ )
+			{
+				//SQU_f
+				Vector & g1g2g3 = w.gCell;
+				gS.gatherCell( i, g1g2g3 );
+
+				cellSolve< M, 1 >( i, g1g2g3, SQU_f[ i ], w.SQU_f_work, w );
+				cellMatrices.assembleCG( i, w.CG );
+				CG_SQU_f[ i ].noalias() = w.CG.template block< C, M >( 0, 0, c, m ) * SQU_f[ i ].template head< M >( m );
+			}
+		} );
+	} );
+
+	// Construct the RHS of K Lambda = F, in serial as neighbouring cells share a face.
+	// The trace residual is -lambda + H^{-1}( L - C sigma - G u ), multiplying its rows through by -H gives
+	// the rows of K, so the lambda part of g is multiplied by -H too
 	F.setZero();
-	F = g4;
 	for ( Index i=0; i < nCells; i++ )
 	{
 		for( Index var = 0; var < nVars; var++)
 		{
-			F.block<2,1>( var*(nCells + 1) + i, 0 ) -= (CG_cellwise[ i ] * SQU_f[ i ]).block(var*2,0,2,1);
+			Eigen::Vector2d g4( gS.lambda( var )( i ), gS.lambda( var )( i + 1 ) );
+			F.block<2,1>( var*(nCells + 1) + i, 0 ).noalias() -= cellMatrices( i, var ).H * g4;
+			F.block<2,1>( var*(nCells + 1) + i, 0 ) -= CG_SQU_f[ i ].block(var*2,0,2,1);
 		}
 	}
+	// except on Dirichlet faces, whose row of K is -lambda
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		if ( problem->isLowerBoundaryDirichlet( var ) )
+			F( var*(nCells + 1) ) = gS.lambda( var )( 0 );
+		if ( problem->isUpperBoundaryDirichlet( var ) )
+			F( var*(nCells + 1) + nCells ) = gS.lambda( var )( nCells );
+	}
 
-	// Factorise the global matrix ( size n_cells * n_variables )
-	Eigen::FullPivLU< Eigen::MatrixXd > lu( K_global );
 	// This solves for the lambdas of all variables at once (drop it in the memory sundials reserved for it)
-	Index LambdaOffset = nVars * nCells * ( k + 1 ) * 3;
-	
-	delYVec.segment( LambdaOffset, nVars*( nCells + 1 ) ) = lu.solve( F );
-
-	// Now find del sigma, del q and del u to eventually find del Y
-	for ( Index i=0; i < nCells; i++ )
+	if ( lambdaSolver == LambdaSolverType::Dense )
 	{
-		// Interval const& I = grid[ i ];
-		Vector delSQU( 3*nVars*( k + 1 ) );
+		// Variable-major, like F
+		F_faces = K_global_lu.solve( F );
+		for ( Index var = 0; var < nVars; var++ )
+			del_y.lambda( var ) = F_faces.segment( var*( nCells + 1 ), nCells + 1 );
+	}
+	else
+	{
+		// Reorder F to face-major, solve in place and scatter back to the lambdas of delY
+		for ( Index face = 0; face < nCells + 1; face++ )
+			for ( Index var = 0; var < nVars; var++ )
+				F_faces( face*nVars + var ) = F( var*( nCells + 1 ) + face );
 
-		// Reorganise the data from variable-major to cell-major
-		Vector delLambdaCell( 2*nVars );
+		K_blocks.solve( F_faces );
 
-		for( Index var = 0; var < nVars; var++ )
-		{
-			delLambdaCell.block<2,1>(2*var,0) = delYVec.segment( LambdaOffset + var * ( nCells + 1 ) + i, 2 );
-		}
+		for ( Index face = 0; face < nCells + 1; face++ )
+			for ( Index var = 0; var < nVars; var++ )
+				del_y.lambda( var )( face ) = F_faces( face*nVars + var );
+	}
 
-		/*
-		// Try mapping the memory by using the magic runes (future update)
-		Eigen::Map< Vector, Eigen::Unaligned, Eigen::Stride< Eigen::Dynamic, 0 > > 
-			delLambdaCell( delYVec.data() + LambdaOffset + i, 2 * nVars, Eigen::Stride< Eigen::Dynamic, 0 >( nCells + 1, 0 ) );
-			*/
+	// Now find del sigma, del q and del u to eventually find del Y
+	dispatchCellKernel( [ & ]( auto NSize, auto VSize ) {
+		constexpr int M = BlockSize( 3, BlockSize( decltype( VSize )::value, decltype( NSize )::value ) );
+		constexpr int C = BlockSize( 2, decltype( VSize )::value );
 
-		delSQU = SQU_f[ i ] - SQU_0[ i ] * delLambdaCell;
-		for(Index var = 0; var < nVars; var++)
-		{
-			del_y.sigma( var ).getCoeff( i ).second = delSQU.block( var*(k+1),                   0, k + 1, 1 );
-			del_y.q( var )    .getCoeff( i ).second = delSQU.block( nVars*(k + 1) + var*(k+1),   0, k + 1, 1 );
-			del_y.u( var )    .getCoeff( i ).second = delSQU.block( 2*nVars*(k + 1) + var*(k+1), 0, k + 1, 1 );
-		}
-	}
+		forEachCell( false, [ & ]( Index begin, Index end, CellWorkspace& w ) {
+			for ( Index i = begin; i < end; i++ )
+			{
+				// Interval const& I = grid[ i ];
+				Vector & delSQU = w.delSQU;
+
+				// Gather the lambdas on the faces of this cell
+				Vector & delLambdaCell = w.delLambdaCell;
 
+				for( Index var = 0; var < nVars; var++ )
+				{
+					delLambdaCell( 2*var )     = del_y.lambda( var )( i );
+					delLambdaCell( 2*var + 1 ) = del_y.lambda( var )( i + 1 );
+				}
+
+				delSQU = SQU_f[ i ];
+				delSQU.template head< M >( m ).noalias() -= SQU_0[ i ].template block< M, C >( 0, 0, m, c ) * delLambdaCell.template head< C >( c );
+				del_y.scatterCell( i, delSQU );
+			}
+		} );
+	} );
 }
 
 int residual(realtype tres, N_Vector Y, N_Vector dYdt, N_Vector resval, void *user_data)
 {
 	auto system = reinterpret_cast<SystemSolver*>( user_data );
-	auto k = system->k;
-	auto grid(system->grid);
+	Grid const& grid = system->grid;
 	auto nCells = system->nCells;
 	auto nVars = system->nVars;
 
 	system->updateBoundaryConditions(tres);
 
-	DGSoln temp( nVars, grid, k, N_VGetArrayPointer( Y ) );
-	DGSoln temp_dt( nVars, grid, k, N_VGetArrayPointer( dYdt ) );
-	DGSoln res( nVars, grid, k, N_VGetArrayPointer( resval ) );
+	// Re-pointing the solver's views at IDA's vectors, rather than building new ones, keeps this allocation-free
+	DGSoln & temp = system->resY;
+	DGSoln & temp_dt = system->resdYdt;
+	DGSoln & res = system->resValues;
+	temp.Map( N_VGetArrayPointer( Y ) );
+	temp_dt.Map( N_VGetArrayPointer( dYdt ) );
+	res.Map( N_VGetArrayPointer( resval ) );
 	
-	DGApprox tempKappa(grid, k);
-	
-	Vector lam(nVars*(nCells+1));
+	BasisTable const& basis = *system->pBasis;
+
+	Vector & lam = system->lam;
 
 	VectorWrapper resVec( N_VGetArrayPointer( resval ), N_VGetLength( resval ) );
 	resVec.setZero();
 
 	//Solve for Lambda with Lam = (H^T)^-1*[ -C*Sig - G*U + L ] 
-	Eigen::VectorXd CsGuL_global(nVars*(nCells+1));
+	// Assembled face-major to match H_blocks, the block for face i is CsGuL_global.segment( i*nVars, nVars )
+	Eigen::VectorXd & CsGuL_global = system->CsGuL_global;
 	CsGuL_global.setZero();
 	for ( Index i=0; i < nCells; i++ )
 	{
 		// Interval I = grid[ i ];
-		Eigen::VectorXd LVarCell(2);
-		Eigen::VectorXd CsGuLVarCell(2);
-		CsGuLVarCell.setZero();
-		LVarCell.setZero();
+		Eigen::Vector2d CsGuLVarCell;
 		for( Index var = 0; var < nVars; var++)
 		{
-			LVarCell = system->L_global.block<2,1>(var*(nCells+1) + i,0);
-
-			CsGuLVarCell = LVarCell 
-				- system->C_cellwise[i].block(var*2,var*(k+1),2,k+1) * temp.sigma( var ).getCoeff( i ).second 
-				- system->G_cellwise[i].block(var*2,var*(k+1),2,k+1) * temp.u( var ).getCoeff( i ).second;
-
-			CsGuL_global.block(var*(nCells + 1) + i, 0, 2, 1) += CsGuLVarCell;
+			CellMatrices::Blocks const& cell = system->cellMatrices( i, var );
+			double scale = system->cellMatrices.invRootH( i );
+			CsGuLVarCell = system->L_global.block<2,1>(var*(nCells+1) + i,0);
+			CsGuLVarCell.noalias() -= scale * cell.C * temp.sigma( var ).getCoeff( i ).second;
+			CsGuLVarCell.noalias() -= scale * cell.G * temp.u( var ).getCoeff( i ).second;
+
+			CsGuL_global( i*nVars + var )       += CsGuLVarCell( 0 );
+			CsGuL_global( ( i + 1 )*nVars + var ) += CsGuLVarCell( 1 );
 		}
 	}
-	lam = system->H_global.solve( CsGuL_global );
+	system->H_blocks.solve( CsGuL_global );
+	for ( Index face = 0; face < nCells + 1; face++ )
+		for ( Index var = 0; var < nVars; var++ )
+			lam( var*( nCells + 1 ) + face ) = CsGuL_global( face*nVars + var );
 
+	// On a Dirichlet face the residual is g_D - lambda. Y is left alone, the face is cut off from its cell anyway
 	auto problem = system->problem;
 	for( Index var = 0; var < nVars; var++)
 	{
-		if( problem->isLowerBoundaryDirichlet( var ) ) {
-			lam[var*(nCells+1)]     = problem->LowerBoundary( var, static_cast<double>(tres) );
-			temp.lambda( var )[ 0 ] = problem->LowerBoundary( var, static_cast<double>(tres) );
-		}
-		if( problem->isUpperBoundaryDirichlet( var ) ) {
-			lam[nCells+var*(nCells+1)]   = problem->UpperBoundary( var, static_cast<double>(tres) );
-			temp.lambda( var )[ nCells ] = problem->UpperBoundary( var, static_cast<double>(tres) );
-		}
-
+		if( problem->isLowerBoundaryDirichlet( var ) )
+			lam[var*(nCells+1)]        = problem->LowerBoundary( var, static_cast<double>(tres) );
+		if( problem->isUpperBoundaryDirichlet( var ) )
+			lam[nCells+var*(nCells+1)] = problem->UpperBoundary( var, static_cast<double>(tres) );
 	}
 
 	for( Index var = 0; var < nVars; var++)
@@ -709,66 +1017,101 @@ int residual(realtype tres, N_Vector Y, N_Vector dYdt, N_Vector resval, void *us
 	}
 
 
-	for ( Index i=0; i < nCells; i++ )
-	{
-		Interval I = grid[ i ];
-		Eigen::VectorXd lamCell(2*nVars);
-
-		for( Index var = 0; var < nVars; var++ )
-		{
-			auto const& lCell = temp.lambda( var );
-			lamCell[2*var] = lCell[ i ]; lamCell[2*var + 1] = lCell[ i + 1 ];
-		}
+	// Cells are independent from here on. The workspace for the fused flux & source evaluation
+	// is per thread, with one column per variable. The per-variable blocks are N x N, N = k + 1 for that variable
+	system->dispatchCellKernel( [ & ]( auto NSize, auto ) {
+		constexpr int N = decltype( NSize )::value;
+		using VectorN = Eigen::Matrix< double, N, 1 >;
 
-		//length = nVars*(k+1)
-		for(Index var = 0; var < nVars; var++)
-		{
-			std::function< double (double) > kappaFunc = [ =,&temp,&system ]( double x ) {
-				Values u_vals( nVars ),q_vals( nVars );
-				for ( Index iv=0; iv < nVars; ++iv )
-				{
-					u_vals[ iv ] = temp.u( iv )( x );
-					q_vals[ iv ] = temp.q( iv )( x );
-				}
-				return system->problem->SigmaFn( var, u_vals, q_vals, x, tres );
-			};
+		// u, q & sigma of every variable at every node of cells [ begin, end ), in one product
+		auto evaluateAtNodes = [ & ]( Index begin, Index end ) {
+			temp.EvaluateAtNodes( basis, system->yNodes.middleCols( 3*nVars*begin, 3*nVars*( end - begin ) ), begin, end );
+		};
 
-			std::function< double (double) > sourceFunc = [ =,&temp,&system ]( double x ) {
-				Values u_vals( nVars ),q_vals( nVars ),sigma_vals( nVars );
-				for ( Index iv=0; iv < nVars; ++iv )
-				{
-					u_vals[ iv ] = temp.u( iv )( x );
-					q_vals[ iv ] = temp.q( iv )( x );
-					sigma_vals[ iv ] = temp.sigma( iv )( x );
-				}
-				return system->problem->Sources( var, u_vals, q_vals, sigma_vals, x, tres );
-			};
+		// The physics is called once for all the nodes and variables of cell i
+		auto evaluate = [ & ]( Index i, SystemSolver::CellWorkspace& w, Eigen::Ref< Matrix > kappa_nodes, Eigen::Ref< Matrix > S_nodes ) {
+			auto sigma_nodes = system->yNodes.middleCols( temp.coeffColumn( i, DGSoln::Sigma, 0 ), nVars );
+			auto q_nodes     = system->yNodes.middleCols( temp.coeffColumn( i, DGSoln::Q, 0 ), nVars );
+			auto u_nodes     = system->yNodes.middleCols( temp.coeffColumn( i, DGSoln::U, 0 ), nVars );
 
-			//Evaluate Diffusion Function
-			Eigen::VectorXd kappa_cellwise(k+1);
-			kappa_cellwise.setZero();
-			for ( Eigen::Index j = 0; j < k+1; j++ )
-				kappa_cellwise( j ) = DGApprox::CellProduct( I, kappaFunc, LegendreBasis::phi( I, j ) );
+			basis.x( grid[ i ], w.x_nodes );
+			problem->Evaluate( u_nodes, q_nodes, sigma_nodes, w.x_nodes, tres, kappa_nodes, S_nodes );
+		};
 
-			//Evaluate Source Function
-			Eigen::VectorXd S_cellwise(k+1);
-			S_cellwise.setZero();
-			for ( Eigen::Index j = 0; j < k+1; j++ )
-				S_cellwise( j ) = DGApprox::CellProduct( I, sourceFunc, LegendreBasis::phi( I, j%(k+1) ) );
+		// The residual of cell i, given its fluxes & sources at the nodes
+		auto assemble = [ & ]( Index i, SystemSolver::CellWorkspace& w, Eigen::Ref< const Matrix > kappa_nodes, Eigen::Ref< const Matrix > S_nodes ) {
+			Interval const& I = grid[ i ];
+			Matrix & kappa_cellwise = w.kappa_cellwise, & S_cellwise = w.S_cellwise;
+			Vector & lamCell = w.lamCell;
 
-			res.sigma( var ).getCoeff( i ).second = 
-				-system->A_cellwise[i].block(var*(k+1), var*(k+1), k+1, k+1) * temp.q( var ).getCoeff( i ).second - system->B_cellwise[i].transpose().block(var*(k+1), var*(k+1), k+1, k+1) * temp.u( var ).getCoeff( i ).second
-				+ system->C_cellwise[i].transpose().block(var*(k+1), var*2, k+1, 2)*lamCell.block<2,1>(var*2,0) - system->RF_cellwise[ i ].block( var*(k+1), 0, k + 1, 1 );
+			for( Index var = 0; var < nVars; var++ )
+			{
+				auto const& lCell = temp.lambda( var );
+				lamCell[2*var] = lCell[ i ]; lamCell[2*var + 1] = lCell[ i + 1 ];
+			}
 
-			res.q( var ).getCoeff( i ).second = 
-				system->B_cellwise[i].block(var*(k+1), var*(k+1), k+1, k+1) * temp.sigma( var ).getCoeff( i ).second + system->D_cellwise[i].block(var*(k+1), var*(k+1), k+1, k+1)*temp.u( var ).getCoeff( i ).second 
-				+ system->E_cellwise[i].block(var*(k+1), var*2, k+1, 2)*lamCell.block<2,1>(var*2,0) - system->RF_cellwise[ i ].block( nVars*(k + 1) + var*(k+1), 0, k + 1, 1 ) + S_cellwise
-				+ system->XMats[i].block(var*(k+1), var*(k+1), k+1, k+1)*temp_dt.u( var ).getCoeff( i ).second;
+			//Project the diffusion and source functions onto all the test functions at once
+			basis.Project< N >( I, kappa_nodes, kappa_cellwise );
+			basis.Project< N >( I, S_nodes, S_cellwise );
 
-			res.u( var ).getCoeff( i ).second = temp.sigma( var ).getCoeff( i ).second + kappa_cellwise;
+			//length = fieldSize
+			// Each product is accumulated straight into the output with noalias(), so no temporaries are made
+			for(Index var = 0; var < nVars; var++)
+			{
+				Index n = system->nCoeffs( var ), b = system->blockStart[ var ];
+				Eigen::Map< const VectorN > sigma( temp.sigma( var ).getCoeff( i ).second.data(), n );
+				Eigen::Map< const VectorN > q( temp.q( var ).getCoeff( i ).second.data(), n );
+				Eigen::Map< const VectorN > u( temp.u( var ).getCoeff( i ).second.data(), n );
+				Eigen::Map< const VectorN > u_dt( temp_dt.u( var ).getCoeff( i ).second.data(), n );
+				// The unit-width blocks of this kind of cell, scaled by 1/h or 1/sqrt( h ). A is the identity
+				CellMatrices::Blocks const& cell = system->cellMatrices( i, var );
+				double hInv = system->cellMatrices.invH( i ), rootHInv = system->cellMatrices.invRootH( i );
+				auto unitBlock = [ & ]( Matrix const& M ) { return M.template topLeftCorner< N, N >( n, n ); };
+
+				Eigen::Map< VectorN > resSigma( res.sigma( var ).getCoeff( i ).second.data(), n );
+				resSigma = -system->RF_cellwise[ i ].template segment< N >( b, n );
+				resSigma -= q;
+				resSigma.noalias() -= hInv * unitBlock( cell.B ).transpose() * u;
+				resSigma.noalias() += rootHInv * cell.C.transpose().template topRows< N >( n )*lamCell.segment< 2 >( var*2 );
+
+				Eigen::Map< VectorN > resQ( res.q( var ).getCoeff( i ).second.data(), n );
+				resQ = S_cellwise.col( var ).template head< N >( n ) - system->RF_cellwise[ i ].template segment< N >( system->fieldSize + b, n );
+				resQ.noalias() += hInv * unitBlock( cell.B ) * sigma;
+				resQ.noalias() += hInv * unitBlock( cell.D ) * u;
+				resQ.noalias() += rootHInv * cell.E.template topRows< N >( n )*lamCell.segment< 2 >( var*2 );
+				resQ.noalias() += system->operators( system->aMass, i, var ).template topLeftCorner< N, N >( n, n ) * u_dt;
+
+				Eigen::Map< VectorN > resU( res.u( var ).getCoeff( i ).second.data(), n );
+				resU = sigma + kappa_cellwise.col( var ).template head< N >( n );
+			}
+		};
 
+		if ( system->serialPhysics() )
+		{
+			Matrix & fluxNodes = system->fluxNodes, & sourceNodes = system->sourceNodes;
+			system->forEachCell( false, [ & ]( Index begin, Index end, SystemSolver::CellWorkspace& ) {
+				evaluateAtNodes( begin, end );
+			} );
+			system->forEachCell( true, [ & ]( Index begin, Index end, SystemSolver::CellWorkspace& w ) {
+				for ( Index i = begin; i < end; i++ )
+					evaluate( i, w, fluxNodes.middleCols( nVars*i, nVars ), sourceNodes.middleCols( nVars*i, nVars ) );
+			} );
+			system->forEachCell( false, [ & ]( Index begin, Index end, SystemSolver::CellWorkspace& w ) {
+				for ( Index i = begin; i < end; i++ )
+					assemble( i, w, fluxNodes.middleCols( nVars*i, nVars ), sourceNodes.middleCols( nVars*i, nVars ) );
+			} );
+			return;
 		}
-	}
+
+		system->forEachCell( true, [ & ]( Index begin, Index end, SystemSolver::CellWorkspace& w ) {
+			evaluateAtNodes( begin, end );
+			for ( Index i = begin; i < end; i++ )
+			{
+				evaluate( i, w, w.kappa_nodes, w.S_nodes );
+				assemble( i, w, w.kappa_nodes, w.S_nodes );
+			}
+		} );
+	} );
 
 	//system->print(std::cerr, tres, 21, 0);
 
@@ -819,16 +1162,18 @@ int residual(realtype tres, N_Vector Y, N_Vector dYdt, N_Vector resval, void *us
 
 void SystemSolver::print( std::ostream& out, double t, int nOut, N_Vector const & tempY )
 {
-	DGSoln tmp_y( nVars, grid, k, N_VGetArrayPointer( tempY ) );
+	DGSoln tmp_y( nVars, grid, degrees, N_VGetArrayPointer( tempY ), stateLayout );
+	tmp_y.setBasis( y.basis() );
 
 	out << "# t = " << t << std::endl;
 	double delta_x = ( grid.upperBoundary() - grid.lowerBoundary() ) * ( 1.0/( nOut - 1.0 ) );
 	for ( int i=0; i<nOut; ++i )
 	{
 		double x = static_cast<double>( i )*delta_x + grid.lowerBoundary();
+		Index cell = grid.findCell( x );
 		out << x;
 		for ( Index v = 0; v < nVars; ++v )
-			out << "\t" << tmp_y.u( v )( x ) << "\t" << tmp_y.q( v )( x ) << "\t" << tmp_y.sigma( v )( x );
+			out << "\t" << tmp_y.u( v )( x, cell ) << "\t" << tmp_y.q( v )( x, cell ) << "\t" << tmp_y.sigma( v )( x, cell );
 		out << std::endl;
 	}
 	out << std::endl;
@@ -843,7 +1188,8 @@ void SystemSolver::print( std::ostream& out, double t, int nOut, int var )
 	for ( int i=0; i<nOut; ++i )
 	{
 		double x = static_cast<double>( i )*delta_x + grid.lowerBoundary();
-		out << x << "\t" << y.u( var )( x ) << "\t" << y.q( var )( x ) << "\t" << y.sigma( var )( x ) << std::endl;
+		Index cell = grid.findCell( x );
+		out << x << "\t" << y.u( var )( x, cell ) << "\t" << y.q( var )( x, cell ) << "\t" << y.sigma( var )( x, cell ) << std::endl;
 	}
 	out << std::endl;
 	out << std::endl; // Two blank lines needed to make gnuplot happy
@@ -857,9 +1203,10 @@ void SystemSolver::print( std::ostream& out, double t, int nOut )
 	for ( int i=0; i<nOut; ++i )
 	{
 		double x = static_cast<double>( i )*delta_x + grid.lowerBoundary();
+		Index cell = grid.findCell( x );
 		out << x;
 		for ( Index v = 0; v < nVars; ++v )
-			out << "\t" << y.u( v )( x ) << "\t" << y.q( v )( x ) << "\t" << y.sigma( v )( x );
+			out << "\t" << y.u( v )( x, cell ) << "\t" << y.q( v )( x, cell ) << "\t" << y.sigma( v )( x, cell );
 		out << std::endl;
 	}
 	out << std::endl;
@@ -7,6 +7,7 @@
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
+#include <array>
 #include <fstream>
 #include <memory>
 #include <optional>
@@ -14,6 +15,11 @@
 #include "gridStructures.hpp"
 #include "TransportSystem.hpp"
 #include "DGSoln.hpp"
+#include "BlockTridiagonalSolver.hpp"
+#include "ThreadPool.hpp"
+#include "DegreeDispatch.hpp"
+#include "OperatorCache.hpp"
+#include "CellMatrices.hpp"
 
 #ifdef TEST
 namespace system_solver_test_suite {
@@ -26,7 +32,14 @@ class SystemSolver
 {
 public:
 
+	// How the global lambda system in solveJacEq is stored & factorised
+	enum class LambdaSolverType { Dense, BlockTridiagonal };
+	// How the cell blocks are factorised in setupJacEq, as they stand or with sigma & q eliminated ( see condenseCell )
+	enum class CellSolverType { Dense, Condensed };
+
 	SystemSolver(Grid const& Grid, unsigned int polyNum, double Dt, TransportSystem *pProblem );
+	// With polynomial degree degrees[ var ] for each variable
+	SystemSolver(Grid const& Grid, std::vector< Index > const& degrees, double Dt, TransportSystem *pProblem );
 
 	// This has been moved elsewhere, SystemSolver should be constructed after the parsing is done.
 	// SystemSolver(std::string const& inputFile);
@@ -41,19 +54,63 @@ public:
 	void initialiseMatrices();
 	
 	void clearCellwiseVecs();
+	void reserveCellwiseVecs();
 
 	void resetCoeffs();
 
-	//Creates the MX cellwise matrices used at each Jacobian iteration
+	//Creates the MX cellwise matrices used at each Jacobian iteration, linearised about state
 	//Factorization of these matrices is done here
-	//?TO DO: the values of the non-linear matrices will be added in this function?
-	void updateMForJacSolve(std::vector< Eigen::FullPivLU< Eigen::MatrixXd > >& MXsolvers, double alpha, DGSoln const & delta );
+	void updateMForJacSolve(std::vector< Eigen::FullPivLU< Eigen::MatrixXd > >& MXsolvers, double alpha, DGSoln const & state );
+
+	//Borrow Y as the point to linearise about in the next setupJacEq (IDA passes this to the Jacobian function)
+	void setJacobianState( N_Vector const& Y );
 
-	//Solves the Jy = -G equation
+	//Assembles and factorises the cell blocks and the global lambda system for the current alpha.
+	//Called when IDA decides the Jacobian is out of date, the factorisations are cached until the next call.
+	void setupJacEq();
+
+	//Solves the Jy = -G equation using the factorisations from the last setupJacEq, only back-substitution is done here
 	void solveJacEq(N_Vector& g, N_Vector& delY);
 
 	void setAlpha(double const a) {alpha = a;}
 
+	//Quadrature nodes per cell are k + 1 + margin ( + any extra the TransportSystem asks for ),
+	//the same rule is used by the residual and the Jacobian. Rebuilds the cell matrices if they already exist.
+	void setQuadratureMargin( Index margin );
+	Index getQuadratureNodes() const { return pBasis->nNodes(); }
+
+	//Basis of each cell, see BasisTable. A nodal basis uses its own k + 1 nodes as the quadrature, so ignores the margin,
+	//and can only be used if every variable has the same degree
+	void setBasisType( BasisTable::Type t );
+	BasisTable::Type getBasisType() const { return basisType; }
+
+	//Polynomial degree of each variable. The quadrature is chosen for the highest
+	std::vector< Index > const& getDegrees() const { return degrees; }
+
+	//Threads used for the loops over cells in the residual, setupJacEq and solveJacEq. Results do not depend on the count.
+	//Physics calls are only made concurrently if the TransportSystem declares itself thread safe.
+	void setThreads( Index n );
+	Index getThreads() const { return threads.size(); }
+
+	void setLambdaSolver( LambdaSolverType t );
+	LambdaSolverType getLambdaSolver() const { return lambdaSolver; }
+
+	void setCellSolver( CellSolverType t );
+	CellSolverType getCellSolver() const { return cellSolver; }
+
+	//Arrangement of the fields within the SUNDIALS vectors, see DGSoln. Must be set before any of them are filled
+	void setStateLayout( DGSoln::Layout l );
+	DGSoln::Layout getStateLayout() const { return stateLayout; }
+
+	//Time-invariant cell operators, rebuilt with the cell matrices. Includes "a_mass", the mass matrix weighted by a_i( x )
+	OperatorCache const& getOperators() const { return operators; }
+	//The time-independent cell matrices, shared between cells of the same kind
+	CellMatrices const& getCellMatrices() const { return cellMatrices; }
+
+	//Cell kernels compiled for this k ( up to MaxSpecialisedDegree ), or the dynamically-sized ones, which give the same answer to rounding
+	void setSpecialisedKernels( bool s ) { specialisedKernels = s; }
+	bool getSpecialisedKernels() const { return specialisedKernels; }
+
 	//print current output for u and q to output file
 	void print( std::ostream& out, double t, int nOut, int var );
 	
@@ -70,8 +127,6 @@ public:
 	void updateBoundaryConditions(double t);
 
 	Vector resEval(std::vector<Vector> resTerms);
-	
-	void mapDGtoSundials( std::vector< VectorWrapper >& SQU_cell, VectorWrapper& lam, realtype* const& Y) const;
 
 	static SystemSolver* ConstructFromConfig( std::string fname );
 	
@@ -80,32 +135,164 @@ public:
 
 private:
 	Grid grid;
-	unsigned int k; 		//polynomial degree per cell
+	unsigned int k; 		//highest polynomial degree of any variable
 	unsigned int nCells;	//Total cell count
 	unsigned int nVars;					//Total number of variables
+
+	// Each variable has degrees[ var ] + 1 coefficients per field per cell, starting at blockStart[ var ] within the
+	// fieldSize = sum( degrees[ var ] + 1 ) of that field. The cell matrices are blocks of these sizes
+	std::vector< Index > degrees, blockStart;
+	Index fieldSize = 0;
+	Index nCoeffs( Index var ) const { return degrees[ var ] + 1; }
+	bool uniformDegree() const { return fieldSize == nVars*( k + 1 ); }
 	
-	std::vector< Matrix > XMats;
-	std::vector< Matrix > MBlocks;
-	std::vector< Matrix > CEBlocks;
+	// A, B, C, D, E, G & H, stored once for each kind of cell and assembled into the workspaces when needed
+	CellMatrices cellMatrices;
+	// Global trace system K Lambda = F, only one of these is used depending on lambdaSolver
 	Matrix K_global;
+	Eigen::FullPivLU< Matrix > K_global_lu;
+	BlockTridiagonalSolver K_blocks;
+	LambdaSolverType lambdaSolver = LambdaSolverType::BlockTridiagonal;
+	DGSoln::Layout stateLayout = DGSoln::Layout::TracesLast;
+
+	// Factorised cell blocks and their homogeneous solutions M^-1 [ C^T E 0 ]^T, cached between setupJacEq calls.
+	// Only one of MXSolvers & condensedCells is used, depending on cellSolver
+	CellSolverType cellSolver = CellSolverType::Condensed;
+	std::vector< Eigen::FullPivLU< Matrix > > MXSolvers;
+	// A cell block with sigma & q eliminated: the factorised Schur complement in u, one factorisation per group in
+	// schurGroups, and the blocks of M needed to recover sigma & q. Blocks the problem declares to be zero are left empty
+	struct CondensedCell
+	{
+		std::vector< Eigen::FullPivLU< Matrix > > schur;
+		Matrix Sq, NLq, NLu, Ssig;
+	};
+	std::vector< CondensedCell > condensedCells;
+	bool cellsFactorised() const;
+
+	// The problem's declared coupling for each TransportSystem::Derivative, and whether any / all of the pattern is set
+	struct DerivativeCoupling
+	{
+		TransportSystem::Coupling pattern;
+		bool any, all;
+	};
+	std::array< DerivativeCoupling, 5 > couplings;
+	DerivativeCoupling const& coupling( TransportSystem::Derivative d ) const { return couplings[ static_cast<Index>( d ) ]; }
+	// The variables that the Schur complement in u couples, directly or not, each as its coefficient indices within a field.
+	// The groups are independent, so are factorised separately
+	std::vector< std::vector< Index > > schurGroups;
+	// As an index for Eigen, which would copy a std::vector
+	Eigen::Map< const Eigen::Array< Index, Eigen::Dynamic, 1 > > groupRows( size_t g ) const { return { schurGroups[ g ].data(), static_cast<Index>( schurGroups[ g ].size() ) }; }
+	void setCoupling();
+	// out += scale * A x, with A a fieldSize x fieldSize block of the Jacobian with the pattern of derivative d
+	template< typename In, typename Out >
+	void coupledProduct( TransportSystem::Derivative d, Matrix const& A, In const& x, Out&& out, double scale ) const;
+	std::vector< Matrix > SQU_0;
 	Eigen::VectorXd L_global;
-	Matrix H_global_mat;
-	Eigen::FullPivLU< Matrix > H_global;
+	// H couples each face only to its neighbours through the cells, so the trace recovery in the residual is an O(N) block-tridiagonal solve
+	BlockTridiagonalSolver H_blocks;
 	std::vector< Vector > RF_cellwise;
-	std::vector< Matrix > CG_cellwise;
-	std::vector< Matrix > A_cellwise, B_cellwise, D_cellwise, E_cellwise, C_cellwise, G_cellwise, H_cellwise; 
-	//?Point the duplicated matrices to the same place?
 
 	DGSoln y, dydt;
 
-	void NLqMat( Matrix &, DGSoln const&, Interval  );
-	void NLuMat( Matrix &, DGSoln const&, Interval );
-
-	void dSourcedu_Mat( Matrix&, DGSoln const&, Interval );
-	void dSourcedq_Mat( Matrix&, DGSoln const&, Interval );
-	void dSourcedsigma_Mat( Matrix&, DGSoln const&, Interval );
-
-	void DerivativeSubMatrix( Matrix& mat, void ( TransportSystem::*dX_dZ )( Index, Values&, const Values&, const Values&, Position, double ), DGSoln const& Y, Interval I );
+	// The a_i( x ) term of the Jacobian is just alpha times the a_mass operator, so is never re-integrated
+	OperatorCache operators;
+	Index aMass = 0;
+
+	// Basis tabulated at this solver's quadrature nodes
+	Index quadratureMargin = BasisTable::DefaultQuadratureMargin;
+	BasisTable::Type basisType = BasisTable::Type::Legendre;
+	BasisTable const* pBasis = nullptr;
+	void selectBasis();
+
+	// Scratch space for one chunk of cells. Everything the hot paths need is sized here, once,
+	// so that the residual, setupJacEq and solveJacEq do not allocate in steady-state time stepping
+	struct CellWorkspace
+	{
+		void resize( Index nVars, Index k, Index fieldSize, Index nNodes );
+
+		// residual
+		Matrix kappa_nodes, S_nodes, kappa_cellwise, S_cellwise;
+		Vector x_nodes, lamCell;
+		// setupJacEq
+		Matrix NLq, NLu, Ssig, Sq, Su, MX, CE, CG, SQU_0_work;
+		// condensed cell solves
+		Matrix schur, P, condensedRhs, condensedWork, groupRhs, groupX, groupWork;
+		// u, q & sigma, and one row of a derivative, at the nodes of a cell
+		Matrix u_nodes, q_nodes, sigma_nodes, dX_dZ_nodes;
+		// Arguments & results of the fused physics at one node, the Jacobians in the order of TransportSystem::Derivative
+		Values u_vals, q_vals, sigma_vals, fusedSigma, fusedSources;
+		std::array< Matrix, 5 > fusedJacobians;
+		// solveJacEq
+		Vector gCell, SQU_f_work, delLambdaCell, delSQU;
+	};
+	// One per thread
+	std::vector< CellWorkspace > workspaces;
+	void resizeWorkspaces();
+
+	// Worker threads for the cell loops
+	ThreadPool threads;
+	// Runs f( begin, end, workspace ) over chunks of cells, in parallel unless f calls into a problem that is not thread safe
+	template< typename F >
+	void forEachCell( bool callsPhysics, F&& f )
+	{
+		if ( callsPhysics && !problem->isThreadSafe() )
+			f( 0, nCells, workspaces[ 0 ] );
+		else
+			threads.parallelFor( 0, nCells, [ & ]( Index begin, Index end, Index t ) { f( begin, end, workspaces[ t ] ); } );
+	}
+	// With a problem that is not thread safe and more than one thread, the residual and setupJacEq call the physics for
+	// every cell first, from one thread, and then spread the linear algebra that uses it over the pool. The physics
+	// results are held in between in fluxNodes & sourceNodes ( column var + nVars*i for cell i ), and derivativeBlocks
+	// ( in the order of TransportSystem::Derivative ), which are only sized when needed
+	bool serialPhysics() const { return !problem->isThreadSafe() && threads.size() > 1; }
+	Matrix fluxNodes, sourceNodes;
+	std::vector< std::array< Matrix, 5 > > derivativeBlocks;
+
+	// Runs f( CellSize< N >(), CellSize< V >() ) with the kernel sizes for this k and nVars, see DegreeDispatch.hpp.
+	// Mixed degrees always use the dynamically-sized kernels
+	bool specialisedKernels = true;
+	template< typename F >
+	void dispatchCellKernel( F&& f )
+	{
+		if ( specialisedKernels && uniformDegree() )
+			DispatchOnCellSize( k, nVars, f );
+		else
+			f( CellSize< Eigen::Dynamic >(), CellSize< Eigen::Dynamic >() );
+	}
+
+	// Persistent global buffers and views for the residual and the Jacobian solves
+	Vector lam, CsGuL_global, F, F_faces;
+	std::vector< Matrix > K_cellwise;
+	std::vector< Vector > SQU_f, CG_SQU_f;
+	// Every field of Y at every quadrature node, in the columns given by DGSoln::coeffColumn
+	Matrix yNodes;
+	DGSoln resY, resdYdt, resValues, gSoln, delYSoln;
+
+	// Point to linearise about, set by the Jacobian function for the following setupJacEq
+	DGSoln yJac;
+	bool useJacobianState = false;
+
+	// Factorises the cell block MX of cell i by eliminating sigma & q, and solves with it
+	void condenseCell( Index i, Matrix const& MX, CondensedCell& cell, CellWorkspace& w );
+	// x = M_i^{-1} b, for b 3*fieldSize x C, with whichever factorisation cellSolver selects
+	template< int M, int C >
+	void cellSolve( Index i, Eigen::Ref< const Matrix > const& b, Eigen::Ref< Matrix > x, Eigen::Ref< Matrix > work, CellWorkspace& w );
+
+	// Linearisations about Y on cell i
+	void NLqMat( Matrix &, DGSoln const&, Index, CellWorkspace& );
+	void NLuMat( Matrix &, DGSoln const&, Index, CellWorkspace& );
+
+	void dSourcedu_Mat( Matrix&, DGSoln const&, Index, CellWorkspace& );
+	void dSourcedq_Mat( Matrix&, DGSoln const&, Index, CellWorkspace& );
+	void dSourcedsigma_Mat( Matrix&, DGSoln const&, Index, CellWorkspace& );
+
+	void DerivativeSubMatrix( Matrix& mat, TransportSystem::Derivative d, DGSoln const& Y, Index i, CellWorkspace& w );
+	template< int N >
+	void DerivativeSubMatrix( Matrix& mat, TransportSystem::Derivative d, DGSoln const& Y, Index i, CellWorkspace& w );
+	// All five of the above at once, in the order of TransportSystem::Derivative, from the problem's fused functions
+	void FusedDerivativeMatrices( std::array< Matrix*, 5 > const& mats, DGSoln const& Y, Index i, CellWorkspace& w );
+	template< int N >
+	void FusedDerivativeMatrices( std::array< Matrix*, 5 > const& mats, DGSoln const& Y, Index i, CellWorkspace& w );
 
 	int total_steps = 0;
 	double resNorm = 0.0; //Exclusively for unit testing purposes
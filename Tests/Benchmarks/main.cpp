@@ -0,0 +1,440 @@
+
+#include "Types.hpp"
+#include <toml.hpp>
+#include "SystemSolver.hpp"
+#include "PhysicsCases.hpp"
+
+#include <nvector/nvector_serial.h>    /* access to serial N_Vector            */
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+	Timing harness for the hot paths of SystemSolver.
+
+	Usage: Benchmarks [ name ... ]
+	With no arguments every benchmark is run. Times are wall-clock, averaged over repeats.
+ */
+
+using namespace toml::literals::toml_literals;
+
+int residual( realtype, N_Vector, N_Vector, N_Vector, void * );
+
+// Owns the problem, solver and sundials vectors for one benchmark configuration
+struct BenchmarkSystem
+{
+	BenchmarkSystem( std::string const& problemName, toml::value const& config, Index nCells, Index k, double alpha = 10.0, DGSoln::Layout layout = DGSoln::Layout::TracesLast )
+		: grid( 0.0, 1.0, nCells )
+	{
+		problem.reset( PhysicsCases::InstantiateProblem( problemName, config ) );
+		if ( problem == nullptr )
+			throw std::invalid_argument( "Unknown physics case " + problemName );
+		system = std::make_unique< SystemSolver >( grid, k, 0.1, problem.get() );
+		system->setStateLayout( layout );
+
+		SUNContext_Create( nullptr, &ctx );
+		DGSoln tmp( problem->getNumVars(), grid, k );
+		Y      = N_VNew_Serial( tmp.getDoF(), ctx );
+		dYdt   = N_VClone( Y );
+		res    = N_VClone( Y );
+		g      = N_VClone( Y );
+		delY   = N_VClone( Y );
+
+		VectorWrapper( N_VGetArrayPointer( Y ), N_VGetLength( Y ) ).setZero();
+		VectorWrapper( N_VGetArrayPointer( dYdt ), N_VGetLength( dYdt ) ).setZero();
+		system->setInitialConditions( Y, dYdt );
+		system->setAlpha( alpha );
+		VectorWrapper( N_VGetArrayPointer( g ), N_VGetLength( g ) ) = Vector::Random( N_VGetLength( g ) );
+	}
+
+	~BenchmarkSystem()
+	{
+		N_VDestroy( Y );
+		N_VDestroy( dYdt );
+		N_VDestroy( res );
+		N_VDestroy( g );
+		N_VDestroy( delY );
+		SUNContext_Free( &ctx );
+	}
+
+	Grid grid;
+	std::unique_ptr< TransportSystem > problem;
+	std::unique_ptr< SystemSolver > system;
+	SUNContext ctx;
+	N_Vector Y, dYdt, res, g, delY;
+};
+
+// Average wall-clock time of f() in milliseconds
+static double TimeIt( std::function<void()> const& f, int repeats )
+{
+	f(); // warm up
+	auto start = std::chrono::steady_clock::now();
+	for ( int i = 0; i < repeats; ++i )
+		f();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>( end - start ).count() / repeats;
+}
+
+// Hardware cache misses of the calling thread while f() runs repeats times, averaged; -1 where the counter is not available
+static double CacheMisses( std::function<void()> const& f, int repeats )
+{
+#ifdef __linux__
+	perf_event_attr attr{};
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof( attr );
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	int fd = syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+	if ( fd < 0 )
+		return -1.0;
+	f(); // warm up
+	ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+	ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+	for ( int i = 0; i < repeats; ++i )
+		f();
+	ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 );
+	long long count = 0;
+	bool ok = read( fd, &count, sizeof( count ) ) == sizeof( count );
+	close( fd );
+	return ok ? static_cast<double>( count ) / repeats : -1.0;
+#else
+	return -1.0;
+#endif
+}
+
+const toml::value matrixDiffusionConfig = u8R"(
+	[DiffusionProblem]
+	nVars = 4
+	InitialHeights = [ 1.0, 0.8, 0.6, 0.4 ]
+)"_toml;
+
+// Dense FullPivLU vs block-tridiagonal factorisation of the global lambda system in setupJacEq / solveJacEq
+void LambdaSolverBenchmark()
+{
+	std::cout << "# setupJacEq + solveJacEq: dense vs block-tridiagonal lambda system (MatrixDiffusion, nVars = 4, k = 1)" << std::endl;
+	std::cout << "# nCells\tdense [ms]\tblock [ms]\tmax |difference|" << std::endl;
+	for ( Index nCells : { 50, 100, 200, 400, 800 } )
+	{
+		BenchmarkSystem b( "MatrixDiffusion", matrixDiffusionConfig, nCells, 1 );
+		VectorWrapper delYVec( N_VGetArrayPointer( b.delY ), N_VGetLength( b.delY ) );
+
+		b.system->setLambdaSolver( SystemSolver::LambdaSolverType::BlockTridiagonal );
+		double tBlock = TimeIt( [ & ](){ b.system->setupJacEq(); b.system->solveJacEq( b.g, b.delY ); }, 5 );
+		Vector blockSolution = delYVec;
+
+		std::cout << nCells << "\t";
+		// Dense path needs O(N^2) memory and O(N^3) time, only run it on the smaller grids
+		if ( nCells <= 400 )
+		{
+			b.system->setLambdaSolver( SystemSolver::LambdaSolverType::Dense );
+			double tDense = TimeIt( [ & ](){ b.system->setupJacEq(); b.system->solveJacEq( b.g, b.delY ); }, 1 );
+			std::cout << std::setw( 10 ) << tDense << "\t" << std::setw( 10 ) << tBlock << "\t" << ( blockSolution - delYVec ).cwiseAbs().maxCoeff() << std::endl;
+		}
+		else
+		{
+			std::cout << std::setw( 10 ) << "-" << "\t" << std::setw( 10 ) << tBlock << "\t-" << std::endl;
+		}
+	}
+	std::cout << std::endl;
+}
+
+const toml::value matrixDiffusion16Config = u8R"(
+	[DiffusionProblem]
+	nVars = 16
+	InitialHeights = [ 1.0, 0.95, 0.9, 0.85, 0.8, 0.75, 0.7, 0.65, 0.6, 0.55, 0.5, 0.45, 0.4, 0.35, 0.3, 0.25 ]
+)"_toml;
+
+// Dense FullPivLU of the whole cell block vs the Schur complement in u, in setupJacEq / solveJacEq
+void CellSolverBenchmark()
+{
+	std::cout << "# setupJacEq + solveJacEq: dense vs condensed cell blocks (MatrixDiffusion, 100 cells)" << std::endl;
+	std::cout << "# nVars	k	dense [ms]	condensed [ms]	max |difference|" << std::endl;
+	struct Case { Index nVars; toml::value const& config; Index k; };
+	for ( Case const& c : { Case{ 4, matrixDiffusionConfig, 1 }, Case{ 4, matrixDiffusionConfig, 3 }, Case{ 16, matrixDiffusion16Config, 1 }, Case{ 16, matrixDiffusion16Config, 3 } } )
+	{
+		BenchmarkSystem b( "MatrixDiffusion", c.config, 100, c.k );
+		VectorWrapper delYVec( N_VGetArrayPointer( b.delY ), N_VGetLength( b.delY ) );
+
+		b.system->setCellSolver( SystemSolver::CellSolverType::Condensed );
+		double tCondensed = TimeIt( [ & ](){ b.system->setupJacEq(); b.system->solveJacEq( b.g, b.delY ); }, 3 );
+		Vector condensedSolution = delYVec;
+
+		b.system->setCellSolver( SystemSolver::CellSolverType::Dense );
+		double tDense = TimeIt( [ & ](){ b.system->setupJacEq(); b.system->solveJacEq( b.g, b.delY ); }, 3 );
+		std::cout << c.nVars << "	" << c.k << "	" << std::setw( 10 ) << tDense << "	" << std::setw( 10 ) << tCondensed
+		          << "	" << ( condensedSolution - delYVec ).cwiseAbs().maxCoeff() << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+const toml::value nonlinearDiffusionConfig = u8R"(
+	[DiffusionProblem]
+	n = 2
+)"_toml;
+
+// Cost of a Jacobian setup (assembly + all factorisations) against a solve with the cached factors
+void JacobianReuseBenchmark()
+{
+	std::cout << "# setupJacEq vs solveJacEq (NonlinearDiffusion, k = 2)" << std::endl;
+	std::cout << "# nCells\tsetup [ms]\tsolve [ms]\t4 Newton iterations, setup every solve [ms]\twith one setup [ms]" << std::endl;
+	for ( Index nCells : { 50, 200, 800 } )
+	{
+		BenchmarkSystem b( "NonlinearDiffusion", nonlinearDiffusionConfig, nCells, 2 );
+		double tSetup = TimeIt( [ & ](){ b.system->setupJacEq(); }, 5 );
+		double tSolve = TimeIt( [ & ](){ b.system->solveJacEq( b.g, b.delY ); }, 20 );
+		std::cout << nCells << "\t" << std::setw( 10 ) << tSetup << "\t" << std::setw( 10 ) << tSolve << "\t"
+		          << std::setw( 10 ) << 4*( tSetup + tSolve ) << "\t" << std::setw( 10 ) << tSetup + 4*tSolve << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Cost of one residual evaluation, which should scale linearly in nCells
+void ResidualBenchmark()
+{
+	struct Case { std::string name; toml::value const& config; Index k; };
+	for ( Case const& c : { Case{ "MatrixDiffusion", matrixDiffusionConfig, 1 }, Case{ "NonlinearDiffusion", nonlinearDiffusionConfig, 2 } } )
+	{
+		std::cout << "# residual (" << c.name << ", k = " << c.k << ")" << std::endl;
+		std::cout << "# nCells\tresidual [ms]\tper cell [us]" << std::endl;
+		for ( Index nCells : { 100, 400, 1600 } )
+		{
+			BenchmarkSystem b( c.name, c.config, nCells, c.k );
+			double t = TimeIt( [ & ](){ residual( 0.0, b.Y, b.dYdt, b.res, b.system.get() ); }, 20 );
+			std::cout << nCells << "\t" << std::setw( 10 ) << t << "\t" << std::setw( 10 ) << 1000.0 * t / nCells << std::endl;
+		}
+		std::cout << std::endl;
+	}
+}
+
+// Point evaluation of the solution through print(), ten output points per cell
+void PointEvaluationBenchmark()
+{
+	std::cout << "# print( ..., 10*nCells points ) (MatrixDiffusion, nVars = 4, k = 1)" << std::endl;
+	std::cout << "# nCells\tprint [ms]\tper point [us]" << std::endl;
+	for ( Index nCells : { 100, 400, 1600, 6400 } )
+	{
+		BenchmarkSystem b( "MatrixDiffusion", matrixDiffusionConfig, nCells, 1 );
+		std::ofstream devNull( "/dev/null" );
+		double t = TimeIt( [ & ](){ b.system->print( devNull, 0.0, 10*nCells, b.Y ); }, 3 );
+		std::cout << nCells << "\t" << std::setw( 10 ) << t << "\t" << std::setw( 10 ) << 100.0 * t / nCells << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Strong scaling of the threaded cell loops: fixed problem size, increasing thread count
+void StrongScalingBenchmark()
+{
+	Index nCells = 3200, k = 2;
+	Index maxThreads = std::max( 1u, std::thread::hardware_concurrency() );
+	std::cout << "# strong scaling (MatrixDiffusion, nVars = 4, k = " << k << ", nCells = " << nCells << ", " << maxThreads << " hardware threads)" << std::endl;
+	std::cout << "# threads\tresidual [ms]\tspeedup\tsetupJacEq [ms]\tspeedup\tsolveJacEq [ms]\tspeedup" << std::endl;
+
+	BenchmarkSystem b( "MatrixDiffusion", matrixDiffusionConfig, nCells, k );
+	double tRes1 = 0, tSetup1 = 0, tSolve1 = 0;
+	for ( Index n = 1; n <= std::max( maxThreads, Index( 2 ) ); n *= 2 )
+	{
+		b.system->setThreads( n );
+		double tRes   = TimeIt( [ & ](){ residual( 0.0, b.Y, b.dYdt, b.res, b.system.get() ); }, 10 );
+		double tSetup = TimeIt( [ & ](){ b.system->setupJacEq(); }, 3 );
+		double tSolve = TimeIt( [ & ](){ b.system->solveJacEq( b.g, b.delY ); }, 10 );
+		if ( n == 1 )
+		{
+			tRes1 = tRes; tSetup1 = tSetup; tSolve1 = tSolve;
+		}
+		std::cout << n << "\t" << std::setw( 10 ) << tRes << "\t" << std::setw( 6 ) << tRes1/tRes
+		          << "\t" << std::setw( 10 ) << tSetup << "\t" << std::setw( 6 ) << tSetup1/tSetup
+		          << "\t" << std::setw( 10 ) << tSolve << "\t" << std::setw( 6 ) << tSolve1/tSolve << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Construction of the solver, which assembles every cell matrix once
+void StartupBenchmark()
+{
+	std::cout << "# SystemSolver construction (MatrixDiffusion, nVars = 4, k = 2)" << std::endl;
+	std::cout << "# nCells\tstartup [ms]\tper cell [us]" << std::endl;
+	for ( Index nCells : { 1000, 10000, 100000 } )
+	{
+		Grid grid( 0.0, 1.0, nCells );
+		std::unique_ptr< TransportSystem > problem( PhysicsCases::InstantiateProblem( "MatrixDiffusion", matrixDiffusionConfig ) );
+		double t = TimeIt( [ & ](){ SystemSolver system( grid, 2, 0.1, problem.get() ); }, 3 );
+		std::cout << nCells << "\t" << std::setw( 10 ) << t << "\t" << std::setw( 10 ) << 1000.0 * t / nCells << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Kernels compiled for each k against the dynamically-sized ones
+void SpecialisedKernelBenchmark()
+{
+	Index nCells = 800;
+	std::cout << "# specialised vs dynamic cell kernels (NonlinearDiffusion, nCells = " << nCells << ")" << std::endl;
+	std::cout << "# k\tresidual [ms]\tdynamic [ms]\tsetupJacEq [ms]\tdynamic [ms]\tsolveJacEq [ms]\tdynamic [ms]" << std::endl;
+	for ( Index k = 1; k <= MaxSpecialisedDegree + 1; ++k )
+	{
+		BenchmarkSystem b( "NonlinearDiffusion", nonlinearDiffusionConfig, nCells, k );
+		std::cout << k;
+		for ( auto const& f : std::vector< std::function<void()> >{
+		          [ & ](){ residual( 0.0, b.Y, b.dYdt, b.res, b.system.get() ); },
+		          [ & ](){ b.system->setupJacEq(); },
+		          [ & ](){ b.system->solveJacEq( b.g, b.delY ); } } )
+		{
+			b.system->setSpecialisedKernels( true );
+			double tSpecialised = TimeIt( f, 10 );
+			b.system->setSpecialisedKernels( false );
+			double tDynamic = TimeIt( f, 10 );
+			std::cout << "\t" << std::setw( 10 ) << tSpecialised << "\t" << std::setw( 10 ) << tDynamic;
+		}
+		std::cout << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Residual and linear-solve throughput for each arrangement of Y, on one thread so the cache-miss counts are for the whole evaluation
+void StateLayoutBenchmark()
+{
+	Index k = 2;
+	std::cout << "# state vector layouts (MatrixDiffusion, nVars = 4, k = " << k << ", 1 thread, cache misses per call or n/a)" << std::endl;
+	std::cout << "# nCells\tlayout\t\tresidual [ms]\tmisses\t\tsolveJacEq [ms]\tmisses" << std::endl;
+	struct Case { std::string name; DGSoln::Layout layout; };
+	for ( Index nCells : { 1000, 10000 } )
+	{
+		for ( Case const& c : { Case{ "traces_last", DGSoln::Layout::TracesLast }, Case{ "cell_major", DGSoln::Layout::CellMajor }, Case{ "variable_major", DGSoln::Layout::VariableMajor } } )
+		{
+			BenchmarkSystem b( "MatrixDiffusion", matrixDiffusionConfig, nCells, k, 10.0, c.layout );
+			b.system->setThreads( 1 );
+			b.system->setupJacEq();
+			auto res   = [ & ](){ residual( 0.0, b.Y, b.dYdt, b.res, b.system.get() ); };
+			auto solve = [ & ](){ b.system->solveJacEq( b.g, b.delY ); };
+			double tRes = TimeIt( res, 20 ), tSolve = TimeIt( solve, 20 );
+			double mRes = CacheMisses( res, 20 ), mSolve = CacheMisses( solve, 20 );
+			auto misses = []( double m ) { return m < 0 ? std::string( "n/a" ) : std::to_string( static_cast<long long>( m ) ); };
+			std::cout << nCells << "\t" << std::setw( 14 ) << std::left << c.name << std::right
+			          << "\t" << std::setw( 10 ) << tRes << "\t" << std::setw( 10 ) << misses( mRes )
+			          << "\t" << std::setw( 10 ) << tSolve << "\t" << std::setw( 10 ) << misses( mSolve ) << std::endl;
+		}
+	}
+	std::cout << std::endl;
+}
+
+// Cost per quadrature node of the weight in the quadrature helpers, called inline or through std::function ( the old interface )
+void CallableOverheadBenchmark()
+{
+	Index nCells = 10000;
+	Grid grid( 0.0, 1.0, nCells );
+	std::cout << "# weighted mass matrix & projection, per quadrature node (nCells = " << nCells << ")" << std::endl;
+	std::cout << "# k	MassMatrix [ns]	std::function [ns]	projection [ns]	std::function [ns]" << std::endl;
+	auto w = []( double x ){ return 1.0 + x*x; };
+	std::function< double( double ) > wFn = w;
+	for ( Index k : { 1, 3 } )
+	{
+		BasisTable const& basis = BasisTable::Get( k );
+		double nodes = static_cast<double>( nCells*basis.nNodes() );
+		Matrix M( k + 1, k + 1 );
+		Vector mem( nCells*( k + 1 ) );
+		DGApprox a( grid, k, mem.data(), k + 1 );
+		double sink = 0.0;
+
+		auto massMatrix = [ & ]( auto const& weight ) {
+			return [ & ](){
+				for ( Index i = 0; i < nCells; ++i )
+				{
+					DGApprox::MassMatrix( grid[ i ], M, weight, basis );
+					sink += M( 0, 0 );
+				}
+			};
+		};
+		auto projection = [ & ]( auto const& weight ) {
+			return [ & ](){ a = weight; sink += mem[ 0 ]; };
+		};
+		double tMass = TimeIt( massMatrix( w ), 20 ), tMassFn = TimeIt( massMatrix( wFn ), 20 );
+		double tProj = TimeIt( projection( w ), 20 ), tProjFn = TimeIt( projection( wFn ), 20 );
+		std::cout << k << "\t" << std::setw( 10 ) << 1e6 * tMass / nodes << "\t" << std::setw( 10 ) << 1e6 * tMassFn / nodes
+		          << "\t" << std::setw( 10 ) << 1e6 * tProj / nodes << "\t" << std::setw( 10 ) << 1e6 * tProjFn / nodes
+		          << ( sink == 0.0 ? " " : "" ) << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+// Every basis function and derivative at a batch of points: one function at a time, against the batched recurrence
+void LegendreEvaluationBenchmark()
+{
+	Index nPoints = 10000;
+	Interval I( 0.3, 0.7 );
+	Vector x = Vector::LinSpaced( nPoints, I.x_l, I.x_u );
+	std::cout << "# phi_0..phi_k & derivatives at " << nPoints << " points, per point" << std::endl;
+	std::cout << "# k\tEvaluate [ns]\tEvaluateAll [ns]\tPrime [ns]\tPrimeAll [ns]" << std::endl;
+	for ( Index k : { 2, 5, 10 } )
+	{
+		Matrix values( nPoints, k + 1 ), derivatives( nPoints, k + 1 );
+		double tEval = TimeIt( [ & ](){
+			for ( Index p = 0; p < nPoints; ++p )
+				for ( Index j = 0; j <= k; ++j )
+					values( p, j ) = LegendreBasis::Evaluate( I, j, x[ p ] );
+		}, 10 );
+		double tEvalAll = TimeIt( [ & ](){ LegendreBasis::EvaluateAll( I, k, x, values ); }, 10 );
+		double tPrime = TimeIt( [ & ](){
+			for ( Index p = 0; p < nPoints; ++p )
+				for ( Index j = 0; j <= k; ++j )
+					derivatives( p, j ) = LegendreBasis::Prime( I, j, x[ p ] );
+		}, 10 );
+		double tPrimeAll = TimeIt( [ & ](){ LegendreBasis::PrimeAll( I, k, x, derivatives ); }, 10 );
+		std::cout << k << "\t" << std::setw( 10 ) << 1e6 * tEval / nPoints << "\t" << std::setw( 10 ) << 1e6 * tEvalAll / nPoints
+		          << "\t" << std::setw( 10 ) << 1e6 * tPrime / nPoints << "\t" << std::setw( 10 ) << 1e6 * tPrimeAll / nPoints << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+int main( int argc, char** argv )
+{
+	std::map< std::string, std::function<void()> > benchmarks = {
+		{ "lambda_solver", LambdaSolverBenchmark },
+		{ "cell_solver", CellSolverBenchmark },
+		{ "jacobian_reuse", JacobianReuseBenchmark },
+		{ "residual", ResidualBenchmark },
+		{ "point_evaluation", PointEvaluationBenchmark },
+		{ "strong_scaling", StrongScalingBenchmark },
+		{ "specialised_kernels", SpecialisedKernelBenchmark },
+		{ "startup", StartupBenchmark },
+		{ "state_layout", StateLayoutBenchmark },
+		{ "callable_overhead", CallableOverheadBenchmark },
+		{ "legendre_evaluation", LegendreEvaluationBenchmark },
+	};
+
+	if ( argc == 1 )
+	{
+		for ( auto const& b : benchmarks )
+			b.second();
+		return 0;
+	}
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		auto it = benchmarks.find( argv[ i ] );
+		if ( it == benchmarks.end() )
+		{
+			std::cerr << "Unknown benchmark " << argv[ i ] << ". Available benchmarks are:" << std::endl;
+			for ( auto const& b : benchmarks )
+				std::cerr << '\t' << b.first << std::endl;
+			return 1;
+		}
+		it->second();
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+
+namespace {
+	std::atomic< std::size_t > nAllocations{ 0 };
+	std::atomic< int > nCounters{ 0 };
+}
+
+#ifdef __GLIBC__
+extern "C" {
+	void* __libc_malloc( std::size_t );
+	void* __libc_calloc( std::size_t, std::size_t );
+	void* __libc_realloc( void*, std::size_t );
+
+	// Replace the allocator entry points for the whole test binary, forwarding to glibc
+	void* malloc( std::size_t n )
+	{
+		if ( nCounters.load( std::memory_order_relaxed ) > 0 )
+			nAllocations.fetch_add( 1, std::memory_order_relaxed );
+		return __libc_malloc( n );
+	}
+
+	void* calloc( std::size_t n, std::size_t size )
+	{
+		if ( nCounters.load( std::memory_order_relaxed ) > 0 )
+			nAllocations.fetch_add( 1, std::memory_order_relaxed );
+		return __libc_calloc( n, size );
+	}
+
+	void* realloc( void* p, std::size_t n )
+	{
+		if ( nCounters.load( std::memory_order_relaxed ) > 0 )
+			nAllocations.fetch_add( 1, std::memory_order_relaxed );
+		return __libc_realloc( p, n );
+	}
+}
+
+bool AllocationCounter::Available() { return true; }
+#else
+bool AllocationCounter::Available() { return false; }
+#endif
+
+AllocationCounter::AllocationCounter()
+	: start( nAllocations.load() )
+{
+	++nCounters;
+}
+
+AllocationCounter::~AllocationCounter()
+{
+	--nCounters;
+}
+
+std::size_t AllocationCounter::count() const
+{
+	return nAllocations.load() - start;
+}
@@ -0,0 +1,33 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <cstddef>
+
+/*
+	Debug counter of heap allocations, for checking that the hot paths of the solver
+	do not allocate once they are warmed up.
+
+	Counts every call to malloc / calloc / realloc made by any thread while a counter
+	is alive, so it sees both Eigen (which calls malloc directly) and operator new.
+	Only available with glibc, where the real allocator can be reached as __libc_malloc;
+	elsewhere Available() is false and the count stays at zero.
+ */
+class AllocationCounter
+{
+public:
+	AllocationCounter();
+	~AllocationCounter();
+
+	AllocationCounter( AllocationCounter const& ) = delete;
+	AllocationCounter& operator=( AllocationCounter const& ) = delete;
+
+	// Allocations since this counter was constructed
+	std::size_t count() const;
+
+	static bool Available();
+
+private:
+	std::size_t start;
+};
+
+#endif // ALLOCATIONCOUNTER_HPP
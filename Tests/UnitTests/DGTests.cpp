@@ -3,6 +3,7 @@
 
 #include "../../gridStructures.hpp"
 #include "../../DGSoln.hpp"
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -39,6 +40,29 @@ BOOST_AUTO_TEST_CASE( grid_test )
 	bool inequality = ( *pGrid != *pGrid2 );
 	BOOST_TEST( inequality );
 
+	// Cell lookup, faces belong to the cell below
+	BOOST_TEST( pGrid->findCell( 0.0 ) == 0 );
+	BOOST_TEST( pGrid->findCell( 0.1 ) == 0 );
+	BOOST_TEST( pGrid->findCell( 0.2 ) == 0 );
+	BOOST_TEST( pGrid->findCell( 0.2000001 ) == 1 );
+	BOOST_TEST( pGrid->findCell( 0.6 ) == 2 );
+	BOOST_TEST( pGrid->findCell( 0.99 ) == 4 );
+	BOOST_TEST( pGrid->findCell( 1.0 ) == 4 );
+	BOOST_CHECK_THROW( pGrid->findCell( -0.01 ), std::out_of_range );
+	BOOST_CHECK_THROW( pGrid->findCell( 1.01 ), std::out_of_range );
+
+	// Non-uniform grid, compare against a linear search
+	Grid refinedGrid( 0.0, 1.0, 20, true );
+	for ( double x = 0.0; x <= 1.0; x += 0.001 ) {
+		Grid::Index i = refinedGrid.findCell( x );
+		Grid::Index j = 0;
+		while ( !refinedGrid[ j ].contains( x ) )
+			++j;
+		BOOST_TEST( i == j );
+	}
+	for ( Grid::Index i = 0; i < refinedGrid.getNCells(); ++i )
+		BOOST_TEST( refinedGrid.findCell( refinedGrid[ i ].x_u ) == i );
+
 }
 
 BOOST_AUTO_TEST_CASE( legendre_basis_test )
@@ -56,11 +80,14 @@ BOOST_AUTO_TEST_CASE( legendre_basis_test )
 			double sgn = ( i%2 == 0 ? 1.0 : -1.0 );
 			double uVal = ::sqrt( ( 2* i + 1 )/( I.h() ) );
 			double lVal = sgn * uVal;
+			// P_i'( +-1 ) = ( +-1 )^( i + 1 ) i ( i + 1 ) / 2
+			double uPrime = uVal * ( 2.0/I.h() ) * i*( i + 1.0 )/2.0;
+			double lPrime = -sgn * uPrime;
 
 			BOOST_TEST( LegendreBasis::Evaluate( I, i, I.x_l ) == lVal );
 			BOOST_TEST( phi_fn( I.x_l ) == lVal );
-			BOOST_TEST( LegendreBasis::Prime( I, i, I.x_l ) == sgn * i*( i + 1.0 )/2.0 );
-			BOOST_TEST( phiPrime_fn( I.x_l ) == sgn * i*( i + 1.0 )/2.0 );
+			BOOST_TEST( LegendreBasis::Prime( I, i, I.x_l ) == lPrime );
+			BOOST_TEST( phiPrime_fn( I.x_l ) == lPrime );
 
 			for ( auto x : test_pt ) {
 				double x_pt = x * I.h() + I.x_l;
@@ -74,11 +101,210 @@ BOOST_AUTO_TEST_CASE( legendre_basis_test )
 
 			BOOST_TEST( LegendreBasis::Evaluate( I, i, I.x_u ) == uVal );
 			BOOST_TEST( phi_fn( I.x_u ) == uVal );
-			BOOST_TEST( LegendreBasis::Prime( I, i, I.x_u ) == i*( i + 1.0 )/2.0 );
-			BOOST_TEST( phiPrime_fn( I.x_u ) == i*( i + 1.0 )/2.0 );
+			BOOST_TEST( LegendreBasis::Prime( I, i, I.x_u ) == uPrime );
+			BOOST_TEST( phiPrime_fn( I.x_u ) == uPrime );
+		}
+	}
+
+}
+
+BOOST_AUTO_TEST_CASE( legendre_batch_test )
+{
+	Interval I1( 0.0, 1.0 ),I2( 0.5, 0.55 ),I3( -0.2,-0.13 );
+	for ( auto const& I : { I1, I2, I3 } ) {
+		for ( Index k : { 0, 1, 2, 5, 12 } ) {
+			Vector x( 6 );
+			x << I.x_l, I.x_l + 0.1*I.h(), I.x_l + 0.37*I.h(), I.x_l + 0.5*I.h(), I.x_l + 0.93*I.h(), I.x_u;
+			Matrix values( x.size(), k + 1 ), derivatives( x.size(), k + 1 );
+			LegendreBasis::EvaluateAll( I, k, x, values );
+			LegendreBasis::PrimeAll( I, k, x, derivatives );
+			for ( Index p = 0; p < x.size(); ++p )
+				for ( Index j = 0; j <= k; ++j ) {
+					BOOST_TEST( values( p, j ) == LegendreBasis::Evaluate( I, j, x[ p ] ) );
+					BOOST_TEST( derivatives( p, j ) == LegendreBasis::Prime( I, j, x[ p ] ) );
+				}
+
+			// Against the closed form, which divides by y^2 - 1, away from the ends
+			for ( Index p = 1; p < x.size() - 1; ++p ) {
+				double y = 2.0*( x[ p ] - I.x_l )/I.h() - 1.0;
+				for ( Index j = 1; j <= k; ++j )
+					BOOST_TEST( derivatives( p, j ) == ::sqrt( ( 2.0*j + 1.0 )/I.h() ) * ( 2.0*j/I.h() ) * ( y*std::legendre( j, y ) - std::legendre( j - 1, y ) )/( y*y - 1.0 ) );
+			}
+
+			Vector c = Vector::LinSpaced( k + 1, -1.0, 3.0 );
+			for ( Index p = 0; p < x.size(); ++p )
+				BOOST_TEST( LegendreBasis::Evaluate( I, c, x[ p ] ) == values.row( p ).dot( c ) );
 		}
 	}
 
+	// The ends are exact on the reference element
+	Index k = 9;
+	Vector y( 2 );
+	y << -1.0, 1.0;
+	Matrix Phi( 2, k + 1 ), DPhi( 2, k + 1 );
+	LegendreBasis::ReferenceAll( k, y, Phi, DPhi );
+	for ( Index j = 0; j <= k; ++j ) {
+		double sgn = ( j % 2 == 0 ? 1.0 : -1.0 ), norm = ::sqrt( 2.0*j + 1.0 );
+		BOOST_TEST( Phi( 0, j ) == sgn * norm, boost::test_tools::tolerance( 0.0 ) );
+		BOOST_TEST( Phi( 1, j ) == norm, boost::test_tools::tolerance( 0.0 ) );
+		BOOST_TEST( DPhi( 0, j ) == -sgn * ( j*( j + 1.0 )/2.0 ) * norm, boost::test_tools::tolerance( 0.0 ) );
+		BOOST_TEST( DPhi( 1, j ) == ( j*( j + 1.0 )/2.0 ) * norm, boost::test_tools::tolerance( 0.0 ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( basis_table_test )
+{
+	Interval I1( 0.0, 1.0 ),I2( 0.5, 0.55 ),I3( -0.2,-0.13 );
+	std::vector<Interval> test_intervals{ I1, I2, I3 };
+
+	for ( Index k : { 0, 1, 3, 8 } ) {
+		BasisTable const& basis = BasisTable::Get( k );
+		BOOST_TEST( basis.order() == k );
+		BOOST_TEST( &basis == &BasisTable::Get( k ) );
+		BOOST_TEST( basis.nNodes() == k + 1 + BasisTable::DefaultQuadratureMargin );
+		BOOST_TEST( BasisTable::Get( k, k + 7 ).nNodes() == k + 7 );
+
+		for ( auto const& I : test_intervals ) {
+			double wSum = 0.0;
+			for ( Index q = 0; q < basis.nNodes(); ++q ) {
+				double x = basis.x( I, q );
+				BOOST_TEST( I.contains( x ) );
+				wSum += basis.weight( I, q );
+				for ( Index j = 0; j <= k; ++j ) {
+					BOOST_TEST( basis.phi( I, j, q ) == LegendreBasis::Evaluate( I, j, x ) );
+					BOOST_TEST( basis.phiPrime( I, j, q ) == LegendreBasis::Prime( I, j, x ) );
+				}
+			}
+			BOOST_TEST( wSum == I.h() );
+
+			Vector c = Vector::LinSpaced( k + 1, 1.0, 2.0 );
+			for ( Index j = 0; j <= k; ++j ) {
+				BOOST_TEST( basis.phiLower( I, j ) == LegendreBasis::Evaluate( I, j, I.x_l ) );
+				BOOST_TEST( basis.phiUpper( I, j ) == LegendreBasis::Evaluate( I, j, I.x_u ) );
+				// d/dx of the orthonormal basis at the ends of I
+				double scale = ::sqrt( ( 2.0*j + 1.0 )/I.h() ) * ( 2.0/I.h() ) * j*( j + 1.0 )/2.0;
+				BOOST_TEST( basis.phiPrimeUpper( I, j ) == scale );
+				BOOST_TEST( basis.phiPrimeLower( I, j ) == ( j % 2 == 0 ? -scale : scale ) );
+			}
+			BOOST_TEST( basis.EvaluateLower( I, c ) == LegendreBasis::Evaluate( I, c, I.x_l ) );
+			BOOST_TEST( basis.EvaluateUpper( I, c ) == LegendreBasis::Evaluate( I, c, I.x_u ) );
+			BOOST_TEST( basis.Evaluate( I, c, 1 ) == LegendreBasis::Evaluate( I, c, basis.x( I, 1 ) ) );
+
+			// Batched evaluation & projection, the basis is orthonormal so one undoes the other
+			Matrix C( k + 1, 2 ), values( basis.nNodes(), 2 ), projected( k + 1, 2 );
+			C.col( 0 ) = c;
+			C.col( 1 ) = c.reverse();
+			basis.EvaluateAtNodes( I, C, values );
+			for ( Index q = 0; q < basis.nNodes(); ++q )
+				BOOST_TEST( values( q, 1 ) == basis.Evaluate( I, C.col( 1 ), q ) );
+			basis.Project( I, values, projected );
+			BOOST_TEST( ( projected - C ).norm() < 1e-12 );
+
+			// Closed-form operators against quadrature, which is exact for these polynomial integrands
+			Matrix B = Matrix::Zero( k + 1, k + 1 );
+			for ( Index q = 0; q < basis.nNodes(); ++q )
+				for ( Index i = 0; i <= k; ++i )
+					for ( Index j = 0; j <= k; ++j )
+						B( i, j ) += basis.weight( I, q ) * basis.phi( I, i, q ) * basis.phiPrime( I, j, q );
+			BOOST_TEST( ( basis.derivativeMatrix()/I.h() - B ).norm() < 1e-9 * ( 1.0 + B.norm() ), boost::test_tools::tolerance( 0.0 ) );
+			for ( Index i = 0; i <= k; ++i )
+				for ( Index j = 0; j <= k; ++j ) {
+					BOOST_TEST( basis.lowerEdgeMatrix()( i, j )/I.h() == basis.phiLower( I, i ) * basis.phiLower( I, j ) );
+					BOOST_TEST( basis.upperEdgeMatrix()( i, j )/I.h() == basis.phiUpper( I, i ) * basis.phiUpper( I, j ) );
+				}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( gauss_legendre_test )
+{
+	Vector x, w;
+	for ( Index n : { 1, 2, 3, 4, 7, 12 } ) {
+		BasisTable::GaussLegendre( n, x, w );
+		BOOST_TEST( x.size() == n );
+		// Exact for polynomials of degree 2n - 1
+		for ( Index p = 0; p < 2*n; ++p ) {
+			double exact = ( p % 2 == 0 ) ? 2.0/( p + 1.0 ) : 0.0;
+			BOOST_TEST( ( w.array() * x.array().pow( p ) ).sum() == exact );
+		}
+	}
+
+	// Large rules stay symmetric, and are exact to rounding for smooth integrands
+	BasisTable::GaussLegendre( 30, x, w );
+	for ( Index i = 0; i < 15; ++i ) {
+		BOOST_TEST( x[ 15 + i ] == -x[ 14 - i ] );
+		BOOST_TEST( w[ 15 + i ] == w[ 14 - i ] );
+	}
+	BOOST_TEST( ( w.array() * x.array().cos() ).sum() == 2.0*::sin( 1.0 ), boost::test_tools::tolerance( 1e-14 ) );
+	BOOST_TEST( ( w.array() * x.array().exp() ).sum() == ::exp( 1.0 ) - ::exp( -1.0 ), boost::test_tools::tolerance( 1e-14 ) );
+
+	BOOST_CHECK_THROW( BasisTable::GaussLegendre( 0, x, w ), std::invalid_argument );
+	BOOST_CHECK_THROW( BasisTable( 3, 3 ), std::invalid_argument );
+}
+
+BOOST_AUTO_TEST_CASE( nodal_basis_test )
+{
+	Vector x, w;
+	BasisTable::GaussLobatto( 5, x, w );
+	Vector x_ref( 5 ), w_ref( 5 );
+	x_ref << -1.0, -::sqrt( 3.0/7.0 ), 0.0, ::sqrt( 3.0/7.0 ), 1.0;
+	w_ref << 1.0/10.0, 49.0/90.0, 32.0/45.0, 49.0/90.0, 1.0/10.0;
+	for ( Index q = 0; q < 5; ++q ) {
+		BOOST_TEST( x[ q ] == x_ref[ q ] );
+		BOOST_TEST( w[ q ] == w_ref[ q ] );
+	}
+	for ( Index n : { 2, 3, 6, 11 } ) {
+		BasisTable::GaussLobatto( n, x, w );
+		// Exact for polynomials of degree 2n - 3
+		for ( Index p = 0; p < 2*n - 2; ++p ) {
+			double exact = ( p % 2 == 0 ) ? 2.0/( p + 1.0 ) : 0.0;
+			BOOST_TEST( ( w.array() * x.array().pow( p ) ).sum() == exact );
+		}
+	}
+	BOOST_CHECK_THROW( BasisTable::GaussLobatto( 1, x, w ), std::invalid_argument );
+	BOOST_CHECK_THROW( BasisTable( 3, 5, BasisTable::Type::GaussLobatto ), std::invalid_argument );
+	BOOST_CHECK_THROW( BasisTable( 0, 1, BasisTable::Type::GaussLobatto ), std::invalid_argument );
+
+	Grid testGrid( -0.3, 1.2, 4 );
+	for ( auto type : { BasisTable::Type::GaussLobatto, BasisTable::Type::Gauss } ) {
+		for ( Index k : { 1, 2, 4, 7 } ) {
+			BasisTable const& basis = BasisTable::Get( k, k + 1, type );
+			BOOST_TEST( basis.isNodal() );
+			BOOST_TEST( ( basis.type() == type ) );
+			BOOST_TEST( basis.nNodes() == k + 1 );
+			if ( type == BasisTable::Type::GaussLobatto ) {
+				BOOST_TEST( basis.x( testGrid[ 1 ], 0 ) == testGrid[ 1 ].x_l );
+				BOOST_TEST( basis.x( testGrid[ 1 ], k ) == testGrid[ 1 ].x_u );
+			}
+
+			// Collocated, so each basis function is non-zero at only one node, and orthonormal under the table's quadrature
+			Matrix Phi = basis.values();
+			BOOST_TEST( ( Phi - Matrix( Phi.diagonal().asDiagonal() ) ).norm() == 0.0 );
+			BOOST_TEST( ( basis.weightedValues() * Phi.transpose() - 2.0 * Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+			// Integration by parts holds exactly for the derivative matrix
+			Matrix D = basis.derivativeMatrix();
+			BOOST_TEST( ( D + D.transpose() - basis.upperEdgeMatrix() + basis.lowerEdgeMatrix() ).norm() < 1e-10, boost::test_tools::tolerance( 0.0 ) );
+
+			// Polynomials of degree k are reproduced exactly, anywhere in the cell
+			DGApprox a( testGrid, k );
+			Vector mem( ( k + 1 )*testGrid.getNCells() );
+			a.Map( mem.data(), k + 1 );
+			a.setBasis( basis );
+			BOOST_TEST( &a.basis() == &basis );
+			auto f = [ k ]( double x ){ return std::pow( x - 0.1, k ) - 2.0*x; };
+			a = f;
+			for ( double y : { -0.3, -0.25, 0.0, 0.33, 0.7, 1.2 } )
+				BOOST_TEST( a( y ) == f( y ) );
+			Interval const& I = testGrid[ 2 ];
+			BOOST_TEST( basis.EvaluateLower( I, a.coeffs().col( 2 ) ) == f( I.x_l ) );
+			BOOST_TEST( basis.EvaluateUpper( I, a.coeffs().col( 2 ) ) == f( I.x_u ) );
+			// The coefficients are just scaled nodal values
+			for ( Index q = 0; q <= k; ++q )
+				BOOST_TEST( a.coeffs()( q, 2 ) * basis.phi( I, q, q ) == f( basis.x( I, q ) ) );
+		}
+	}
+	DGApprox b( testGrid, 3 );
+	BOOST_CHECK_THROW( b.setBasis( BasisTable::Get( 2, 3, BasisTable::Type::Gauss ) ), std::invalid_argument );
 }
 
 BOOST_AUTO_TEST_CASE( dg_approx_construction )
@@ -87,15 +313,16 @@ BOOST_AUTO_TEST_CASE( dg_approx_construction )
 	double a = 2.0;
 		DGApprox linear( testGrid, 1 );
 
-	auto const& cref = linear.getCoeffs();
-	BOOST_TEST( cref.size() == 0 );
-	BOOST_TEST( cref.capacity() == testGrid.getNCells() );
 	BOOST_TEST( linear.getDoF() == 8 );
 
 	// Map memory
 	double* mem = new double[ linear.getDoF() ];
 	VectorWrapper v( mem, linear.getDoF() );
 	linear.Map( mem, 2 );
+	BOOST_TEST( linear.coeffs().rows() == 2 );
+	BOOST_TEST( linear.coeffs().cols() == testGrid.getNCells() );
+	BOOST_TEST( linear.coeffs().data() == mem );
+	BOOST_CHECK_THROW( linear.Map( mem, 1 ), std::invalid_argument );
 
 	// Pick something that is exact
 	linear = [=]( double x ){ return a*x; };
@@ -116,12 +343,19 @@ BOOST_AUTO_TEST_CASE( dg_approx_construction )
 
 	// Check copy
 	BOOST_CHECK_NO_THROW( constructedLinear.copy( linear ) );
-	BOOST_TEST( constructedLinear.getCoeffs().size() == testGrid.getNCells() );
+	BOOST_TEST( constructedLinear.coeffs().cols() == testGrid.getNCells() );
+	BOOST_TEST( &constructedLinear.getCoeff( 3 ).first == &testGrid[ 3 ] );
+	BOOST_TEST( constructedLinear.getCoeff( 3 ).second.data() == extraMem + 6 );
 	BOOST_TEST( constructedLinear.getDoF() == testGrid.getNCells() * 2 );
 	BOOST_TEST( constructedLinear( 0.1 ) == a*0.1 );
 	BOOST_TEST( constructedLinear( 0.7 ) == a*0.7 );
 	BOOST_TEST( constructedLinear( 0.1, testGrid[ 0 ] ) == a * 0.1 );
 	BOOST_TEST( constructedLinear( 0.7, testGrid[ 2 ] ) == a * 0.7 );
+	BOOST_TEST( constructedLinear( 0.7, Index( 2 ) ) == a * 0.7 );
+	// On a face, either neighbouring cell can be asked for
+	BOOST_TEST( constructedLinear( 0.5, testGrid[ 1 ] ) == a * 0.5 );
+	BOOST_TEST( constructedLinear( 0.5, testGrid[ 2 ] ) == a * 0.5 );
+	BOOST_CHECK_THROW( constructedLinear( 1.5 ), std::logic_error );
 
 
 	// Another window on mem
@@ -175,6 +409,15 @@ BOOST_AUTO_TEST_CASE( dg_approx_construction )
 	BOOST_TEST( v( 10 ) == ( a/4.0 ) * ( 0.75*0.75 - 0.5*0.5 ) / ::sqrt( 0.25 ) );
 	BOOST_TEST( v( 14 ) == ( a/4.0 ) * ( 1*1 - 0.75*0.75 ) / ::sqrt( 0.25 ) );
 
+	// Whole-field operations only touch every other block of the interleaved data
+	linear += constructedData;
+	BOOST_TEST( linear( 0.7 ) == 1.5*a*0.7 );
+	BOOST_TEST( constructedData( 0.7 ) == ( a/2.0 )*0.7 );
+	BOOST_TEST( linear.maxCoeff() == v( 12 ) );
+	linear.zeroCoeffs();
+	BOOST_TEST( linear( 0.7 ) == 0.0 );
+	BOOST_TEST( constructedData( 0.7 ) == ( a/2.0 )*0.7 );
+
 	delete[] mem;
 
 }
@@ -185,7 +428,6 @@ BOOST_AUTO_TEST_CASE( dg_approx_static )
 	auto foo = []( double x ){ return x; };
 	auto bar = []( double x ){ return ::sin( x ); };
 
-	BOOST_TEST( DGApprox::CellProduct( testGrid[ 0 ], foo, bar ) == ::sin( 0.25 ) - 0.25*::cos( 0.25 ) );
 	BOOST_TEST( DGApprox::EdgeProduct( testGrid[ 0 ], foo, bar ) == 0.25*::sin( 0.25 ) );
 
 	Eigen::MatrixXd tmp( 5, 5 );
@@ -315,6 +557,234 @@ BOOST_AUTO_TEST_CASE( dg_soln_construction )
 }
 
 
+BOOST_AUTO_TEST_CASE( dg_soln_transforms )
+{
+	Grid testGrid( 0.0, 1.0, 4 );
+	Index k = 3, nVars = 2;
+	BasisTable const& basis = BasisTable::Get( k );
+
+	DGSoln soln( nVars, testGrid, k );
+	std::vector< double > mem( soln.getDoF() );
+	soln.Map( mem.data() );
+
+	soln.AssignU( []( Index var, double x ){ return ( var + 1.0 )*x*x; } );
+	soln.AssignQ( []( Index var, double x ){ return ::cos( x + var ); } );
+	soln.AssignSigma( []( Index var, const Values& uV, const Values& qV, Position, Time ) {
+		return uV[ var ] - qV[ 1 - var ];
+	} );
+
+	Index nCells = testGrid.getNCells();
+	Matrix values( basis.nNodes(), 3*nVars*nCells );
+	soln.EvaluateAtNodes( basis, values );
+
+	// Agrees with evaluating each field on each cell separately
+	Vector cellValues( basis.nNodes() );
+	for ( Index i = 0; i < nCells; ++i )
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			basis.EvaluateAtNodes( testGrid[ i ], soln.u( var ).getCoeff( i ).second, cellValues );
+			BOOST_TEST( ( values.col( soln.coeffColumn( i, DGSoln::U, var ) ) - cellValues ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+			basis.EvaluateAtNodes( testGrid[ i ], soln.q( var ).getCoeff( i ).second, cellValues );
+			BOOST_TEST( ( values.col( soln.coeffColumn( i, DGSoln::Q, var ) ) - cellValues ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+			basis.EvaluateAtNodes( testGrid[ i ], soln.sigma( var ).getCoeff( i ).second, cellValues );
+			BOOST_TEST( ( values.col( soln.coeffColumn( i, DGSoln::Sigma, var ) ) - cellValues ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+		}
+
+	// The quadrature is exact for the products of two basis functions, so projecting back recovers the coefficients
+	Matrix coeffs = soln.cellCoeffs();
+	soln.cellCoeffs().setZero();
+	soln.ProjectFromNodes( basis, values );
+	BOOST_TEST( ( soln.cellCoeffs() - coeffs ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+
+	// On a subset of cells, with values relative to the first cell, and for a single field
+	soln.cellCoeffs().setZero();
+	soln.ProjectFromNodes( basis, values.middleCols( 3*nVars, 3*nVars*2 ), DGSoln::Q, 1, 3 );
+	for ( Index i = 0; i < nCells; ++i )
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			BOOST_TEST( soln.u( var ).getCoeff( i ).second.norm() == 0.0 );
+			BOOST_TEST( soln.sigma( var ).getCoeff( i ).second.norm() == 0.0 );
+			if ( i == 1 || i == 2 )
+				BOOST_TEST( ( soln.cellCoeffs().col( soln.coeffColumn( i, DGSoln::Q, var ) ) - coeffs.col( soln.coeffColumn( i, DGSoln::Q, var ) ) ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+			else
+				BOOST_TEST( soln.q( var ).getCoeff( i ).second.norm() == 0.0 );
+		}
+
+	Matrix subset( basis.nNodes(), 3*nVars*2 );
+	soln.ProjectFromNodes( basis, values );
+	soln.EvaluateAtNodes( basis, subset, 1, 3 );
+	BOOST_TEST( ( subset - values.middleCols( 3*nVars, 3*nVars*2 ) ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+}
+
+BOOST_AUTO_TEST_CASE( dg_soln_layouts )
+{
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index k = 2, nVars = 3, nCells = 5;
+	BasisTable const& basis = BasisTable::Get( k );
+
+	DGSoln reference( nVars, testGrid, k );
+	std::vector< double > refMem( reference.getDoF() );
+	reference.Map( refMem.data() );
+	reference.AssignU( []( Index var, double x ){ return ( var + 1.0 )*x*x; } );
+	reference.AssignQ( []( Index var, double x ){ return ::cos( x + var ); } );
+	reference.EvaluateLambda();
+	reference.AssignSigma( []( Index var, const Values& uV, const Values& qV, Position, Time ) { return uV[ var ]*qV[ 0 ]; } );
+
+	Matrix refValues( basis.nNodes(), 3*nVars*testGrid.getNCells() );
+	reference.EvaluateAtNodes( basis, refValues );
+
+	for ( auto layout : { DGSoln::Layout::CellMajor, DGSoln::Layout::VariableMajor } )
+	{
+		DGSoln soln( nVars, testGrid, k, layout );
+		std::vector< double > mem( soln.getDoF(), 0.0 );
+		soln.Map( mem.data() );
+
+		// Every value has exactly one place in memory
+		std::vector< int > hits( soln.getDoF(), 0 );
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			for ( Index i = 0; i < nCells; ++i )
+				for ( auto f : { DGSoln::Sigma, DGSoln::Q, DGSoln::U } )
+					for ( Index j = 0; j <= k; ++j )
+						hits[ soln.coeffOffset( i, f, var ) + j ]++;
+			for ( Index face = 0; face <= nCells; ++face )
+				hits[ soln.lambdaOffset( face, var ) ]++;
+		}
+		BOOST_TEST( std::all_of( hits.begin(), hits.end(), []( int h ){ return h == 1; } ) );
+
+		// The views follow the layout
+		soln.copy( reference );
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			BOOST_TEST( soln.u( var ).getCoeff( 3 ).second.data() == mem.data() + soln.coeffOffset( 3, DGSoln::U, var ) );
+			BOOST_TEST( &soln.lambda( var )( 4 ) == mem.data() + soln.lambdaOffset( 4, var ) );
+			BOOST_TEST( soln.u( var )( 0.3 ) == reference.u( var )( 0.3 ) );
+			BOOST_TEST( soln.sigma( var )( 0.8 ) == reference.sigma( var )( 0.8 ) );
+			BOOST_TEST( ( soln.lambda( var ) - reference.lambda( var ) ).norm() == 0.0 );
+		}
+		BOOST_CHECK_THROW( soln.cellCoeffs(), std::logic_error );
+
+		// The batched transforms do not depend on the layout
+		Matrix values( basis.nNodes(), 3*nVars*testGrid.getNCells() );
+		soln.EvaluateAtNodes( basis, values );
+		BOOST_TEST( ( values - refValues ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+		soln.zeroCoeffs();
+		soln.ProjectFromNodes( basis, values );
+		for ( Index var = 0; var < nVars; ++var )
+			BOOST_TEST( ( soln.q( var ).coeffs() - reference.q( var ).coeffs() ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+
+		// As do the cell gathers, which are in the order of the cell matrices
+		Vector cell( 3*nVars*( k + 1 ) ), refCell( 3*nVars*( k + 1 ) );
+		soln.copy( reference );
+		soln.gatherCell( 2, cell );
+		reference.gatherCell( 2, refCell );
+		BOOST_TEST( ( cell - refCell ).norm() == 0.0 );
+		BOOST_TEST( refCell.head( k + 1 ).norm() == reference.sigma( 0 ).getCoeff( 2 ).second.norm() );
+		soln.scatterCell( 1, 2.0*refCell );
+		BOOST_TEST( ( soln.q( 1 ).getCoeff( 1 ).second - 2.0*reference.q( 1 ).getCoeff( 2 ).second ).norm() == 0.0 );
+
+		// Changing the layout re-reads the same memory
+		soln.setLayout( DGSoln::Layout::TracesLast );
+		BOOST_TEST( ( soln.getLayout() == DGSoln::Layout::TracesLast ) );
+		BOOST_TEST( soln.sigma( 0 ).getCoeff( 0 ).second.data() == mem.data() );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( dg_soln_mixed_degrees )
+{
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index nVars = 3, nCells = 5;
+	std::vector< Index > degrees{ 1, 3, 2 };
+	// Lower degrees use the leading rows of the table for the highest
+	BasisTable const& basis = BasisTable::Get( 3 );
+
+	BOOST_CHECK_THROW( DGSoln( nVars, testGrid, std::vector< Index >{ 1, 2 } ), std::invalid_argument );
+
+	std::vector< double > refMem;
+	Matrix refValues;
+	for ( auto layout : { DGSoln::Layout::TracesLast, DGSoln::Layout::CellMajor, DGSoln::Layout::VariableMajor } )
+	{
+		DGSoln soln( nVars, testGrid, degrees, layout );
+		BOOST_TEST( soln.getDoF() == 3*nCells*( 2 + 4 + 3 ) + nVars*( nCells + 1 ) );
+		BOOST_TEST( soln.maxOrder() == 3 );
+		BOOST_TEST( !soln.uniformOrder() );
+		std::vector< double > mem( soln.getDoF(), 0.0 );
+		soln.Map( mem.data() );
+
+		// Every value still has exactly one place in memory
+		std::vector< int > hits( soln.getDoF(), 0 );
+		for ( Index var = 0; var < nVars; ++var )
+		{
+			BOOST_TEST( soln.order( var ) == degrees[ var ] );
+			BOOST_TEST( soln.u( var ).getCoeff( 0 ).second.size() == degrees[ var ] + 1 );
+			for ( Index i = 0; i < nCells; ++i )
+				for ( auto f : { DGSoln::Sigma, DGSoln::Q, DGSoln::U } )
+					for ( Index j = 0; j <= degrees[ var ]; ++j )
+						hits[ soln.coeffOffset( i, f, var ) + j ]++;
+			for ( Index face = 0; face <= nCells; ++face )
+				hits[ soln.lambdaOffset( face, var ) ]++;
+		}
+		BOOST_TEST( std::all_of( hits.begin(), hits.end(), []( int h ){ return h == 1; } ) );
+
+		// Polynomials of each variable's degree are represented exactly
+		soln.AssignU( []( Index var, double x ){ return var == 1 ? x*x*x : ( var + 1.0 )*x; } );
+		soln.AssignQ( []( Index var, double x ){ return var == 1 ? 3*x*x : var + 1.0; } );
+		soln.EvaluateLambda();
+		soln.AssignSigma( []( Index var, const Values& uV, const Values& qV, Position, Time ) { return uV[ var ]*qV[ 0 ]; } );
+		BOOST_TEST( soln.u( 1 )( 0.3 ) == 0.3*0.3*0.3 );
+		BOOST_TEST( soln.u( 2 )( 0.3 ) == 0.9 );
+		BOOST_TEST( soln.lambda( 1 )( 2 ) == 0.4*0.4*0.4 );
+		// q_0 = 1, so sigma = u
+		BOOST_TEST( soln.sigma( 2 )( 0.55 ) == 3.0*0.55 );
+
+		// The nodal values of each variable are those of its own polynomials
+		Matrix values( basis.nNodes(), 3*nVars*nCells );
+		soln.EvaluateAtNodes( basis, values );
+		for ( Index var = 0; var < nVars; ++var )
+			for ( Index q = 0; q < basis.nNodes(); ++q )
+				BOOST_TEST( values( q, soln.coeffColumn( 3, DGSoln::U, var ) ) == soln.u( var )( basis.x( testGrid[ 3 ], q ), 3 ) );
+		soln.zeroCoeffs();
+		soln.ProjectFromNodes( basis, values );
+		BOOST_TEST( soln.q( 1 )( 0.7 ) == 3*0.7*0.7 );
+
+		// Gathers are [ sigma, q, u ], each with the coefficients of every variable in turn
+		Vector cell( 3*( 2 + 4 + 3 ) );
+		soln.gatherCell( 2, cell );
+		BOOST_TEST( ( cell.segment( 9 + 2, 4 ) - soln.q( 1 ).getCoeff( 2 ).second ).norm() == 0.0 );
+		BOOST_TEST( ( cell.segment( 18 + 6, 3 ) - soln.u( 2 ).getCoeff( 2 ).second ).norm() == 0.0 );
+		soln.scatterCell( 0, cell );
+		BOOST_TEST( ( soln.sigma( 0 ).getCoeff( 0 ).second - soln.sigma( 0 ).getCoeff( 2 ).second ).norm() == 0.0 );
+
+		BOOST_CHECK_THROW( soln.cellCoeffs(), std::logic_error );
+		BOOST_CHECK_THROW( soln.setBasis( BasisTable::Get( 3, 4, BasisTable::Type::Gauss ) ), std::invalid_argument );
+		BOOST_CHECK_THROW( soln.EvaluateAtNodes( BasisTable::Get( 2 ), values ), std::invalid_argument );
+
+		// The same values in every layout
+		if ( layout == DGSoln::Layout::TracesLast )
+		{
+			refMem = mem;
+			refValues = values;
+		}
+		else
+		{
+			DGSoln reference( nVars, testGrid, degrees, refMem.data() );
+			for ( Index var = 0; var < nVars; ++var )
+			{
+				BOOST_TEST( ( soln.u( var ).coeffs() - reference.u( var ).coeffs() ).norm() == 0.0 );
+				BOOST_TEST( ( soln.lambda( var ) - reference.lambda( var ) ).norm() == 0.0 );
+			}
+			BOOST_TEST( ( values - refValues ).norm() < 1e-12, boost::test_tools::tolerance( 0.0 ) );
+			DGSoln copy( nVars, testGrid, degrees, layout );
+			std::vector< double > copyMem( copy.getDoF() );
+			copy.Map( copyMem.data() );
+			copy.copy( reference );
+			BOOST_TEST( ( copyMem == mem ) );
+		}
+	}
+	std::vector< double > uniformMem( DGSoln( nVars, testGrid, 3 ).getDoF() );
+	BOOST_CHECK_THROW( DGSoln( nVars, testGrid, degrees, refMem.data() ).copy( DGSoln( nVars, testGrid, 3, uniformMem.data() ) ), std::invalid_argument );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
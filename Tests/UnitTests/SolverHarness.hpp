@@ -0,0 +1,82 @@
+#ifndef SOLVERHARNESS_HPP
+#define SOLVERHARNESS_HPP
+
+#include "Types.hpp"
+#include "SystemSolver.hpp"
+
+#include <nvector/nvector_serial.h>
+#include <vector>
+
+/*
+	Header-only owner of the SUNDIALS context and N_Vectors of a SystemSolver test,
+	which are all freed when it goes out of scope.
+
+	Every vector has the length of the state. y & y_dot take the initial conditions
+	in setup(), and g is a random right-hand side for the Jacobian solves.
+ */
+class SolverHarness
+{
+public:
+	explicit SolverHarness( sunindextype n ) : nDoF( n )
+	{
+		SUNContext_Create( nullptr, &ctx );
+		y = vector();
+		y_dot = vector();
+		g = vector();
+		view( g ) = Vector::Random( nDoF );
+	}
+
+	~SolverHarness()
+	{
+		for ( N_Vector v : vectors )
+			N_VDestroy( v );
+		SUNContext_Free( &ctx );
+	}
+
+	SolverHarness( SolverHarness const& ) = delete;
+	SolverHarness& operator=( SolverHarness const& ) = delete;
+
+	// Length of the state on nCells cells, with polynomial degree degrees[ var ] for each variable
+	static sunindextype StateSize( Index nCells, std::vector< Index > const& degrees )
+	{
+		sunindextype n = 0;
+		for ( Index d : degrees )
+			n += 3*nCells*( d + 1 ) + nCells + 1;
+		return n;
+	}
+
+	// A new zeroed vector, owned by the harness
+	N_Vector vector()
+	{
+		N_Vector v = N_VNew_Serial( nDoF, ctx );
+		view( v ).setZero();
+		vectors.push_back( v );
+		return v;
+	}
+
+	static VectorWrapper view( N_Vector v ) { return VectorWrapper( N_VGetArrayPointer( v ), N_VGetLength( v ) ); }
+
+	// Puts the initial conditions of system in y & y_dot, ready for Jacobian solves with the given alpha
+	void setup( SystemSolver& system, double alpha = 10.0 )
+	{
+		system.setInitialConditions( y, y_dot );
+		system.setAlpha( alpha );
+	}
+
+	// Factorises the Jacobian of system and solves it for g
+	VectorWrapper solve( SystemSolver& system, N_Vector delY )
+	{
+		system.setupJacEq();
+		system.solveJacEq( g, delY );
+		return view( delY );
+	}
+
+	sunindextype const nDoF;
+	N_Vector y, y_dot, g;
+
+private:
+	SUNContext ctx;
+	std::vector< N_Vector > vectors;
+};
+
+#endif // SOLVERHARNESS_HPP
@@ -5,6 +5,16 @@
 #include <toml.hpp>
 #include "SystemSolver.hpp"
 #include "TestDiffusion.hpp"
+#include "PhysicsCases/MatrixDiffusion.hpp"
+#include "AutodiffTransportSystem.hpp"
+#include "AllocationCounter.hpp"
+#include "SolverHarness.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <thread>
 
 #include <nvector/nvector_serial.h>    /* access to serial N_Vector            */
 #include <sundials/sundials_linearsolver.h> /* Generic Liner Solver Interface */
@@ -12,6 +22,8 @@
 
 using namespace toml::literals::toml_literals;
 
+int residual( realtype, N_Vector, N_Vector, N_Vector, void * );
+
 // raw string literal (`R"(...)"` is useful for this purpose)
 const toml::value config_snippet = u8R"(
     [DiffusionProblem]
@@ -40,56 +52,56 @@ BOOST_AUTO_TEST_CASE( systemsolver_init_tests )
 	BOOST_TEST( system->grid == testGrid );
 	BOOST_TEST( system->nVars == 1 );
 
-	BOOST_TEST(  ( system->A_cellwise[ 0 ] - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->A_cellwise[ 1 ] - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->A_cellwise[ 2 ] - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->A_cellwise[ 3 ] - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.A( 0 ) - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.A( 1 ) - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.A( 2 ) - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.A( 3 ) - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
 
 	Matrix ref( k + 1, k + 1 );
 	// Derivative matrix
 	ref << 0.0, 13.85640646055103,
 	       0.0, 0.0;
-	BOOST_TEST(  ( system->B_cellwise[ 0 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->B_cellwise[ 1 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->B_cellwise[ 2 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->B_cellwise[ 3 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.B( 0 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.B( 1 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.B( 2 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.B( 3 ) - ref ).norm() < 1e-9 );
 
 	ref << 4.0, 0.0,
 	       0.0, 12.0;
 
-	BOOST_TEST(  ( system->D_cellwise[ 0 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->D_cellwise[ 1 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->D_cellwise[ 2 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->D_cellwise[ 3 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.D( 0 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.D( 1 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.D( 2 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.D( 3 ) - ref ).norm() < 1e-9 );
 
 	double TwoRootThree = 2.0*::sqrt( 3.0 );
 
 	ref <<  0.0, 0.0,
 	        2.0, TwoRootThree;
-	BOOST_TEST(  ( system->C_cellwise[ 0 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.C( 0 ) - ref ).norm() < 1e-9 );
 
 	ref << -2.0, TwoRootThree,
 	        2.0, TwoRootThree;
-	BOOST_TEST(  ( system->C_cellwise[ 1 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->C_cellwise[ 2 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.C( 1 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.C( 2 ) - ref ).norm() < 1e-9 );
 
 	ref <<  -2.0, TwoRootThree,
 	         0.0, 0.0;
-	BOOST_TEST(  ( system->C_cellwise[ 3 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.C( 3 ) - ref ).norm() < 1e-9 );
 
 	double RootThree = ::sqrt( 3.0 );
 	ref <<  0.0,       -1.0,
 	        0.0, -RootThree;
-	BOOST_TEST(  ( system->E_cellwise[ 0 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.E( 0 ) - ref ).norm() < 1e-9 );
 
 	ref << -1.0,       -1.0,
 	        RootThree, -RootThree;
-	BOOST_TEST(  ( system->E_cellwise[ 1 ] - ref ).norm() < 1e-9 );
-	BOOST_TEST(  ( system->E_cellwise[ 2 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.E( 1 ) - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.E( 2 ) - ref ).norm() < 1e-9 );
 
 	ref << -1.0,       0.0,
 	        RootThree, 0.0;
-	BOOST_TEST(  ( system->E_cellwise[ 3 ] - ref ).norm() < 1e-9 );
+	BOOST_TEST(  ( system->cellMatrices.E( 3 ) - ref ).norm() < 1e-9 );
 
 	// Should check k > 1 here
 
@@ -131,13 +143,1204 @@ BOOST_AUTO_TEST_CASE( systemsolver_matrix_tests )
 	Matrix NLMat( k + 1, k + 1 );
 
 	for ( Index i = 0; i < 4; ++i ) {
-		system->NLqMat( NLMat, system->y, testGrid[ i ] );
+		system->NLqMat( NLMat, system->y, i, system->workspaces[ 0 ] );
 		BOOST_TEST(  ( NLMat - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
-		system->NLuMat( NLMat, system->y, testGrid[ i ] );
+		system->NLuMat( NLMat, system->y, i, system->workspaces[ 0 ] );
 		BOOST_TEST(  ( NLMat - Matrix::Zero( k + 1, k + 1 ) ).norm() < 1e-9 );
 	}
 
+	// k + 1 nodes are still exact for a linear flux
+	BOOST_TEST( system->getQuadratureNodes() == k + 1 + BasisTable::DefaultQuadratureMargin );
+	BOOST_CHECK_THROW( system->setQuadratureMargin( -1 ), std::invalid_argument );
+	system->setQuadratureMargin( 0 );
+	BOOST_TEST( system->getQuadratureNodes() == k + 1 );
+	for ( Index i = 0; i < 4; ++i ) {
+		system->NLqMat( NLMat, system->y, i, system->workspaces[ 0 ] );
+		BOOST_TEST(  ( NLMat - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-9 );
+	}
+
+}
+
+// Non-uniform a( x ), and an operator of its own in the solver's cache
+class WeightedDiffusion : public TestDiffusion
+{
+	public:
+		using TestDiffusion::TestDiffusion;
+		Value aFn( Index, Position x ) override { return 1.0 + x*x; };
+		void addOperators( OperatorCache& cache ) override {
+			cache.add( "x_mass", []( Index, Interval const& I, BasisTable const& basis, Matrix& out ) {
+				DGApprox::MassMatrix( I, out, []( double x ){ return x; }, basis );
+			} );
+		};
+};
+
+BOOST_AUTO_TEST_CASE( operator_cache_tests )
+{
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index k = 2;
+	WeightedDiffusion problem( config_snippet );
+	SystemSolver system( testGrid, k, 0.1, &problem );
+
+	OperatorCache const& ops = system.getOperators();
+	BOOST_TEST( ops.size() == 2 );
+	BOOST_TEST( ops.contains( "a_mass" ) );
+	BOOST_CHECK_THROW( ops.find( "b_mass" ), std::invalid_argument );
+	Index aMass = ops.find( "a_mass" ), xMass = ops.find( "x_mass" );
+
+	Matrix M( k + 1, k + 1 );
+	BasisTable const& basis = BasisTable::Get( k, system.getQuadratureNodes() );
+	for ( Index i = 0; i < 5; ++i ) {
+		DGApprox::MassMatrix( testGrid[ i ], M, []( double x ){ return 1.0 + x*x; }, basis );
+		BOOST_TEST( ( ops( aMass, i, 0 ) - M ).norm() == 0.0 );
+		DGApprox::MassMatrix( testGrid[ i ], M, []( double x ){ return x; }, basis );
+		BOOST_TEST( ( ops( xMass, i, 0 ) - M ).norm() == 0.0 );
+	}
+
+	// Rebuilt, not duplicated, with the cell matrices
+	system.setQuadratureMargin( 0 );
+	BOOST_TEST( ops.size() == 2 );
+	DGApprox::MassMatrix( testGrid[ 3 ], M, []( double x ){ return 1.0 + x*x; }, BasisTable::Get( k, k + 1 ) );
+	BOOST_TEST( ( ops( aMass, 3, 0 ) - M ).norm() == 0.0 );
+
+	BOOST_TEST( ops.dependsOnX( aMass ) );
+	BOOST_TEST( ops.bytes() == ops.perCellBytes() );
+
+	// a = 1 is kept once per kind and width of cell
+	Grid uniformGrid( 0.0, 1.0, 16 );
+	TestDiffusion constantA( config_snippet );
+	SystemSolver constantSystem( uniformGrid, k, 0.1, &constantA );
+	OperatorCache const& constantOps = constantSystem.getOperators();
+	aMass = constantOps.find( "a_mass" );
+	BOOST_TEST( !constantOps.dependsOnX( aMass ) );
+	BOOST_TEST( constantOps.bytes() < constantOps.perCellBytes() / 2 );
+	BasisTable const& constantBasis = BasisTable::Get( k, constantSystem.getQuadratureNodes() );
+	for ( Index i = 0; i < 16; ++i ) {
+		DGApprox::MassMatrix( uniformGrid[ i ], M, []( double ){ return 1.0; }, constantBasis );
+		BOOST_TEST( ( constantOps( aMass, i, 0 ) - M ).norm() < 1e-14 );
+	}
+
+	OperatorCache cache;
+	cache.add( "a", []( Index, Interval const&, BasisTable const&, Matrix& out ){ out.setIdentity(); } );
+	BOOST_CHECK_THROW( cache.add( "a", []( Index, Interval const&, BasisTable const&, Matrix& ){} ), std::invalid_argument );
+
+	// Shared operators are built once for each pair of kind and width
+	Index width = cache.add( "width", []( Index, Interval const& I, BasisTable const&, Matrix& out ){ out.setConstant( I.h() ); }, false );
+	Grid threeWidths( 0.0, 1.0, 16, true );
+	cache.build( threeWidths, 1, basis, []( Index i ){ return i == 0 ? 0 : 1; } );
+	BOOST_TEST( cache.bytes() == ( 16 + 4 )*( k + 1 )*( k + 1 )*sizeof( double ) + 16*sizeof( Index ) );
+	for ( Index i = 0; i < 16; ++i )
+		BOOST_TEST( std::abs( cache( width, i, 0 )( 0, 0 ) - threeWidths[ i ].h() ) < 1e-14 );
+}
+
+// Dirichlet or Neumann at each end
+class MixedBoundaries : public TestDiffusion
+{
+	public:
+		MixedBoundaries( toml::value const& config, bool lower, bool upper ) : TestDiffusion( config ), lowerDirichlet( lower ), upperDirichlet( upper ) {};
+
+		bool isLowerBoundaryDirichlet( Index ) const override { return lowerDirichlet; };
+		bool isUpperBoundaryDirichlet( Index ) const override { return upperDirichlet; };
+
+	private:
+		bool lowerDirichlet, upperDirichlet;
+};
+
+BOOST_AUTO_TEST_CASE( cell_matrix_tests )
+{
+	Index k = 2, nCells = 16;
+
+	// An interior set, and one for each boundary cell with a Dirichlet face, whether or not the widths vary. Only the
+	// faces with Dirichlet conditions are cut off, each according to the condition at its own end
+	for ( auto [ lowerDirichlet, upperDirichlet ] : { std::pair{ true, true }, std::pair{ true, false }, std::pair{ false, true } } )
+	for ( bool highGridBoundary : { false, true } )
+	{
+		MixedBoundaries problem( config_snippet, lowerDirichlet, upperDirichlet );
+		Grid testGrid( 0.0, 1.0, nCells, highGridBoundary );
+		SystemSolver system( testGrid, k, 0.1, &problem );
+		CellMatrices const& cells = system.getCellMatrices();
+		BOOST_TEST( cells.nCells() == nCells );
+		BOOST_TEST( cells.nSets() == 1 + lowerDirichlet + upperDirichlet );
+		BOOST_TEST( cells.bytes() < cells.perCellBytes() );
+
+		BasisTable const& basis = BasisTable::Get( k, system.getQuadratureNodes() );
+		Matrix ref( k + 1, k + 1 ), C( 2, k + 1 ), E( k + 1, 2 ), G( 2, k + 1 ), H( 2, 2 );
+		for ( Index i = 0; i < nCells; ++i )
+		{
+			Interval const& I = testGrid[ i ];
+			bool lower = ( i == 0 ) && lowerDirichlet, upper = ( i == nCells - 1 ) && upperDirichlet;
+			BOOST_TEST( ( cells.A( i ) - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-12 );
+			ref = basis.derivativeMatrix()/I.h();
+			BOOST_TEST( ( cells.B( i ) - ref ).norm() < 1e-12*ref.norm() );
+			ref = 0.5*( basis.lowerEdgeMatrix() + basis.upperEdgeMatrix() )/I.h();
+			BOOST_TEST( ( cells.D( i ) - ref ).norm() < 1e-12*ref.norm() );
+
+			for ( Index j = 0; j < k + 1; ++j )
+			{
+				C( 0, j ) = lower ? 0.0 : -basis.phiLower( I, j );
+				C( 1, j ) = upper ? 0.0 :  basis.phiUpper( I, j );
+				E( j, 0 ) = lower ? 0.0 : -0.5*basis.phiLower( I, j );
+				E( j, 1 ) = upper ? 0.0 : -0.5*basis.phiUpper( I, j );
+				G( 0, j ) = lower ? 0.0 : 0.5*basis.phiLower( I, j );
+				G( 1, j ) = upper ? 0.0 : 0.5*basis.phiUpper( I, j );
+			}
+			H << ( lower ? 0.0 : -0.5 ), 0.0, 0.0, ( upper ? 0.0 : -0.5 );
+			BOOST_TEST( ( cells.C( i ) - C ).norm() < 1e-12*C.norm() );
+			BOOST_TEST( ( cells.E( i ) - E ).norm() < 1e-12*E.norm() );
+			BOOST_TEST( ( cells.G( i ) - G ).norm() < 1e-12*G.norm() );
+			BOOST_TEST( ( cells.H( i ) - H ).norm() == 0.0 );
+
+			// The assembled blocks
+			Index S = k + 1;
+			Matrix M( 3*S, 3*S ), CE( 3*S, 2 ), CG( 2, 3*S );
+			cells.assembleM( i, M );
+			cells.assembleCE( i, CE );
+			cells.assembleCG( i, CG );
+			BOOST_TEST( ( M.block( 0, 2*S, S, S ) + cells.B( i ).transpose() ).norm() == 0.0 );
+			BOOST_TEST( ( M.block( S, 2*S, S, S ) - cells.D( i ) ).norm() == 0.0 );
+			BOOST_TEST( ( M.block( 2*S, 0, S, S ) - cells.A( i ) ).norm() == 0.0 );
+			BOOST_TEST( ( CE.topRows( S ) - C.transpose() ).norm() < 1e-12*C.norm() );
+			BOOST_TEST( CE.bottomRows( S ).norm() == 0.0 );
+			BOOST_TEST( ( CG.rightCols( S ) - G ).norm() < 1e-12*G.norm() );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( block_tridiagonal_tests )
+{
+	Index nBlocks = 7, m = 3;
+	BlockTridiagonalSolver K( nBlocks, m );
+
+	// Diagonally dominant, like the lambda system
+	for ( Index i = 0; i < nBlocks; ++i ) {
+		K.diagonal( i ) = Matrix::Random( m, m ) + 4.0 * Matrix::Identity( m, m );
+		if ( i < nBlocks - 1 ) {
+			K.lower( i ) = Matrix::Random( m, m );
+			K.upper( i ) = Matrix::Random( m, m );
+		}
+	}
+
+	Matrix dense = K.toDense();
+	BOOST_TEST( dense.rows() == nBlocks * m );
+	BOOST_TEST( ( dense.block( m, 0, m, m ) - K.lower( 0 ) ).norm() == 0.0 );
+	BOOST_TEST( ( dense.block( 0, m, m, m ) - K.upper( 0 ) ).norm() == 0.0 );
+
+	Vector b = Vector::Random( nBlocks * m );
+	Vector x = b;
+	BOOST_CHECK_THROW( K.solve( x ), std::logic_error );
+
+	K.factorise();
+	K.solve( x );
+	BOOST_TEST( ( dense * x - b ).norm() < 1e-10 );
+	BOOST_TEST( ( x - Eigen::FullPivLU< Matrix >( dense ).solve( b ) ).norm() < 1e-10 );
+}
+
+BOOST_AUTO_TEST_CASE( lambda_solver_tests )
+{
+	Grid testGrid( 0.0, 1.0, 8 );
+	Index k = 2;
+	double dt = 0.1;
+
+	TestDiffusion problem( config_snippet );
+	SystemSolver system( testGrid, k, dt, &problem );
+	SolverHarness h( SolverHarness::StateSize( 8, { k } ) );
+	N_Vector delY_dense = h.vector(), delY_blocks = h.vector();
+	h.setup( system );
+
+	system.setLambdaSolver( SystemSolver::LambdaSolverType::Dense );
+	BOOST_CHECK_THROW( system.solveJacEq( h.g, delY_dense ), std::logic_error );
+	VectorWrapper denseVec = h.solve( system, delY_dense );
+	system.setLambdaSolver( SystemSolver::LambdaSolverType::BlockTridiagonal );
+	VectorWrapper blockVec = h.solve( system, delY_blocks );
+	BOOST_TEST( denseVec.norm() > 0.0 );
+	BOOST_TEST( ( denseVec - blockVec ).norm() < 1e-9 * denseVec.norm() );
+
+	// Repeated solves reuse the cached factorisation
+	N_Vector delY_again = h.vector();
+	system.solveJacEq( h.g, delY_again );
+	VectorWrapper againVec = h.view( delY_again );
+	BOOST_TEST( ( againVec - blockVec ).norm() == 0.0 );
+
+	// Linearising about a different state changes the nonlinear blocks, but not for this linear problem
+	N_Vector yOther = h.vector();
+	h.view( yOther ) = 2.0 * h.view( h.y );
+	system.setJacobianState( yOther );
+	h.solve( system, delY_again );
+	BOOST_TEST( ( againVec - blockVec ).norm() < 1e-12 * blockVec.norm() );
+}
+
+// Two variables coupled through nonlinear fluxes and sources, so that every block of the cell Jacobian is non-zero
+class CoupledDiffusion : public TestDiffusion
+{
+	public:
+		explicit CoupledDiffusion( toml::value const& config ) : TestDiffusion( config ) { nVars = 2; };
+
+		bool isUpperBoundaryDirichlet( Index ) const override { return false; };
+
+		Value SigmaFn( Index i, const Values& u, const Values& q, Position, Time ) override {
+			return ( 1.0 + u[ i ]*u[ i ] )*q[ i ] + 0.1*q[ 1 - i ];
+		};
+		Value Sources( Index i, const Values& u, const Values& q, const Values& sigma, Position, Time ) override {
+			return u[ 0 ]*u[ 1 ] + 0.2*q[ i ] + 0.3*sigma[ 1 - i ];
+		};
+
+		void dSigmaFn_dq( Index i, Values& v, const Values& u, const Values&, Position, Time ) override {
+			v[ i ] = 1.0 + u[ i ]*u[ i ];
+			v[ 1 - i ] = 0.1;
+		};
+		void dSigmaFn_du( Index i, Values& v, const Values& u, const Values& q, Position, Time ) override {
+			v[ i ] = 2.0*u[ i ]*q[ i ];
+			v[ 1 - i ] = 0.0;
+		};
+		void dSources_du( Index, Values& v, const Values& u, const Values&, Position, Time ) override {
+			v[ 0 ] = u[ 1 ];
+			v[ 1 ] = u[ 0 ];
+		};
+		void dSources_dq( Index i, Values& v, const Values&, const Values&, Position, Time ) override {
+			v[ i ] = 0.2;
+			v[ 1 - i ] = 0.0;
+		};
+		void dSources_dsigma( Index i, Values& v, const Values&, const Values&, Position, Time ) override {
+			v[ i ] = 0.0;
+			v[ 1 - i ] = 0.3;
+		};
+};
+
+BOOST_AUTO_TEST_CASE( lambda_recovery_tests )
+{
+	// The residual recovers the traces from sigma & u with the block-tridiagonal H_blocks. Compare them with the dense
+	// solve it replaced, for a random state and a non-zero flux through the Neumann upper boundary
+	class NeumannFlux : public CoupledDiffusion
+	{
+		public:
+			using CoupledDiffusion::CoupledDiffusion;
+			Value UpperBoundary( Index i, Time ) const override { return 0.5 + i; };
+	};
+	Grid testGrid( 0.0, 1.0, 6 );
+	Index nCells = 6, nVars = 2, nFaces = nCells + 1;
+	std::vector< Index > degrees{ 2, 3 };
+	NeumannFlux problem( config_snippet );
+	SystemSolver system( testGrid, degrees, 0.1, &problem );
+	SolverHarness h( SolverHarness::StateSize( nCells, degrees ) );
+	N_Vector res = h.vector();
+	h.setup( system );
+	h.view( h.y ) = Vector::Random( h.nDoF );
+	DGSoln state( nVars, testGrid, degrees, N_VGetArrayPointer( h.y ) ), Res( nVars, testGrid, degrees, N_VGetArrayPointer( res ) );
+	residual( 0.0, h.y, h.y_dot, res, &system );
+
+	// H & -C sigma - G u + L over all the faces, variable-major
+	CellMatrices const& cellMatrices = system.getCellMatrices();
+	Matrix H = Matrix::Zero( nVars*nFaces, nVars*nFaces );
+	Vector CsGuL = Vector::Zero( nVars*nFaces );
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		CsGuL( var*nFaces + nCells ) = problem.UpperBoundary( var, 0.0 );
+		for ( Index i = 0; i < nCells; i++ )
+		{
+			CellMatrices::Blocks const& cell = cellMatrices( i, var );
+			H.block( var*nFaces + i, var*nFaces + i, 2, 2 ) += cell.H;
+			CsGuL.segment( var*nFaces + i, 2 ) -= cellMatrices.invRootH( i ) * ( cell.C * state.sigma( var ).getCoeff( i ).second + cell.G * state.u( var ).getCoeff( i ).second );
+		}
+	}
+	Vector lamRef = Eigen::FullPivLU< Matrix >( H ).solve( CsGuL );
+	BOOST_TEST( lamRef.norm() > 0.0 );
+
+	// res.lambda = lam - lambda, except on the Dirichlet lower faces
+	for ( Index var = 0; var < nVars; var++ )
+	{
+		Vector lam = ( Res.lambda( var ) + state.lambda( var ) ).tail( nCells );
+		BOOST_TEST( ( lam - lamRef.segment( var*nFaces + 1, nCells ) ).norm() < 1e-10 * lamRef.norm() );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( residual_assembly_tests )
+{
+	// The residual evaluates the fluxes & sources at all the nodes of a cell at once and projects them with one product.
+	// Compare it, on a random state, with evaluating every field point by point and projecting one test function at a time
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index k = 2, nCells = 5, nVars = 2;
+	CoupledDiffusion problem( config_snippet );
+	SystemSolver system( testGrid, k, 0.1, &problem );
+	SolverHarness h( SolverHarness::StateSize( nCells, { k, k } ) );
+	N_Vector res = h.vector();
+	h.setup( system );
+	h.view( h.y ) = Vector::Random( h.nDoF );
+	// With y' = 0, and boundary values of 0, no other terms are left
+	h.view( h.y_dot ).setZero();
+	residual( 0.0, h.y, h.y_dot, res, &system );
+	DGSoln state( nVars, testGrid, k, N_VGetArrayPointer( h.y ) ), Res( nVars, testGrid, k, N_VGetArrayPointer( res ) );
+
+	BasisTable const& basis = BasisTable::Get( k, system.getQuadratureNodes(), system.getBasisType() );
+	CellMatrices const& cellMatrices = system.getCellMatrices();
+	Values u( nVars ), q( nVars ), sigma( nVars );
+	for ( Index i = 0; i < nCells; i++ )
+	{
+		Interval const& I = testGrid[ i ];
+		double hInv = cellMatrices.invH( i ), rootHInv = cellMatrices.invRootH( i );
+		for ( Index var = 0; var < nVars; var++ )
+		{
+			Vector kappa = Vector::Zero( k + 1 ), S = Vector::Zero( k + 1 );
+			for ( Index n = 0; n < basis.nNodes(); n++ )
+			{
+				for ( Index v = 0; v < nVars; v++ )
+				{
+					u[ v ] = basis.Evaluate( I, state.u( v ).getCoeff( i ).second, n );
+					q[ v ] = basis.Evaluate( I, state.q( v ).getCoeff( i ).second, n );
+					sigma[ v ] = basis.Evaluate( I, state.sigma( v ).getCoeff( i ).second, n );
+				}
+				double x = basis.x( I, n ), wgt = basis.weight( I, n );
+				double kappaVal = problem.SigmaFn( var, u, q, x, 0.0 ), sourceVal = problem.Sources( var, u, q, sigma, x, 0.0 );
+				for ( Index j = 0; j < k + 1; j++ )
+				{
+					kappa( j ) += wgt * kappaVal * basis.phi( I, j, n );
+					S( j ) += wgt * sourceVal * basis.phi( I, j, n );
+				}
+			}
+
+			CellMatrices::Blocks const& cell = cellMatrices( i, var );
+			Vector lamCell( 2 );
+			lamCell << state.lambda( var )[ i ], state.lambda( var )[ i + 1 ];
+			Vector sigmaCell = state.sigma( var ).getCoeff( i ).second, qCell = state.q( var ).getCoeff( i ).second, uCell = state.u( var ).getCoeff( i ).second;
+			Vector resSigma = -qCell - hInv * cell.B.transpose() * uCell + rootHInv * cell.C.transpose() * lamCell;
+			Vector resQ = S + hInv * ( cell.B * sigmaCell + cell.D * uCell ) + rootHInv * cell.E * lamCell;
+			Vector resU = sigmaCell + kappa;
+			BOOST_TEST( ( Res.sigma( var ).getCoeff( i ).second - resSigma ).norm() < 1e-12 * resSigma.norm() );
+			BOOST_TEST( ( Res.q( var ).getCoeff( i ).second - resQ ).norm() < 1e-12 * resQ.norm() );
+			BOOST_TEST( ( Res.u( var ).getCoeff( i ).second - resU ).norm() < 1e-12 * resU.norm() );
+		}
+	}
+}
+
+// The Jacobian system is the derivative of the residual with respect to y + alpha y', so a small step along its
+// solution changes the residual by eps g. This holds for every row, the trace rows on the boundary faces included
+void CheckJacobian( TransportSystem* problem )
+{
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index k = 2, nCells = 5;
+	double alpha = 10.0, eps = 1e-7;
+	SystemSolver system( testGrid, k, 0.1, problem );
+	SolverHarness h( SolverHarness::StateSize( nCells, std::vector< Index >( problem->getNumVars(), k ) ) );
+	N_Vector yStep = h.vector(), y_dotStep = h.vector(), res = h.vector(), resStep = h.vector(), delY = h.vector();
+
+	h.setup( system, alpha );
+	system.setJacobianState( h.y );
+	VectorWrapper delYVec = h.solve( system, delY ), gVec = h.view( h.g );
+
+	h.view( yStep ) = h.view( h.y ) + eps*delYVec;
+	h.view( y_dotStep ) = h.view( h.y_dot ) + alpha*eps*delYVec;
+	residual( 0.0, h.y, h.y_dot, res, &system );
+	residual( 0.0, yStep, y_dotStep, resStep, &system );
+	BOOST_TEST( ( ( h.view( resStep ) - h.view( res ) )/eps - gVec ).norm() < 1e-6 * gVec.norm() );
+}
+
+BOOST_AUTO_TEST_CASE( jacobian_tests )
+{
+	// Sources that depend on u, q & sigma, with a Dirichlet lower and a Neumann upper boundary
+	CoupledDiffusion problem( config_snippet );
+	CheckJacobian( &problem );
+}
+
+BOOST_AUTO_TEST_CASE( cell_solver_tests )
+{
+	Grid testGrid( 0.0, 1.0, 6 );
+	Index nCells = 6;
+
+	TestDiffusion diffusion( config_snippet );
+	CoupledDiffusion coupled( config_snippet );
+	struct Case { TransportSystem* problem; std::vector< Index > degrees; };
+	for ( Case const& c : { Case{ &diffusion, { 3 } }, Case{ &coupled, { 2, 2 } }, Case{ &coupled, { 3, 1 } } } )
+	{
+		SystemSolver system( testGrid, c.degrees, 0.1, c.problem );
+		BOOST_TEST( ( system.getCellSolver() == SystemSolver::CellSolverType::Condensed ) );
+		SolverHarness h( SolverHarness::StateSize( nCells, c.degrees ) );
+		N_Vector delY_condensed = h.vector(), delY_dense = h.vector();
+		h.setup( system );
+
+		// Condensing the cells is exact, so both give the same solution of the whole Jacobian system, for either lambda solver
+		for ( auto lambdaSolver : { SystemSolver::LambdaSolverType::BlockTridiagonal, SystemSolver::LambdaSolverType::Dense } )
+		{
+			system.setLambdaSolver( lambdaSolver );
+			system.setCellSolver( SystemSolver::CellSolverType::Condensed );
+			VectorWrapper condensedVec = h.solve( system, delY_condensed );
+
+			system.setCellSolver( SystemSolver::CellSolverType::Dense );
+			BOOST_CHECK_THROW( system.solveJacEq( h.g, delY_dense ), std::logic_error );
+			VectorWrapper denseVec = h.solve( system, delY_dense );
+			BOOST_TEST( denseVec.norm() > 0.0 );
+			BOOST_TEST( ( denseVec - condensedVec ).norm() < 1e-10 * denseVec.norm() );
+		}
+	}
+}
+
+class SparseCoupledDiffusion : public TestDiffusion
+{
+	public:
+		SparseCoupledDiffusion( toml::value const& config, bool declare ) : TestDiffusion( config )
+		{
+			nVars = 3;
+			if ( !declare )
+				return;
+			Coupling diagonal = Coupling::Constant( 3, 3, false ), pair = Coupling::Constant( 3, 3, false );
+			diagonal.matrix().diagonal().setConstant( true );
+			pair( 0, 2 ) = pair( 2, 0 ) = true;
+			declareCoupling( Derivative::dSigma_du, diagonal );
+			declareCoupling( Derivative::dSigma_dq, diagonal || pair );
+			declareCoupling( Derivative::dSources_du, diagonal || pair );
+			declareCoupling( Derivative::dSources_dq, diagonal );
+			pair( 1, 1 ) = true;
+			declareCoupling( Derivative::dSources_dsigma, pair );
+		};
+
+		bool isUpperBoundaryDirichlet( Index ) const override { return false; };
+
+		Value SigmaFn( Index i, const Values& u, const Values& q, Position, Time ) override {
+			return ( 1.0 + u[ i ]*u[ i ] )*q[ i ] + ( i == 1 ? 0.0 : 0.1*q[ 2 - i ] );
+		};
+		Value Sources( Index i, const Values& u, const Values& q, const Values& sigma, Position, Time ) override {
+			return u[ i ]*u[ 2 - i ] + 0.2*q[ i ] + 0.3*sigma[ 2 - i ];
+		};
+
+		void dSigmaFn_dq( Index i, Values& v, const Values& u, const Values&, Position, Time ) override {
+			v.setZero();
+			v[ 2 - i ] = 0.1;
+			v[ i ] = 1.0 + u[ i ]*u[ i ];
+		};
+		void dSigmaFn_du( Index i, Values& v, const Values& u, const Values& q, Position, Time ) override {
+			v.setZero();
+			v[ i ] = 2.0*u[ i ]*q[ i ];
+		};
+		void dSources_du( Index i, Values& v, const Values& u, const Values&, Position, Time ) override {
+			v.setZero();
+			v[ i ] += u[ 2 - i ];
+			v[ 2 - i ] += u[ i ];
+		};
+		void dSources_dq( Index i, Values& v, const Values&, const Values&, Position, Time ) override {
+			v.setZero();
+			v[ i ] = 0.2;
+		};
+		void dSources_dsigma( Index i, Values& v, const Values&, const Values&, Position, Time ) override {
+			v.setZero();
+			v[ 2 - i ] = 0.3;
+		};
+};
+
+// Declares a pattern of the wrong size
+class BadCoupling : public TestDiffusion
+{
+	public:
+		explicit BadCoupling( toml::value const& config ) : TestDiffusion( config ) { declareCoupling( Derivative::dSigma_dq, Coupling::Constant( 2, 2, true ) ); };
+};
+
+BOOST_AUTO_TEST_CASE( coupling_tests )
+{
+	using Derivative = TransportSystem::Derivative;
+	TestDiffusion diffusion( config_snippet );
+	BOOST_TEST( diffusion.coupling( Derivative::dSources_dsigma ).all() );
+	BOOST_CHECK_THROW( BadCoupling problem( config_snippet ), std::invalid_argument );
+
+	SparseCoupledDiffusion dense( config_snippet, false ), sparse( config_snippet, true );
+	BOOST_TEST( dense.coupling( Derivative::dSigma_du ).all() );
+	BOOST_TEST( sparse.coupling( Derivative::dSigma_du ).count() == 3 );
+	BOOST_TEST( sparse.coupling( Derivative::dSources_dsigma ).count() == 3 );
+
+	Grid testGrid( 0.0, 1.0, 6 );
+	Index nCells = 6;
+	for ( std::vector< Index > degrees : { std::vector< Index >{ 2, 2, 2 }, std::vector< Index >{ 3, 1, 2 } } )
+	{
+		SystemSolver denseSystem( testGrid, degrees, 0.1, &dense ), sparseSystem( testGrid, degrees, 0.1, &sparse );
+		SolverHarness h( SolverHarness::StateSize( nCells, degrees ) );
+		N_Vector delY_dense = h.vector(), delY_sparse = h.vector(), delY_full = h.vector();
+
+		// The declared zeros are exact, so skipping them changes nothing but the cost. The Schur complements
+		// of sparseSystem are factorised as two groups, { 0, 2 } and { 1 }, the others as one
+		for ( SystemSolver* system : { &denseSystem, &sparseSystem } )
+		{
+			h.setup( *system );
+			system->setJacobianState( h.y );
+		}
+		VectorWrapper denseVec = h.solve( denseSystem, delY_dense ), sparseVec = h.solve( sparseSystem, delY_sparse );
+		sparseSystem.setCellSolver( SystemSolver::CellSolverType::Dense );
+		sparseSystem.setJacobianState( h.y );
+		VectorWrapper fullVec = h.solve( sparseSystem, delY_full );
+		BOOST_TEST( denseVec.norm() > 0.0 );
+		BOOST_TEST( ( denseVec - sparseVec ).norm() < 1e-10 * denseVec.norm() );
+		BOOST_TEST( ( fullVec - sparseVec ).norm() < 1e-10 * denseVec.norm() );
+
+		// and the grouped factorisation does not allocate once warmed up
+		if ( AllocationCounter::Available() )
+		{
+			sparseSystem.setCellSolver( SystemSolver::CellSolverType::Condensed );
+			sparseSystem.setJacobianState( h.y );
+			h.solve( sparseSystem, delY_sparse );
+			AllocationCounter allocations;
+			sparseSystem.setJacobianState( h.y );
+			h.solve( sparseSystem, delY_sparse );
+			BOOST_TEST( allocations.count() == 0 );
+		}
+	}
+}
+
+// SparseCoupledDiffusion with the physics evaluated for all the nodes of a cell in one call
+class BatchedCoupledDiffusion : public SparseCoupledDiffusion
+{
+	public:
+		explicit BatchedCoupledDiffusion( toml::value const& config ) : SparseCoupledDiffusion( config, true ) {};
+
+		void Evaluate( PointValues u, PointValues q, PointValues sigma, Positions, Time, PointResults sigmaOut, PointResults sourcesOut ) override {
+			batchCalls++;
+			for ( Index i = 0; i < 3; i++ )
+			{
+				sigmaOut.col( i ).array() = ( 1.0 + u.col( i ).array().square() )*q.col( i ).array() + ( i == 1 ? 0.0 : 0.1 )*q.col( 2 - i ).array();
+				sourcesOut.col( i ).array() = u.col( i ).array()*u.col( 2 - i ).array() + 0.2*q.col( i ).array() + 0.3*sigma.col( 2 - i ).array();
+			}
+		};
+
+		void EvaluateDerivative( Derivative d, Index i, PointValues u, PointValues q, Positions, Time, PointResults out ) override {
+			batchCalls++;
+			out.setZero();
+			switch ( d )
+			{
+				case Derivative::dSigma_du:
+					out.col( i ).array() = 2.0*u.col( i ).array()*q.col( i ).array();
+					break;
+				case Derivative::dSigma_dq:
+					out.col( 2 - i ).setConstant( 0.1 );
+					out.col( i ).array() = 1.0 + u.col( i ).array().square();
+					break;
+				case Derivative::dSources_du:
+					out.col( i ) += u.col( 2 - i );
+					out.col( 2 - i ) += u.col( i );
+					break;
+				case Derivative::dSources_dq:
+					out.col( i ).setConstant( 0.2 );
+					break;
+				case Derivative::dSources_dsigma:
+					out.col( 2 - i ).setConstant( 0.3 );
+					break;
+			}
+		};
+
+		Index batchCalls = 0;
+};
+
+BOOST_AUTO_TEST_CASE( batched_evaluation_tests )
+{
+	using Derivative = TransportSystem::Derivative;
+	SparseCoupledDiffusion pointwise( config_snippet, true );
+	BatchedCoupledDiffusion batched( config_snippet );
+
+	// The default batched functions are just the pointwise ones
+	Index nPoints = 5, nVars = 3;
+	Matrix u = Matrix::Random( nPoints, nVars ), q = Matrix::Random( nPoints, nVars ), sigma = Matrix::Random( nPoints, nVars );
+	Vector x = Vector::LinSpaced( nPoints, 0.0, 1.0 );
+	Matrix sigmaOut( nPoints, nVars ), sourcesOut( nPoints, nVars ), dOut( nPoints, nVars );
+	Values uP( nVars ), qP( nVars ), sigmaP( nVars ), dP( nVars );
+	pointwise.Evaluate( u, q, sigma, x, 0.0, sigmaOut, sourcesOut );
+	for ( Index p = 0; p < nPoints; p++ )
+	{
+		uP = u.row( p ).transpose();
+		qP = q.row( p ).transpose();
+		sigmaP = sigma.row( p ).transpose();
+		for ( Index i = 0; i < nVars; i++ )
+		{
+			BOOST_TEST( sigmaOut( p, i ) == pointwise.SigmaFn( i, uP, qP, x[ p ], 0.0 ) );
+			BOOST_TEST( sourcesOut( p, i ) == pointwise.Sources( i, uP, qP, sigmaP, x[ p ], 0.0 ) );
+		}
+	}
+	for ( Index i = 0; i < nVars; i++ )
+	{
+		pointwise.EvaluateDerivative( Derivative::dSources_du, i, u, q, x, 0.0, dOut );
+		for ( Index p = 0; p < nPoints; p++ )
+		{
+			uP = u.row( p ).transpose();
+			qP = q.row( p ).transpose();
+			pointwise.dSources_du( i, dP, uP, qP, x[ p ], 0.0 );
+			BOOST_TEST( ( dOut.row( p ).transpose() - dP ).norm() == 0.0 );
+		}
+	}
+
+	// and a problem that overrides them gives the same residual and Jacobian
+	Grid testGrid( 0.0, 1.0, 7 );
+	Index k = 2, nCells = 7;
+	SystemSolver pointwiseSystem( testGrid, k, 0.1, &pointwise ), batchedSystem( testGrid, k, 0.1, &batched );
+	SolverHarness h( SolverHarness::StateSize( nCells, { k, k, k } ) );
+	N_Vector res = h.vector(), delY = h.vector();
+
+	std::vector< Vector > results;
+	for ( SystemSolver* system : { &pointwiseSystem, &batchedSystem } )
+	{
+		h.setup( *system );
+		residual( 0.0, h.y, h.y_dot, res, system );
+		results.push_back( h.view( res ) );
+		system->setJacobianState( h.y );
+		results.push_back( h.solve( *system, delY ) );
+	}
+	BOOST_TEST( batched.batchCalls > 0 );
+	BOOST_TEST( results[ 0 ].norm() > 0.0 );
+	BOOST_TEST( ( results[ 0 ] - results[ 2 ] ).norm() < 1e-12 * results[ 0 ].norm() );
+	BOOST_TEST( ( results[ 1 ] - results[ 3 ] ).norm() < 1e-12 * results[ 1 ].norm() );
+}
+
+// SparseCoupledDiffusion with every flux, source and derivative at a point from one call of each fused function
+class FusedCoupledDiffusion : public SparseCoupledDiffusion
+{
+	public:
+		explicit FusedCoupledDiffusion( toml::value const& config ) : SparseCoupledDiffusion( config, true ) { fusedEvaluation = true; };
+
+		void FluxAndJacobian( const Values& u, const Values& q, Position, Time, Values& sigma, Matrix& dSigma_du, Matrix& dSigma_dq ) override {
+			fluxCalls++;
+			for ( Index i = 0; i < 3; i++ )
+			{
+				sigma[ i ] = ( 1.0 + u[ i ]*u[ i ] )*q[ i ] + ( i == 1 ? 0.0 : 0.1*q[ 2 - i ] );
+				dSigma_du( i, i ) = 2.0*u[ i ]*q[ i ];
+				dSigma_dq( i, 2 - i ) = 0.1;
+				dSigma_dq( i, i ) = 1.0 + u[ i ]*u[ i ];
+			}
+		};
+		void SourcesAndJacobian( const Values& u, const Values& q, const Values& sigma, Position, Time, Values& S, Matrix& dS_du, Matrix& dS_dq, Matrix& dS_dsigma ) override {
+			sourceCalls++;
+			for ( Index i = 0; i < 3; i++ )
+			{
+				S[ i ] = u[ i ]*u[ 2 - i ] + 0.2*q[ i ] + 0.3*sigma[ 2 - i ];
+				dS_du( i, i ) += u[ 2 - i ];
+				dS_du( i, 2 - i ) += u[ i ];
+				dS_dq( i, i ) = 0.2;
+				dS_dsigma( i, 2 - i ) = 0.3;
+			}
+		};
+
+		Index fluxCalls = 0, sourceCalls = 0;
+};
+
+BOOST_AUTO_TEST_CASE( fused_evaluation_tests )
+{
+	SparseCoupledDiffusion pointwise( config_snippet, true );
+	FusedCoupledDiffusion fused( config_snippet );
+	BOOST_TEST( !pointwise.hasFusedEvaluation() );
+	BOOST_TEST( fused.hasFusedEvaluation() );
+
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index k = 3, nCells = 5, nVars = 3;
+	SystemSolver pointwiseSystem( testGrid, k, 0.1, &pointwise ), fusedSystem( testGrid, k, 0.1, &fused );
+	SolverHarness h( SolverHarness::StateSize( nCells, std::vector< Index >( nVars, k ) ) );
+	N_Vector res = h.vector(), delY = h.vector();
+
+	std::vector< Vector > results;
+	for ( SystemSolver* system : { &pointwiseSystem, &fusedSystem } )
+	{
+		h.setup( *system );
+		residual( 0.0, h.y, h.y_dot, res, system );
+		results.push_back( h.view( res ) );
+		// The residual only needs values, so it must not go through the fused Jacobian functions
+		BOOST_TEST( fused.fluxCalls == 0 );
+		BOOST_TEST( fused.sourceCalls == 0 );
+		system->setJacobianState( h.y );
+		results.push_back( h.solve( *system, delY ) );
+	}
+
+	// One call of each per node for the Jacobian
+	Index nNodes = BasisTable::QuadratureNodes( k, BasisTable::DefaultQuadratureMargin );
+	BOOST_TEST( fused.fluxCalls == nCells*nNodes );
+	BOOST_TEST( fused.sourceCalls == nCells*nNodes );
+	BOOST_TEST( results[ 0 ].norm() > 0.0 );
+	BOOST_TEST( ( results[ 0 ] - results[ 2 ] ).norm() < 1e-12 * results[ 0 ].norm() );
+	BOOST_TEST( ( results[ 1 ] - results[ 3 ] ).norm() < 1e-12 * results[ 1 ].norm() );
+}
+
+// CoupledDiffusion with only the flux & source written out, its derivatives come from automatic differentiation
+class AutodiffCoupledDiffusion : public AutodiffTransportSystem< AutodiffCoupledDiffusion >
+{
+	public:
+		explicit AutodiffCoupledDiffusion( toml::value const& config ) : reference( config ) { nVars = 2; threadSafe = true; };
+
+		template< typename T > T Flux( Index i, VectorOf< T > const& u, VectorOf< T > const& q, Position, Time ) const {
+			return ( 1.0 + u[ i ]*u[ i ] )*q[ i ] + 0.1*q[ 1 - i ];
+		}
+		template< typename T > T Source( Index i, VectorOf< T > const& u, VectorOf< T > const& q, VectorOf< T > const& sigma, Position, Time ) const {
+			return u[ 0 ]*u[ 1 ] + 0.2*q[ i ] + 0.3*sigma[ 1 - i ];
+		}
+
+		Value LowerBoundary( Index i, Time t ) const override { return reference.LowerBoundary( i, t ); };
+		Value UpperBoundary( Index i, Time t ) const override { return reference.UpperBoundary( i, t ); };
+		bool isLowerBoundaryDirichlet( Index i ) const override { return reference.isLowerBoundaryDirichlet( i ); };
+		bool isUpperBoundaryDirichlet( Index i ) const override { return reference.isUpperBoundaryDirichlet( i ); };
+		Value InitialValue( Index i, Position x ) const override { return reference.InitialValue( i, x ); };
+		Value InitialDerivative( Index i, Position x ) const override { return reference.InitialDerivative( i, x ); };
+
+	private:
+		CoupledDiffusion reference;
+};
+
+BOOST_AUTO_TEST_CASE( autodiff_tests )
+{
+	// f( x, y ) = x y/( 1 + x ) + exp( x ) y^3
+	using D = Dual< 4 >;
+	double x0 = 0.7, y0 = -1.3;
+	D a( x0, 2, 0 ), b( y0, 2, 1 );
+	D f = a*b/( 1.0 + a ) + exp( a )*pow( b, 3.0 );
+	BOOST_TEST( f.value() == x0*y0/( 1.0 + x0 ) + std::exp( x0 )*y0*y0*y0, boost::test_tools::tolerance( 1e-14 ) );
+	BOOST_TEST( f.derivative( 0 ) == y0/( ( 1.0 + x0 )*( 1.0 + x0 ) ) + std::exp( x0 )*y0*y0*y0, boost::test_tools::tolerance( 1e-14 ) );
+	BOOST_TEST( f.derivative( 1 ) == x0/( 1.0 + x0 ) + 3.0*std::exp( x0 )*y0*y0, boost::test_tools::tolerance( 1e-14 ) );
+	// Constants carry no derivatives, and fractional powers are finite at 0
+	BOOST_TEST( D( 2.0 ).derivatives().size() == 0 );
+	BOOST_TEST( ( D( 2.0 )*a ).derivative( 0 ) == 2.0 );
+	D root = pow( D( 0.0, 2, 0 ), 1.5 );
+	BOOST_TEST( root.value() == 0.0 );
+	BOOST_TEST( root.derivative( 0 ) == 0.0 );
+
+	// The generated derivatives are the hand-written ones
+	CoupledDiffusion coupled( config_snippet );
+	AutodiffCoupledDiffusion autodiff( config_snippet );
+	BOOST_TEST( autodiff.hasFusedEvaluation() );
+	Values u = Values::Random( 2 ), q = Values::Random( 2 ), sigma = Values::Random( 2 );
+	Values sigmaHand( 2 ), sigmaAD( 2 ), SHand( 2 ), SAD( 2 ), vHand( 2 ), vAD( 2 );
+	std::array< Matrix, 5 > hand, ad;
+	for ( Index d = 0; d < 5; d++ )
+	{
+		hand[ d ] = Matrix::Zero( 2, 2 );
+		ad[ d ] = Matrix::Zero( 2, 2 );
+	}
+	coupled.FluxAndJacobian( u, q, 0.3, 0.0, sigmaHand, hand[ 0 ], hand[ 1 ] );
+	coupled.SourcesAndJacobian( u, q, sigma, 0.3, 0.0, SHand, hand[ 2 ], hand[ 3 ], hand[ 4 ] );
+	autodiff.FluxAndJacobian( u, q, 0.3, 0.0, sigmaAD, ad[ 0 ], ad[ 1 ] );
+	autodiff.SourcesAndJacobian( u, q, sigma, 0.3, 0.0, SAD, ad[ 2 ], ad[ 3 ], ad[ 4 ] );
+	BOOST_TEST( ( sigmaHand - sigmaAD ).norm() < 1e-14 );
+	BOOST_TEST( ( SHand - SAD ).norm() < 1e-14 );
+	for ( Index d = 0; d < 5; d++ )
+		BOOST_TEST( ( hand[ d ] - ad[ d ] ).norm() < 1e-14 );
+	for ( Index i = 0; i < 2; i++ )
+	{
+		BOOST_TEST( autodiff.SigmaFn( i, u, q, 0.3, 0.0 ) == sigmaHand[ i ] );
+		BOOST_TEST( autodiff.Sources( i, u, q, sigma, 0.3, 0.0 ) == SHand[ i ] );
+		for ( auto fn : { &TransportSystem::dSigmaFn_du, &TransportSystem::dSigmaFn_dq, &TransportSystem::dSources_du, &TransportSystem::dSources_dq, &TransportSystem::dSources_dsigma } )
+		{
+			( coupled.*fn )( i, vHand, u, q, 0.3, 0.0 );
+			( autodiff.*fn )( i, vAD, u, q, 0.3, 0.0 );
+			BOOST_TEST( ( vHand - vAD ).norm() < 1e-14 );
+		}
+	}
+
+	// Both solve the same Jacobian system, and it is the derivative of the residual
+	Grid testGrid( 0.0, 1.0, 5 );
+	Index k = 2, nCells = 5;
+	SystemSolver coupledSystem( testGrid, k, 0.1, &coupled ), autodiffSystem( testGrid, k, 0.1, &autodiff );
+	SolverHarness h( SolverHarness::StateSize( nCells, { k, k } ) );
+	N_Vector delY = h.vector();
+
+	std::vector< Vector > solutions;
+	for ( SystemSolver* system : { &coupledSystem, &autodiffSystem } )
+	{
+		h.setup( *system );
+		system->setJacobianState( h.y );
+		solutions.push_back( h.solve( *system, delY ) );
+	}
+	BOOST_TEST( solutions[ 0 ].norm() > 0.0 );
+	BOOST_TEST( ( solutions[ 0 ] - solutions[ 1 ] ).norm() < 1e-10 * solutions[ 0 ].norm() );
+	CheckJacobian( &autodiff );
+}
+
+BOOST_AUTO_TEST_CASE( thread_pool_tests )
+{
+	ThreadPool pool( 3 );
+	BOOST_TEST( pool.size() == 3 );
+	BOOST_CHECK_THROW( pool.resize( 0 ), std::invalid_argument );
+
+	// Every index is visited exactly once, including ranges shorter than the pool,
+	// and chunk t covers the t'th contiguous piece of the range
+	for ( Index n : { 0, 1, 2, 3, 10, 101 } )
+	{
+		std::vector< int > visits( n, 0 );
+		std::vector< Index > chunk( n, -1 );
+		pool.parallelFor( 0, n, [ & ]( Index begin, Index end, Index t ) {
+			for ( Index i = begin; i < end; ++i )
+			{
+				visits[ i ]++;
+				chunk[ i ] = t;
+			}
+		} );
+		BOOST_TEST( std::count( visits.begin(), visits.end(), 1 ) == n );
+		BOOST_TEST( std::is_sorted( chunk.begin(), chunk.end() ) );
+		BOOST_TEST( ( n == 0 || ( chunk.front() == 0 && chunk.back() < pool.size() ) ) );
+	}
+
+	BOOST_CHECK_THROW( pool.parallelFor( 0, 10, []( Index begin, Index, Index ) {
+		if ( begin > 0 ) throw std::runtime_error( "chunk failed" );
+	} ), std::runtime_error );
+
+	// and the pool is still usable afterwards
+	pool.resize( 2 );
+	std::vector< Index > sums( 10, 0 );
+	pool.parallelFor( 0, 10, [ & ]( Index begin, Index end, Index ) {
+		for ( Index i = begin; i < end; ++i )
+			sums[ i ] = i;
+	} );
+	BOOST_TEST( std::accumulate( sums.begin(), sums.end(), Index( 0 ) ) == 45 );
 }
 
+// CoupledDiffusion without the promise of thread safety, recording the threads that call its flux
+class SerialCoupledDiffusion : public CoupledDiffusion
+{
+	public:
+		explicit SerialCoupledDiffusion( toml::value const& config ) : CoupledDiffusion( config ) { threadSafe = false; };
+
+		Value SigmaFn( Index i, const Values& u, const Values& q, Position x, Time t ) override {
+			record();
+			return CoupledDiffusion::SigmaFn( i, u, q, x, t );
+		};
+		void dSigmaFn_dq( Index i, Values& v, const Values& u, const Values& q, Position x, Time t ) override {
+			record();
+			CoupledDiffusion::dSigmaFn_dq( i, v, u, q, x, t );
+		};
+
+		std::set< std::thread::id > callers;
+
+	private:
+		void record()
+		{
+			std::lock_guard< std::mutex > lock( m );
+			callers.insert( std::this_thread::get_id() );
+		};
+		std::mutex m;
+};
+
+BOOST_AUTO_TEST_CASE( threaded_solver_tests )
+{
+	Grid testGrid( 0.0, 1.0, 13 );
+	Index k = 2;
+	double dt = 0.1;
+
+	TestDiffusion diffusion( config_snippet );
+	SerialCoupledDiffusion coupled( config_snippet );
+	BOOST_TEST( !coupled.isThreadSafe() );
+	for ( TransportSystem* problem : std::initializer_list< TransportSystem* >{ &diffusion, &coupled } )
+	{
+		SystemSolver system( testGrid, k, dt, problem );
+		SolverHarness h( SolverHarness::StateSize( 13, std::vector< Index >( problem->getNumVars(), k ) ) );
+		N_Vector res = h.vector(), delY = h.vector();
+		VectorWrapper resVec = h.view( res );
+		h.setup( system );
+
+		BOOST_TEST( system.getThreads() == 1 );
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		Vector serialRes = resVec, serialDelY = h.solve( system, delY );
+
+		// Each cell is computed on exactly one thread, so the answers must be bitwise identical. A problem that
+		// is not thread safe is still only ever called from this one
+		for ( Index n : { 2, 4 } )
+		{
+			system.setThreads( n );
+			BOOST_TEST( system.getThreads() == n );
+			coupled.callers.clear();
+			residual( 0.0, h.y, h.y_dot, res, &system );
+			VectorWrapper delYVec = h.solve( system, delY );
+			BOOST_TEST( ( resVec - serialRes ).norm() == 0.0 );
+			BOOST_TEST( ( delYVec - serialDelY ).norm() == 0.0 );
+			if ( problem == &coupled )
+				BOOST_TEST( ( coupled.callers == std::set< std::thread::id >{ std::this_thread::get_id() } ) );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( degree_dispatch_tests )
+{
+	for ( Index k = 0; k <= MaxSpecialisedDegree + 1; ++k )
+	{
+		for ( Index nVars : { 1, 3 } )
+		{
+			int N = 0, V = 0;
+			DispatchOnCellSize( k, nVars, [ & ]( auto NSize, auto VSize ) { N = decltype( NSize )::value; V = decltype( VSize )::value; } );
+			BOOST_TEST( N == ( k <= MaxSpecialisedDegree ? k + 1 : Eigen::Dynamic ) );
+			BOOST_TEST( V == ( nVars == 1 ? 1 : Eigen::Dynamic ) );
+		}
+	}
+	BOOST_TEST( BlockSize( 3, 4 ) == 12 );
+	BOOST_TEST( BlockSize( 3, Eigen::Dynamic ) == Eigen::Dynamic );
+
+	// The fixed-size back-substitution matches the dynamic one, including for singular blocks
+	Matrix A = Matrix::Random( 9, 9 ) + 3.0 * Matrix::Identity( 9, 9 );
+	Matrix b = Matrix::Random( 9, 2 ), x( 9, 2 ), xFixed( 9, 2 ), work( 9, 2 );
+	Eigen::FullPivLU< Matrix > lu( A );
+	LUSolve( lu, b, x, work );
+	LUSolve< 9, 2 >( lu, b, xFixed, work );
+	BOOST_TEST( ( A * xFixed - b ).norm() < 1e-12 );
+	BOOST_TEST( ( xFixed - x ).norm() < 1e-12 );
+
+	A.row( 4 ).setZero();
+	lu.compute( A );
+	LUSolve( lu, b, x, work );
+	LUSolve< 9, 2 >( lu, b, xFixed, work );
+	BOOST_TEST( ( xFixed - x ).norm() == 0.0 );
+}
+
+BOOST_AUTO_TEST_CASE( specialised_kernel_tests )
+{
+	Grid testGrid( 0.0, 1.0, 9 );
+
+	// Specialised and dynamic kernels differ only in the order of the floating-point operations
+	for ( Index k : { Index( 1 ), Index( 3 ), MaxSpecialisedDegree + 1 } )
+	{
+		TestDiffusion problem( config_snippet );
+		SystemSolver system( testGrid, k, 0.1, &problem );
+		SolverHarness h( SolverHarness::StateSize( 9, { k } ) );
+		N_Vector res = h.vector(), delY = h.vector();
+		VectorWrapper resVec = h.view( res );
+		h.setup( system );
+
+		BOOST_TEST( system.getSpecialisedKernels() );
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		Vector specialisedRes = resVec, specialisedDelY = h.solve( system, delY );
+
+		system.setSpecialisedKernels( false );
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		VectorWrapper delYVec = h.solve( system, delY );
+		BOOST_TEST( ( resVec - specialisedRes ).norm() <= 1e-12 * ( 1.0 + resVec.norm() ) );
+		BOOST_TEST( ( delYVec - specialisedDelY ).norm() <= 1e-12 * ( 1.0 + delYVec.norm() ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( state_layout_tests )
+{
+	Grid testGrid( 0.0, 1.0, 7 );
+	Index k = 2;
+	sunindextype nDoF = SolverHarness::StateSize( 7, { k } );
+	Vector gRef = Vector::Random( nDoF );
+
+	// The same state and right-hand side in each layout give the same residual & Newton update, just stored elsewhere
+	Vector refRes, refDelY;
+	for ( auto layout : { DGSoln::Layout::TracesLast, DGSoln::Layout::CellMajor, DGSoln::Layout::VariableMajor } )
+	{
+		TestDiffusion problem( config_snippet );
+		SystemSolver system( testGrid, k, 0.1, &problem );
+		system.setStateLayout( layout );
+		BOOST_TEST( ( system.getStateLayout() == layout ) );
+
+		SolverHarness h( nDoF );
+		N_Vector res = h.vector(), delY = h.vector();
+		DGSoln( 1, testGrid, k, N_VGetArrayPointer( h.g ), layout ).copy( DGSoln( 1, testGrid, k, gRef.data() ) );
+
+		h.setup( system );
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		h.solve( system, delY );
+
+		// Back in the original layout for comparison
+		Vector resVec( nDoF ), delYVec( nDoF );
+		DGSoln( 1, testGrid, k, resVec.data() ).copy( DGSoln( 1, testGrid, k, N_VGetArrayPointer( res ), layout ) );
+		DGSoln( 1, testGrid, k, delYVec.data() ).copy( DGSoln( 1, testGrid, k, N_VGetArrayPointer( delY ), layout ) );
+		if ( layout == DGSoln::Layout::TracesLast )
+		{
+			refRes = resVec;
+			refDelY = delYVec;
+			BOOST_TEST( refDelY.norm() > 0.0 );
+		}
+		else
+		{
+			BOOST_TEST( ( resVec - refRes ).norm() <= 1e-12 * ( 1.0 + refRes.norm() ) );
+			BOOST_TEST( ( delYVec - refDelY ).norm() <= 1e-12 * ( 1.0 + refDelY.norm() ) );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( basis_type_tests )
+{
+	Grid testGrid( 0.0, 1.0, 7 );
+	Index k = 3;
+	sunindextype nDoF = SolverHarness::StateSize( 7, { k } );
+	BasisTable const& legendre = BasisTable::Get( k, k + 1 );
+	BasisTable const& gauss = BasisTable::Get( k, k + 1, BasisTable::Type::Gauss );
+	// Both bases are orthonormal on the same polynomials, T takes nodal coefficients to Legendre ones
+	Matrix T = legendre.weightedValues() * gauss.values().transpose() / 2.0;
+	BOOST_TEST( ( T * T.transpose() - Matrix::Identity( k + 1, k + 1 ) ).norm() < 1e-12 );
+
+	// Applies T, or its inverse, to every cell of every field
+	auto changeBasis = [ & ]( N_Vector v, bool toLegendre ) {
+		DGSoln s( 1, testGrid, k, N_VGetArrayPointer( v ) );
+		for ( DGApprox* a : { &s.sigma( 0 ), &s.q( 0 ), &s.u( 0 ) } )
+			a->coeffs() = ( toLegendre ? T : Matrix( T.transpose() ) ) * a->coeffs();
+	};
+
+	Vector refRes, refDelY, y0Legendre, y0Legendre_dot;
+	Vector g = Vector::Random( nDoF );
+	for ( auto type : { BasisTable::Type::Legendre, BasisTable::Type::GaussLobatto, BasisTable::Type::Gauss } )
+	{
+		TestDiffusion problem( config_snippet );
+		SystemSolver system( testGrid, k, 0.1, &problem );
+		system.setBasisType( type );
+		BOOST_TEST( ( system.getBasisType() == type ) );
+		BOOST_TEST( system.getQuadratureNodes() == ( type == BasisTable::Type::Legendre ? k + 1 + BasisTable::DefaultQuadratureMargin : k + 1 ) );
+
+		SolverHarness h( nDoF );
+		N_Vector res = h.vector(), delY = h.vector();
+
+		// Initial conditions are projected in ( or interpolated onto ) the chosen basis
+		h.setup( system );
+		DGSoln y( 1, testGrid, k, N_VGetArrayPointer( h.y ) );
+		y.setBasis( type == BasisTable::Type::Legendre ? BasisTable::Get( k ) : BasisTable::Get( k, k + 1, type ) );
+		for ( double x : { 0.05, 0.3, 0.5, 0.81 } )
+			BOOST_TEST( std::abs( y.u( 0 )( x ) - problem.InitialValue( 0, x ) ) < 1e-2 );
+
+		if ( type == BasisTable::Type::Legendre ) {
+			y0Legendre = h.view( h.y );
+			y0Legendre_dot = h.view( h.y_dot );
+		}
+		if ( type == BasisTable::Type::GaussLobatto )
+			continue;
+
+		// The problem is linear, so the Gauss rule on k + 1 nodes is exact and the nodal basis gives the same
+		// discretisation as Legendre: the same state, residual and Newton update in the other basis
+		h.view( h.y ) = y0Legendre;
+		h.view( h.y_dot ) = y0Legendre_dot;
+		h.view( h.g ) = g;
+		if ( type == BasisTable::Type::Gauss ) {
+			changeBasis( h.y, false );
+			changeBasis( h.y_dot, false );
+			changeBasis( h.g, false );
+		}
+
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		h.solve( system, delY );
+		if ( type == BasisTable::Type::Gauss ) {
+			changeBasis( res, true );
+			changeBasis( delY, true );
+		}
+
+		Vector resVec = h.view( res ), delYVec = h.view( delY );
+		if ( type == BasisTable::Type::Legendre ) {
+			refRes = resVec;
+			refDelY = delYVec;
+			BOOST_TEST( refRes.norm() > 0.0 );
+		} else {
+			BOOST_TEST( ( resVec - refRes ).norm() <= 1e-10 * ( 1.0 + refRes.norm() ) );
+			BOOST_TEST( ( delYVec - refDelY ).norm() <= 1e-10 * ( 1.0 + refDelY.norm() ) );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( mixed_degree_tests )
+{
+	Grid testGrid( 0.0, 1.0, 8 );
+	Index nCells = 8, nVars = 3;
+	std::vector< Index > degrees{ 3, 1, 2 };
+
+	// Kappa is the identity, so each variable is independent and should evolve as it would alone at its own degree
+	const toml::value mixedConfig = u8R"(
+		[DiffusionProblem]
+		nVars = 3
+		InitialHeights = [ 1.0, 0.5, 2.0 ]
+		Centre = 0.5
+	)"_toml;
+	const toml::value singleConfigs[] = {
+		u8R"(
+			[DiffusionProblem]
+			InitialHeights = [ 1.0 ]
+			Centre = 0.5
+		)"_toml,
+		u8R"(
+			[DiffusionProblem]
+			InitialHeights = [ 0.5 ]
+			Centre = 0.5
+		)"_toml,
+		u8R"(
+			[DiffusionProblem]
+			InitialHeights = [ 2.0 ]
+			Centre = 0.5
+		)"_toml
+	};
+	MatrixDiffusion problem( mixedConfig );
+	SystemSolver system( testGrid, degrees, 0.1, &problem );
+	BOOST_TEST( ( system.getDegrees() == degrees ) );
+	BOOST_CHECK_THROW( system.setBasisType( BasisTable::Type::GaussLobatto ), std::invalid_argument );
+	BOOST_TEST( ( system.getBasisType() == BasisTable::Type::Legendre ) );
+	BOOST_CHECK_THROW( SystemSolver( testGrid, std::vector< Index >{ 1, 2 }, 0.1, &problem ), std::invalid_argument );
+
+	SolverHarness h( SolverHarness::StateSize( nCells, degrees ) );
+	N_Vector res = h.vector(), delY = h.vector(), delY_dense = h.vector();
+	h.setup( system );
+	residual( 0.0, h.y, h.y_dot, res, &system );
+	VectorWrapper delYVec = h.solve( system, delY );
+
+	system.setLambdaSolver( SystemSolver::LambdaSolverType::Dense );
+	VectorWrapper denseVec = h.solve( system, delY_dense );
+	BOOST_TEST( delYVec.norm() > 0.0 );
+	BOOST_TEST( ( denseVec - delYVec ).norm() < 1e-9 * delYVec.norm() );
+
+	DGSoln Y( nVars, testGrid, degrees, N_VGetArrayPointer( h.y ) ), Y_dot( nVars, testGrid, degrees, N_VGetArrayPointer( h.y_dot ) );
+	DGSoln G( nVars, testGrid, degrees, N_VGetArrayPointer( h.g ) ), Res( nVars, testGrid, degrees, N_VGetArrayPointer( res ) ), DelY( nVars, testGrid, degrees, N_VGetArrayPointer( delY ) );
+	for ( Index var = 0; var < nVars; ++var )
+	{
+		Index k = degrees[ var ];
+		MatrixDiffusion singleProblem( singleConfigs[ var ] );
+		SystemSolver single( testGrid, k, 0.1, &singleProblem );
+
+		SolverHarness h1( SolverHarness::StateSize( nCells, { k } ) );
+		N_Vector res1 = h1.vector(), delY1 = h1.vector();
+
+		// Start from exactly the same state, as the projections of the initial condition use different quadratures
+		h1.setup( single );
+		DGSoln Y1( 1, testGrid, k, N_VGetArrayPointer( h1.y ) ), Y1_dot( 1, testGrid, k, N_VGetArrayPointer( h1.y_dot ) ), G1( 1, testGrid, k, N_VGetArrayPointer( h1.g ) );
+		for ( auto [ one, mixed ] : { std::pair{ &Y1, &Y }, std::pair{ &Y1_dot, &Y_dot }, std::pair{ &G1, &G } } )
+		{
+			one->sigma( 0 ).copy( mixed->sigma( var ) );
+			one->q( 0 ).copy( mixed->q( var ) );
+			one->u( 0 ).copy( mixed->u( var ) );
+			one->lambda( 0 ) = mixed->lambda( var );
+		}
+
+		residual( 0.0, h1.y, h1.y_dot, res1, &single );
+		h1.solve( single, delY1 );
+
+		DGSoln Res1( 1, testGrid, k, N_VGetArrayPointer( res1 ) ), DelY1( 1, testGrid, k, N_VGetArrayPointer( delY1 ) );
+		for ( auto [ one, mixed ] : { std::pair{ &Res1, &Res }, std::pair{ &DelY1, &DelY } } )
+		{
+			BOOST_TEST( ( one->sigma( 0 ).coeffs() - mixed->sigma( var ).coeffs() ).norm() < 1e-10 * ( 1.0 + one->sigma( 0 ).coeffs().norm() ) );
+			BOOST_TEST( ( one->q( 0 ).coeffs() - mixed->q( var ).coeffs() ).norm() < 1e-10 * ( 1.0 + one->q( 0 ).coeffs().norm() ) );
+			BOOST_TEST( ( one->u( 0 ).coeffs() - mixed->u( var ).coeffs() ).norm() < 1e-10 * ( 1.0 + one->u( 0 ).coeffs().norm() ) );
+			BOOST_TEST( ( one->lambda( 0 ) - mixed->lambda( var ) ).norm() < 1e-10 * ( 1.0 + one->lambda( 0 ).norm() ) );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( allocation_tests )
+{
+	if ( !AllocationCounter::Available() )
+		return;
+
+	{
+		// The counter sees Eigen's allocations
+		AllocationCounter check;
+		Vector v = Vector::Zero( 100 );
+		BOOST_TEST( check.count() > 0 );
+	}
+
+	Grid testGrid( 0.0, 1.0, 10 );
+	Index k = 2;
+
+	TestDiffusion problem( config_snippet );
+	SystemSolver system( testGrid, k, 0.1, &problem );
+
+	SolverHarness h( SolverHarness::StateSize( 10, { k } ) );
+	N_Vector res = h.vector(), delY = h.vector();
+	h.setup( system );
+
+	// Once warmed up, a time step (residuals, Jacobian setup & solves) must not touch the heap
+	for ( Index n : { 1, 3 } )
+	{
+		system.setThreads( n );
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		system.setJacobianState( h.y );
+		h.solve( system, delY );
+
+		AllocationCounter residualAllocations;
+		residual( 0.0, h.y, h.y_dot, res, &system );
+		BOOST_TEST( residualAllocations.count() == 0 );
+
+		AllocationCounter setupAllocations;
+		system.setJacobianState( h.y );
+		system.setupJacEq();
+		BOOST_TEST( setupAllocations.count() == 0 );
+
+		AllocationCounter solveAllocations;
+		system.solveJacEq( h.g, delY );
+		BOOST_TEST( solveAllocations.count() == 0 );
+	}
+}
 
 BOOST_AUTO_TEST_SUITE_END()
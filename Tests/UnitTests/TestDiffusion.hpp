@@ -15,6 +15,7 @@ class TestDiffusion : public TransportSystem {
 		explicit TestDiffusion( toml::value const& config ){
 			// Always set nVars in a derived constructor
 			nVars = 1;
+			threadSafe = true;
 
 			// Construst your problem from user-specified config
 			// throw an exception if you can't. NEVER leave a part-constructed object around
@@ -0,0 +1,110 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+void ThreadPool::resize( Index n )
+{
+	if ( n <= 0 )
+		throw std::invalid_argument( "Thread pool needs at least one thread" );
+
+	if ( n == nThreads && static_cast<Index>( workers.size() ) == nThreads - 1 )
+		return;
+
+	stop();
+	nThreads = n;
+	stopping = false;
+	for ( Index id = 1; id < nThreads; ++id )
+		workers.emplace_back( &ThreadPool::workerLoop, this, id, generation );
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard< std::mutex > lock( m );
+		stopping = true;
+	}
+	wake.notify_all();
+	for ( auto & w : workers )
+		w.join();
+	workers.clear();
+}
+
+// Chunk t is [ first + t*n/nChunks, first + ( t + 1 )*n/nChunks ), threads beyond nChunks have nothing to do
+void ThreadPool::runChunk( Index t )
+{
+	if ( t < jobChunks )
+		jobFn( jobData, jobFirst + ( t*jobSize )/jobChunks, jobFirst + ( ( t + 1 )*jobSize )/jobChunks, t );
+}
+
+void ThreadPool::workerLoop( Index id, unsigned long seen )
+{
+	while ( true )
+	{
+		{
+			std::unique_lock< std::mutex > lock( m );
+			wake.wait( lock, [ & ](){ return stopping || generation != seen; } );
+			if ( stopping )
+				return;
+			seen = generation;
+		}
+
+		try {
+			runChunk( id );
+		} catch ( ... ) {
+			std::lock_guard< std::mutex > lock( m );
+			if ( !error )
+				error = std::current_exception();
+		}
+
+		{
+			std::lock_guard< std::mutex > lock( m );
+			if ( --pending == 0 )
+				done.notify_one();
+		}
+	}
+}
+
+void ThreadPool::run( Index first, Index last, ChunkFn fn, void const* data )
+{
+	Index n = last - first;
+	if ( n <= 0 )
+		return;
+
+	if ( nThreads == 1 || n == 1 )
+	{
+		fn( data, first, last, 0 );
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( m );
+		jobFn = fn;
+		jobData = data;
+		jobFirst = first;
+		jobSize = n;
+		jobChunks = std::min( nThreads, n );
+		error = nullptr;
+		pending = nThreads - 1;
+		++generation;
+	}
+	wake.notify_all();
+
+	std::exception_ptr mine;
+	try {
+		runChunk( 0 );
+	} catch ( ... ) {
+		mine = std::current_exception();
+	}
+
+	std::unique_lock< std::mutex > lock( m );
+	done.wait( lock, [ & ](){ return pending == 0; } );
+	jobFn = nullptr;
+	jobData = nullptr;
+	if ( !mine )
+		mine = error;
+	lock.unlock();
+
+	if ( mine )
+		std::rethrow_exception( mine );
+}
@@ -0,0 +1,72 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include "Types.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+	Fixed set of worker threads for the loops over cells in SystemSolver
+
+	parallelFor splits [ first, last ) into one contiguous chunk per thread. The split depends only
+	on the range and the number of threads, never on timing, so as long as each index writes only
+	its own outputs (no sums across cells) the results are bitwise identical for any thread count.
+	Anything that has to be accumulated across cells should be computed per cell in parallel and
+	summed afterwards in serial, in index order.
+
+	The calling thread runs the first chunk itself, so a pool of size 1 starts no threads and
+	parallelFor is just a function call. parallelFor is not re-entrant: do not call it from inside a chunk.
+ */
+class ThreadPool
+{
+public:
+	explicit ThreadPool( Index nThreads = 1 ) { resize( nThreads ); };
+	~ThreadPool() { stop(); };
+
+	ThreadPool( ThreadPool const& ) = delete;
+	ThreadPool& operator=( ThreadPool const& ) = delete;
+
+	void resize( Index nThreads );
+	Index size() const { return nThreads; };
+
+	// Calls f( begin, end, t ) for chunk t = 0, ..., size() - 1 of [ first, last ) and waits for all of them.
+	// Chunk t always runs on thread t, so t can index per-thread scratch space.
+	// The first exception thrown by any chunk is rethrown here once every chunk has finished.
+	// f is called through a plain function pointer, so no allocation is done here.
+	template< typename F >
+	void parallelFor( Index first, Index last, F&& f )
+	{
+		using Fn = std::remove_reference_t< F >;
+		run( first, last, []( void const* fn, Index begin, Index end, Index t ) { ( *static_cast< Fn* >( const_cast< void* >( fn ) ) )( begin, end, t ); }, &f );
+	}
+
+private:
+	using ChunkFn = void (*)( void const*, Index, Index, Index );
+
+	void run( Index first, Index last, ChunkFn fn, void const* data );
+	void runChunk( Index t );
+	void stop();
+	// seen is the generation at start-up, so a new worker never picks up an old job
+	void workerLoop( Index id, unsigned long seen );
+
+	Index nThreads = 1;
+	std::vector< std::thread > workers;
+
+	std::mutex m;
+	std::condition_variable wake, done;
+	// Current job, valid while pending > 0
+	ChunkFn jobFn = nullptr;
+	void const* jobData = nullptr;
+	Index jobFirst = 0, jobSize = 0, jobChunks = 0;
+	unsigned long generation = 0;
+	Index pending = 0;
+	bool stopping = false;
+	std::exception_ptr error;
+};
+
+#endif // THREADPOOL_HPP
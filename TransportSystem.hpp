@@ -3,12 +3,24 @@
 
 #include "Types.hpp"
 
+#include <array>
+#include <stdexcept>
+
+class OperatorCache;
+
 /*
 	Pure interface class
 	defines a problem in the form
 		a_i d_t u_i + d_x ( sigma_i ) = S_i( u(x), q(x), x, t ) ; S_i can depend on the entire u & q vector, but only locally.
 		sigma_i = sigma_hat_i( u( x ), q( x ), x, t ) ; so can sigma_hat_i
 
+	Thread safety: with more than one thread the solver evaluates the flux, source and a_i functions
+	(and their derivatives) for different cells concurrently, on the same object. It only does so if
+	the derived class sets threadSafe = true in its constructor, promising that these calls neither
+	modify the object nor share any other mutable state. Otherwise the physics is called for every
+	cell from one thread, and only then is the linear algebra that uses the results spread over
+	the thread pool.
+
  */
 
 class TransportSystem {
@@ -40,13 +52,141 @@ class TransportSystem {
 		virtual void dSources_dq( Index i, Values&, const Values &u, const Values &q, Position x, Time t ) = 0;
 		virtual void dSources_dsigma( Index i, Values&, const Values &u, const Values &q, Position x, Time t ) = 0;
 
+		// Which of the derivatives above can be non-zero. coupling( d )( i, j ) is false if derivative d of
+		// flux / source i with respect to variable j is identically zero, in which case the solver neither
+		// asks for it nor stores or factorises that block of the Jacobian. Patterns are declared in the
+		// derived constructor with declareCoupling, anything undeclared is taken to be dense
+		enum class Derivative : Index { dSigma_du = 0, dSigma_dq, dSources_du, dSources_dq, dSources_dsigma };
+		using Coupling = Eigen::Array< bool, Eigen::Dynamic, Eigen::Dynamic >;
+		Coupling coupling( Derivative d ) const
+		{
+			Coupling const& c = couplings[ static_cast<Index>( d ) ];
+			return c.size() == 0 ? Coupling::Constant( nVars, nVars, true ) : c;
+		};
+
+		// Batched forms of the functions above over a set of points, e.g. the quadrature nodes of a cell. Row p of u, q & sigma
+		// holds every variable at x[ p ], and so does row p of each output. The solver calls these rather than the functions
+		// above. The defaults call the pointwise functions for one point and variable at a time; override them to share work
+		// between variables and points, or to vectorise over the points.
+		using PointValues = Eigen::Ref< const Matrix >;
+		using PointResults = Eigen::Ref< Matrix >;
+		using Positions = Eigen::Ref< const Vector >;
+
+		// sigmaOut( p, i ) = SigmaFn( i, ... ) and sourcesOut( p, i ) = Sources( i, ... ) at x[ p ]
+		virtual void Evaluate( PointValues u, PointValues q, PointValues sigma, Positions x, Time t, PointResults sigmaOut, PointResults sourcesOut )
+		{
+			Scratch& s = scratch();
+			for ( Index p = 0; p < x.size(); ++p )
+			{
+				s.u = u.row( p ).transpose();
+				s.q = q.row( p ).transpose();
+				s.sigma = sigma.row( p ).transpose();
+				for ( Index i = 0; i < nVars; ++i )
+				{
+					sigmaOut( p, i ) = SigmaFn( i, s.u, s.q, x[ p ], t );
+					sourcesOut( p, i ) = Sources( i, s.u, s.q, s.sigma, x[ p ], t );
+				}
+			}
+		};
+
+		// out( p, j ) is derivative d of flux / source i with respect to variable j at x[ p ]. Only called for rows i
+		// of coupling( d ) with anything in them
+		virtual void EvaluateDerivative( Derivative d, Index i, PointValues u, PointValues q, Positions x, Time t, PointResults out )
+		{
+			static constexpr void ( TransportSystem::*pointwise[] )( Index, Values&, const Values&, const Values&, Position, Time ) = {
+				&TransportSystem::dSigmaFn_du, &TransportSystem::dSigmaFn_dq, &TransportSystem::dSources_du, &TransportSystem::dSources_dq, &TransportSystem::dSources_dsigma };
+			Scratch& s = scratch();
+			for ( Index p = 0; p < x.size(); ++p )
+			{
+				s.u = u.row( p ).transpose();
+				s.q = q.row( p ).transpose();
+				( this->*pointwise[ static_cast<Index>( d ) ] )( i, s.d, s.u, s.q, x[ p ], t );
+				out.row( p ) = s.d.transpose();
+			}
+		};
+
+		// Optional fused forms, for cases where the variables share expensive intermediate quantities ( collision times,
+		// Coulomb logarithms, temperatures, ... ). At one point sigma[ i ] is SigmaFn( i, ... ) and row i of dSigma_du & dSigma_dq
+		// is what dSigmaFn_du & dSigmaFn_dq give for i, and likewise for the sources. The nVars x nVars Jacobians arrive zeroed.
+		// Set fusedEvaluation in the constructor if you override these: the solver then builds every derivative matrix of
+		// the Jacobian from one call of each per node. The residual only needs values, so it still goes through Evaluate.
+		// The defaults call the per-variable functions
+		virtual void FluxAndJacobian( const Values &u, const Values &q, Position x, Time t, Values& sigma, Matrix& dSigma_du, Matrix& dSigma_dq )
+		{
+			Values& d = scratch().d;
+			for ( Index i = 0; i < nVars; ++i )
+			{
+				sigma[ i ] = SigmaFn( i, u, q, x, t );
+				dSigmaFn_du( i, d, u, q, x, t );
+				dSigma_du.row( i ) = d.transpose();
+				dSigmaFn_dq( i, d, u, q, x, t );
+				dSigma_dq.row( i ) = d.transpose();
+			}
+		};
+		virtual void SourcesAndJacobian( const Values &u, const Values &q, const Values &sigma, Position x, Time t, Values& S, Matrix& dS_du, Matrix& dS_dq, Matrix& dS_dsigma )
+		{
+			Values& d = scratch().d;
+			for ( Index i = 0; i < nVars; ++i )
+			{
+				S[ i ] = Sources( i, u, q, sigma, x, t );
+				dSources_du( i, d, u, q, x, t );
+				dS_du.row( i ) = d.transpose();
+				dSources_dq( i, d, u, q, x, t );
+				dS_dq.row( i ) = d.transpose();
+				dSources_dsigma( i, d, u, q, x, t );
+				dS_dsigma.row( i ) = d.transpose();
+			}
+		};
+		bool hasFusedEvaluation() const { return fusedEvaluation; };
+
+		// Extra quadrature nodes per cell, on top of the configured margin, for fluxes and sources
+		// that are strongly nonlinear in u & q. k is the polynomial degree of the solution.
+		virtual Index extraQuadratureNodes( Index k ) const { return 0; };
+
+		// Register any time-invariant cell operators with the solver's cache, see OperatorCache.hpp.
+		// Called every time the solver builds its cell matrices, after it has added its own
+		virtual void addOperators( OperatorCache& ) {};
+
 		// and initial conditions for u & q
 		virtual Value      InitialValue( Index i, Position x ) const = 0;
 		virtual Value InitialDerivative( Index i, Position x ) const = 0;
 
+		bool isThreadSafe() const { return threadSafe; };
+
 	protected:
 		Index nVars;
 
+		// Call after setting nVars
+		void declareCoupling( Derivative d, Coupling const& pattern )
+		{
+			if ( pattern.rows() != nVars || pattern.cols() != nVars )
+				throw std::invalid_argument( "Coupling patterns must be nVars x nVars" );
+			couplings[ static_cast<Index>( d ) ] = pattern;
+		};
+		// See above, leave false if SigmaFn, Sources, aFn or their derivatives cache anything in the object
+		bool threadSafe = false;
+		// See above, set if FluxAndJacobian & SourcesAndJacobian are overridden
+		bool fusedEvaluation = false;
+
+	private:
+		std::array< Coupling, 5 > couplings;
+
+		// Arguments for the pointwise functions in the default batched ones. One set per thread, as the batched functions
+		// may be called concurrently, sized on first use so that steady-state calls do not allocate
+		struct Scratch
+		{
+			Values u, q, sigma, d;
+		};
+		Scratch& scratch() const
+		{
+			thread_local Scratch s;
+			if ( s.u.size() != nVars )
+			{
+				for ( Values* v : { &s.u, &s.q, &s.sigma, &s.d } )
+					v->resize( nVars );
+			}
+			return s;
+		};
 };
 
 #endif // TRANSPORTSYSTEM_HPP
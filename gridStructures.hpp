@@ -5,9 +5,11 @@
 #include <map>
 #include <memory>
 #include <algorithm>
+#include <concepts>
+#include <functional>
 #include <boost/math/special_functions/legendre.hpp>
-#include <boost/math/quadrature/gauss.hpp>
 #include <cmath>
+#include <stdexcept>
 #include <vector>
 #include <iostream>
 
@@ -63,10 +65,11 @@ public:
 		if ( nCells == 0 )
 			throw std::invalid_argument( "Strictly positive number of cells required to construct grid." );
 
-		Position cellLength = (upperBound - lowerBound)/static_cast<double>(nCells);
+		cellLength = (upperBound - lowerBound)/static_cast<double>(nCells);
 		for ( Index i = 0; i < nCells - 1; i++)
 			gridCells.emplace_back(lowerBound + i*cellLength, lowerBound + (i+1)*cellLength);
 		gridCells.emplace_back(lowerBound + (nCells-1)*cellLength, upperBound);
+		uniform = true;
 		
 		if ( gridCells.size() != nCells )
 			throw std::runtime_error( "Unable to construct grid." );
@@ -77,10 +80,11 @@ public:
 	{
 		if(!highGridBoundary)
 		{
-			Position cellLength = abs(uBound-lBound)/static_cast<double>(nCells);
+			cellLength = abs(uBound-lBound)/static_cast<double>(nCells);
 			for ( Index i = 0; i < nCells - 1; i++)
 				gridCells.emplace_back(lBound + i*cellLength, lBound + (i+1)*cellLength);
 			gridCells.emplace_back(lBound + (nCells-1)*cellLength, uBound);
+			uniform = true;
 
 			if ( gridCells.size() != nCells )
 				throw std::runtime_error( "Unable to construct grid." );
@@ -116,6 +120,28 @@ public:
 	Interval& operator[]( Index i ) { return gridCells[ i ]; };
 	Interval const& operator[]( Index i ) const { return gridCells[ i ]; };
 
+	// Index of the first cell containing x, so a point on a face belongs to the cell below it.
+	// O(1) on a uniform grid and O(log nCells) otherwise.
+	Index findCell( Position x ) const
+	{
+		if ( gridCells.empty() || x < gridCells.front().x_l || x > gridCells.back().x_u )
+			throw std::out_of_range( "Position is outside of the grid" );
+
+		if ( uniform )
+		{
+			// Guess from the cell width, then step off any rounding error in the guess
+			Index i = std::min( static_cast<Index>( ( x - gridCells.front().x_l )/cellLength ), gridCells.size() - 1 );
+			while ( x > gridCells[ i ].x_u )
+				++i;
+			while ( i > 0 && x <= gridCells[ i - 1 ].x_u )
+				--i;
+			return i;
+		}
+
+		auto it = std::lower_bound( gridCells.begin(), gridCells.end(), x, []( Interval const& I, Position y ){ return I.x_u < y; } );
+		return static_cast<Index>( it - gridCells.begin() );
+	}
+
 	friend bool operator==( const Grid & a, const Grid & b )
 	{
 		return ( ( a.upperBound == b.upperBound ) && ( a.lowerBound == b.lowerBound ) && ( a.gridCells == b.gridCells ) );
@@ -127,6 +153,9 @@ public:
 private:
 	std::vector<Interval> gridCells;
 	double upperBound, lowerBound;
+	// Equal-width cells allow findCell to compute the index directly
+	bool uniform = false;
+	Position cellLength = 0.0;
 
 };
 
@@ -143,53 +172,180 @@ class LegendreBasis
 			return ::sqrt( ( 2* i + 1 )/( I.h() ) ) * std::legendre( i, 2*( x - I.x_l )/I.h() - 1.0 );
 		};
 
+		// By the recurrence P_{j+1}' = P_{j-1}' + ( 2j + 1 ) P_j, which has no division by y^2 - 1 so is exact at the ends of I
 		static double Prime(  Interval const & I, Index i, double x )
 		{
-			if ( i == 0 )
-				return 0.0;
-
 			double y = 2*( x - I.x_l )/I.h() - 1.0;
-
-			if ( y == 1.0 )
-				return i*( i + 1.0 )/2.0;
-			if ( y == -1.0 )
-				return ( i % 2 == 0 ? i*( i + 1.0 )/2.0 : - i*( i + 1.0 )/2.0 );
-
-			return ::sqrt( ( 2* i + 1 )/( I.h() ) ) * ( 2*i/I.h() ) *( 1.0/( y*y-1.0 ) )*( y*std::legendre( i, y ) - std::legendre( i-1,y ) );
+			double P = 1.0, PPrev = 0.0, dP = 0.0, dPPrev = 0.0;
+			for ( Index j = 0; j < i; ++j )
+			{
+				double dPNext = dPPrev + ( 2.0*j + 1.0 )*P;
+				double PNext = ( ( 2.0*j + 1.0 )*y*P - j*PPrev )/( j + 1.0 );
+				dPPrev = dP;
+				dP = dPNext;
+				PPrev = P;
+				P = PNext;
+			}
+			return ::sqrt( ( 2* i + 1 )/( I.h() ) ) * ( 2.0/I.h() ) * dP;
 		};
 
-		static double Evaluate( Interval const & I, Eigen::VectorXd const& vCoeffs, double x )
+		// Sum of vCoeffs( j ) phi_j( x ), with the P_j from the three-term recurrence, so O( k ) rather than O( k^2 )
+		static double Evaluate( Interval const & I, Eigen::Ref< const Eigen::VectorXd > const& vCoeffs, double x )
 		{
+			double y = 2*( x - I.x_l )/I.h() - 1.0;
+			double P = 1.0, PPrev = 0.0;
 			double result = 0.0;
-			for ( Index i=0; i<vCoeffs.size(); ++i )
-				result += vCoeffs( i ) * Evaluate( I, i, x );
-			return result;
+			for ( Index j = 0; j < vCoeffs.size(); ++j )
+			{
+				result += vCoeffs( j ) * ::sqrt( 2.0*j + 1.0 ) * P;
+				double PNext = ( ( 2.0*j + 1.0 )*y*P - j*PPrev )/( j + 1.0 );
+				PPrev = P;
+				P = PNext;
+			}
+			return result/::sqrt( I.h() );
 		};
 
-		static std::function<double( double )> phi( Interval const& I, Index i )
+		// phi_0 .. phi_k of I ( columns ) at every point of x ( rows ), values is x.size() x ( k + 1 ).
+		// Each step of the recurrence is one operation on a contiguous column, so is vectorised across the points
+		static void EvaluateAll( Interval const& I, Index k, Eigen::Ref< const Vector > const& x, Eigen::Ref< Matrix > values );
+		// phi_0' .. phi_k', laid out the same way, exact at the ends of I
+		static void PrimeAll( Interval const& I, Index k, Eigen::Ref< const Vector > const& x, Eigen::Ref< Matrix > derivatives );
+		// Phi_j = sqrt( 2j + 1 ) P_j, and its derivative, on the reference element at every point y in [-1,1]
+		static void ReferenceValues( Index k, Eigen::Ref< const Vector > const& y, Eigen::Ref< Matrix > Phi );
+		static void ReferenceAll( Index k, Eigen::Ref< const Vector > const& y, Eigen::Ref< Matrix > Phi, Eigen::Ref< Matrix > DPhi );
+
+		// The basis functions as callables, which can be passed to the templated quadrature helpers and inlined there
+		static auto phi( Interval const& I, Index i )
 		{
 			return [=]( double x ){ 
 				return ::sqrt( ( 2* i + 1 )/( I.h() ) ) * std::legendre( i, 2*( x - I.x_l )/I.h() - 1.0 );
 			};
 		}
 
-		static std::function<double( double )> phiPrime( Interval const& I, Index i )
+		static auto phiPrime( Interval const& I, Index i )
 		{
-			if ( i == 0 )
-				return []( double ){ return 0.0; };
+			return [=]( double x ){ return Prime( I, i, x ); };
+		}
 
-			return [=]( double x ){
-				double y = 2*( x - I.x_l )/I.h() - 1.0;
+};
 
-				if ( y == 1.0 )
-					return i*( i + 1.0 )/2.0;
-				if ( y == -1.0 )
-					return ( i % 2 == 0 ? i*( i + 1.0 )/2.0 : - i*( i + 1.0 )/2.0 );
+/*
+	A basis on the reference element [-1,1], tabulated at the nodes of a quadrature rule and at the two endpoints.
+
+	Every cell is an affine image of [-1,1], so on a cell I of width h
+		phi_j( x ) = Phi_j( y ) / sqrt( h ),  phi_j'( x ) = ( 2 / h ) Phi_j'( y ) / sqrt( h )
+	The tables are built once per ( order, node count, type ) and the cell scaling is applied on the fly,
+	so quadrature loops never evaluate a basis function.
+
+	Legendre : Phi_j = sqrt( 2j + 1 ) P_j on an n-point Gauss-Legendre rule. The number of nodes is k + 1 + margin;
+	           k + 1 nodes integrate products of two basis functions exactly, each node of margin adds two
+	           degrees of exactness for nonlinear integrands.
+	GaussLobatto, Gauss : the nodal basis Phi_j = sqrt( 2 / w_j ) l_j, with l_j the Lagrange polynomials on the
+	           k + 1 nodes of that rule, which is also the quadrature ( so n = k + 1 ). Nonlinear functions are then
+	           only evaluated at the nodes, and each coefficient is a scaled nodal value.
+
+	Either way the basis is orthonormal in the inner product given by the table's quadrature, so the mass
+	matrix is the identity. For the Gauss rule this is exact; Gauss-Lobatto integrates the mass matrix
+	inexactly, which is the usual mass lumping, but is exact for the derivative matrix.
+ */
+class BasisTable
+{
+	public:
+		enum class Type { Legendre, GaussLobatto, Gauss };
 
-				return ::sqrt( ( 2* i + 1 )/( I.h() ) ) * ( 2*i/I.h() ) *( 1.0/( y*y-1.0 ) )*( y*std::legendre( i, y ) - std::legendre( i-1,y ) );
-			};
+		BasisTable( Index Order, Index nNodes, Type t = Type::Legendre );
+
+		static constexpr Index DefaultQuadratureMargin = 2;
+		static Index QuadratureNodes( Index Order, Index margin ) { return Order + 1 + margin; };
+
+		// Shared table for a given order, number of nodes and type, built on first use
+		static BasisTable const& Get( Index Order, Index nNodes, Type t = Type::Legendre );
+		static BasisTable const& Get( Index Order ) { return Get( Order, QuadratureNodes( Order, DefaultQuadratureMargin ) ); };
+
+		// Nodes ( ascending, in (-1,1) ) and weights of the n-point Gauss-Legendre rule on [-1,1]
+		static void GaussLegendre( Index n, Vector& nodes, Vector& weights );
+		// Nodes ( ascending, including -1 and 1 ) and weights of the n-point Gauss-Lobatto rule on [-1,1], n >= 2
+		static void GaussLobatto( Index n, Vector& nodes, Vector& weights );
+
+		Index order() const { return k; };
+		Index nNodes() const { return nodes.size(); };
+		Type type() const { return basisType; };
+		bool isNodal() const { return basisType != Type::Legendre; };
+
+		// Position and quadrature weight of node q in the cell I
+		double x( Interval const& I, Index q ) const { return I.x_l + ( 1.0 + nodes[ q ] )*I.h()/2.0; };
+		double weight( Interval const& I, Index q ) const { return weights[ q ]*I.h()/2.0; };
+		// Positions of all the nodes in I
+		void x( Interval const& I, Eigen::Ref< Vector > xs ) const { xs.array() = I.x_l + ( 1.0 + nodes.array() )*I.h()/2.0; };
+
+		// phi_j and phi_j' on I at node q
+		double phi( Interval const& I, Index j, Index q ) const { return Phi( j, q )/::sqrt( I.h() ); };
+		double phiPrime( Interval const& I, Index j, Index q ) const { return DPhi( j, q )*( 2.0/I.h() )/::sqrt( I.h() ); };
+
+		// phi_j and phi_j' on I at x_l and x_u
+		double phiLower( Interval const& I, Index j ) const { return PhiLower( j )/::sqrt( I.h() ); };
+		double phiUpper( Interval const& I, Index j ) const { return PhiUpper( j )/::sqrt( I.h() ); };
+		double phiPrimeLower( Interval const& I, Index j ) const { return DPhiLower( j )*( 2.0/I.h() )/::sqrt( I.h() ); };
+		double phiPrimeUpper( Interval const& I, Index j ) const { return DPhiUpper( j )*( 2.0/I.h() )/::sqrt( I.h() ); };
+
+		// Value of the expansion sum_j c_j phi_j at node q of I, or at either end of I
+		template< typename CoeffVector > double Evaluate( Interval const& I, CoeffVector const& c, Index q ) const
+		{
+			return Phi.col( q ).dot( c )/::sqrt( I.h() );
+		}
+		template< typename CoeffVector > double EvaluateLower( Interval const& I, CoeffVector const& c ) const
+		{
+			return PhiLower.dot( c )/::sqrt( I.h() );
 		}
+		template< typename CoeffVector > double EvaluateUpper( Interval const& I, CoeffVector const& c ) const
+		{
+			return PhiUpper.dot( c )/::sqrt( I.h() );
+		}
+		// At any x in I, for output rather than in quadrature loops
+		double EvaluateAt( Interval const& I, Eigen::Ref< const Vector > const& c, double x ) const;
+
+		// Values at every node of I of the expansions in the columns of coeffs, one column per field.
+		// values is nNodes x coeffs.cols(). N = k + 1, if given, fixes the length of the inner products at compile time
+		template< int N = Eigen::Dynamic >
+		void EvaluateAtNodes( Interval const& I, Eigen::Ref< const Matrix > const& coeffs, Eigen::Ref< Matrix > values ) const
+		{
+			values.noalias() = Phi.template topRows< N >( k + 1 ).transpose() * coeffs.template topRows< N >( k + 1 );
+			values /= ::sqrt( I.h() );
+		}
+
+		// Projection onto every basis function of I of the fields sampled at the nodes,
+		// coeffs( j, f ) = sum_q w_q values( q, f ) phi_j( x_q ); coeffs is ( k + 1 ) x values.cols()
+		template< int N = Eigen::Dynamic >
+		void Project( Interval const& I, Eigen::Ref< const Matrix > const& values, Eigen::Ref< Matrix > coeffs ) const
+		{
+			coeffs.template topRows< N >( k + 1 ).noalias() = PhiW.template topRows< N >( k + 1 ) * values;
+			coeffs *= ( I.h()/2.0 )/::sqrt( I.h() );
+		}
+
+		// Reference tables, ( k + 1 ) x nNodes
+		Matrix const& values() const { return Phi; };
+		Matrix const& derivatives() const { return DPhi; };
+		// Phi_j( y_q ) w_q, the reference projection onto the basis
+		Matrix const& weightedValues() const { return PhiW; };
+
+		// Operators on [-1,1], ( k + 1 ) x ( k + 1 ), built with the table ( in closed form for Legendre ). On a cell of width h
+		//	( phi_i, phi_j ) = delta_ij,  ( phi_i, phi_j' ) = derivativeMatrix()( i, j ) / h,
+		//	phi_i( x_l ) phi_j( x_l ) = lowerEdgeMatrix()( i, j ) / h,  and likewise at x_u
+		Matrix const& derivativeMatrix() const { return RefDerivative; };
+		Matrix const& lowerEdgeMatrix() const { return RefLowerEdge; };
+		Matrix const& upperEdgeMatrix() const { return RefUpperEdge; };
 
+	private:
+		Index k;
+		Type basisType;
+		Vector nodes, weights;
+		// Barycentric weights 1 / prod_{m != j} ( y_j - y_m ) of the nodal basis
+		Vector baryWeights;
+		Matrix Phi, DPhi;
+		// Phi_j( y_q ) * w_q
+		Matrix PhiW;
+		Vector PhiLower, PhiUpper, DPhiLower, DPhiUpper;
+		Matrix RefDerivative, RefLowerEdge, RefUpperEdge;
 };
 
 class DGApprox
@@ -204,9 +360,8 @@ class DGApprox
 		~DGApprox() = default;
 
 		DGApprox( Grid const& _grid, unsigned int Order )
-			: grid( _grid ),k( Order ), coeffs()
+			: grid( _grid ),k( Order ), pBasis( &BasisTable::Get( Order ) )
 		{
-			coeffs.reserve( grid.getNCells() );
 		};
 
 		/*
@@ -233,33 +388,28 @@ class DGApprox
 		};
 		*/
 
-		DGApprox( Grid const& _grid, unsigned int Order, double* block_data, size_t stride ) : grid( _grid )
+		DGApprox( Grid const& _grid, unsigned int Order, double* block_data, size_t stride ) : grid( _grid ), k( Order ), pBasis( &BasisTable::Get( Order ) )
 		{
-			k = Order;
-			Grid::Index nCells = grid.getNCells();
-			coeffs.clear();
-			coeffs.reserve( nCells );
-			auto const& cells = grid.getCells();
-			for ( Grid::Index i = 0; i < nCells; ++i )
-			{
-				VectorWrapper v( block_data + i*stride, k + 1 );
-				coeffs.emplace_back( cells[ i ], v );
-			}
+			Map( block_data, stride );
 		}
 
+		// The basis the coefficients are in, and whose quadrature operator= projects with. The Legendre basis unless set
+		BasisTable const& basis() const { return *pBasis; };
+		void setBasis( BasisTable const& b )
+		{
+			if ( b.order() != static_cast<Index>( k ) )
+				throw std::invalid_argument( "Basis must be of the same order as the approximation" );
+			pBasis = &b;
+		}
+
+		// The k + 1 coefficients on cell i start at block_data + i*stride. Only the pointer and stride are kept,
+		// so re-mapping is O(1) and the intervals come from the grid when they are needed.
 		void Map( double* block_data, size_t stride )
 		{
-			Grid::Index nCells = grid.getNCells();
-			coeffs.clear();
-			coeffs.reserve( nCells );
 			if ( stride < k + 1 )
 				throw std::invalid_argument( "stride too short, memory corrption guaranteed." );
-			auto const& cells = grid.getCells();
-			for ( Grid::Index i = 0; i < nCells; ++i )
-			{
-				VectorWrapper v( block_data + i*stride, k + 1 );
-				coeffs.emplace_back( cells[ i ], v );
-			}
+			data = block_data;
+			coeffStride = stride;
 		}
 
 		// Do a copy from other's memory into ours
@@ -269,23 +419,26 @@ class DGApprox
 				throw std::invalid_argument( "To use copy, construct from the same grid." );
 			if ( k != other.k )
 				throw std::invalid_argument( "Cannot change order of polynomial approximation via copy()." );
-			
-			coeffs = other.coeffs;
 
+			coeffs() = other.coeffs();
 		}
 
-		DGApprox& operator=( std::function<double( double )> const & f )
+		// Projection of any callable double( double ), which is called once per quadrature node
+		template< typename F > requires std::invocable< F const&, double >
+		DGApprox& operator=( F const & f )
 		{
-			// check for data ownership
-			for ( auto pair : coeffs )
+			BasisTable const& basis = *pBasis;
+			for ( Grid::Index iCell = 0; iCell < grid.getNCells(); ++iCell )
 			{
-				Interval const& I = pair.first;
-				pair.second.setZero();
-				// assert( pair.second.size == k + 1);
-				// Interpolate onto k legendre polynomials
-				for ( Index i=0; i<= k; i++ )
+				Interval const& I = grid[ iCell ];
+				auto c = coeffs().col( iCell );
+				c.setZero();
+				// Project onto the k + 1 basis functions
+				for ( Index q = 0; q < basis.nNodes(); ++q )
 				{
-					pair.second( i ) = CellProduct( I, f, Basis.phi( I, i ) );
+					double fVal = basis.weight( I, q ) * f( basis.x( I, q ) );
+					for ( Index i=0; i<= k; i++ )
+						c( i ) += fVal * basis.phi( I, i, q );
 				}
 			}
 			return *this;
@@ -307,106 +460,106 @@ class DGApprox
 		{
 			if ( grid != other.grid )
 				throw std::invalid_argument( "Cannot add two DGApprox's on different grids" );
-			for ( unsigned int i=0; i < coeffs.size(); ++i )
-			{
-				// std::assert( coeffs[ i ].first == other.coeffs[ i ].first );
-				coeffs[ i ].second += other.coeffs[ i ].second;
-			}
+			coeffs() += other.coeffs();
 			return *this;
 		}
 
 		double operator()( Position x ) const {
-			for ( auto const & I : coeffs )
-			{
-				if (  I.first.contains( x ) )
-					return Basis.Evaluate( I.first, I.second, x );
+			Grid::Index i;
+			try {
+				i = grid.findCell( x );
+			} catch ( std::out_of_range const& ) {
+				throw std::logic_error( "Evaluation outside of grid" );
 			}
-			throw std::logic_error( "Evaluation outside of grid" );
+			return pBasis->EvaluateAt( grid[ i ], coeffs().col( i ), x );
 		};
 
 		double operator()( Position x, Interval const& I ) const {
 			if ( !I.contains( x ) ) 
 				throw std::invalid_argument( "Evaluate(x, I) requires x to be in the interval I" );
-			auto it = std::find_if ( coeffs.begin(), coeffs.end(), [I]( std::pair<Interval,VectorWrapper> p ) { return ( p.first == I ); } );
-			if ( it == coeffs.end() )
+			// x may be on a face, in which case findCell returns the cell below and I may be the one above
+			Grid::Index i = grid.findCell( x );
+			if ( !( grid[ i ] == I ) && i + 1 < grid.getNCells() && grid[ i + 1 ] == I )
+				++i;
+			if ( !( grid[ i ] == I ) )
 				throw std::logic_error( "Interval I not part of the grid" );
-			else
-				return Basis.Evaluate( it->first, it->second, x );
-
+			return pBasis->EvaluateAt( grid[ i ], coeffs().col( i ), x );
 		};
 
-		static double CellProduct( Interval const& I, std::function< double( double )> f, std::function< double( double )> g )
-		{
-			auto u = [ & ]( double x ){ return f( x )*g( x );};
-			return integrator.integrate( u, I.x_l, I.x_u );
+		// Evaluate in a known cell, without any search; x must be in grid[ i ]
+		double operator()( Position x, Index i ) const {
+			return pBasis->EvaluateAt( grid[ i ], coeffs().col( i ), x );
 		};
 
-		static double EdgeProduct( Interval const& I, std::function< double( double )> f, std::function< double( double )> g )
+		// The quadrature helpers take any callable, so the weights are inlined rather than called through std::function
+		template< typename F, typename G >
+		static double EdgeProduct( Interval const& I, F const& f, G const& g )
 		{
 			return f( I.x_l )*g( I.x_l ) + f( I.x_u )*g( I.x_u );
-		};
+		}
 
 		static void MassMatrix( Interval const& I, Eigen::MatrixXd &u ) {
 			// The unweighted mass matrix is the identity.
 			u.setIdentity();
 		};
 
-		static void MassMatrix( Interval const& I, Eigen::MatrixXd &u, std::function< double( double )> const& w ) {
-			for ( Index i = 0 ; i < u.rows(); i++ )
-				for ( Index j = 0 ; j < u.cols(); j++ )
-				{
-					auto F = [ & ]( double x ) { return w( x ) * Basis.Evaluate( I, i, x ) * Basis.Evaluate( I, j, x ); };
-					u( i, j ) = integrator.integrate( F, I.x_l, I.x_u );
-				}
-		};
+		template< typename W > requires std::invocable< W const&, double >
+		static void MassMatrix( Interval const& I, Eigen::MatrixXd &u, W const& w ) {
+			MassMatrix( I, u, w, BasisTable::Get( u.rows() - 1 ) );
+		}
 
-		static void MassMatrix( Interval const& I, Eigen::MatrixXd &u, std::function< double( double, int )> const& w, int var ) {
-			for ( Index i = 0 ; i < u.rows(); i++ )
-				for ( Index j = 0 ; j < u.cols(); j++ )
-				{
-					auto F = [ & ]( double x ) { return w( x, var ) * Basis.Evaluate( I, i, x ) * Basis.Evaluate( I, j, x ); };
-					u( i, j ) = integrator.integrate( F, I.x_l, I.x_u );
-				}
-		};
+		// As above, with the quadrature rule of basis ( which must be at least of order u.rows() - 1 )
+		template< typename W > requires std::invocable< W const&, double >
+		static void MassMatrix( Interval const& I, Eigen::MatrixXd &u, W const& w, BasisTable const& basis ) {
+			u.setZero();
+			for ( Index q = 0; q < basis.nNodes(); ++q )
+			{
+				// phi_i phi_j = Phi_i Phi_j / h
+				double wVal = basis.weight( I, q ) * w( basis.x( I, q ) )/I.h();
+				auto Phi = basis.values().col( q );
+				u.noalias() += wVal * Phi.head( u.rows() ) * Phi.head( u.cols() ).transpose();
+			}
+		}
+
+		template< typename W > requires std::invocable< W const&, double, int >
+		static void MassMatrix( Interval const& I, Eigen::MatrixXd &u, W const& w, int var ) {
+			MassMatrix( I, u, [ & ]( double x ){ return w( x, var ); } );
+		}
 
 		Eigen::MatrixXd MassMatrix( Interval const& I )
 		{
 			return Eigen::MatrixXd::Identity( k + 1, k + 1 );
 		}
 
-		Eigen::MatrixXd MassMatrix( Interval const& I, std::function<double( double )> const&w )
+		template< typename W > requires std::invocable< W const&, double >
+		Eigen::MatrixXd MassMatrix( Interval const& I, W const&w )
 		{
 			Eigen::MatrixXd u ( k + 1, k + 1 );
-			for ( Index i = 0 ; i < u.rows(); i++ )
-				for ( Index j = 0 ; j < u.cols(); j++ )
-				{
-					auto F = [ & ]( double x ) { return w( x ) * Basis.Evaluate( I, i, x ) * Basis.Evaluate( I, j, x ); };
-					u( i, j ) = integrator.integrate( F, I.x_l, I.x_u );
-				}
+			MassMatrix( I, u, w );
 			return u;
 		}
 
+		// Unweighted, from the closed form in BasisTable
 		static void DerivativeMatrix( Interval const& I, Eigen::MatrixXd &D ) {
-			for ( Index i = 0 ; i < D.rows(); i++ )
-				for ( Index j = 0 ; j < D.cols(); j++ )
-				{
-					auto F = [ & ]( double x ) { return Basis.Evaluate( I, i, x ) * Basis.Prime( I, j, x ); };
-					D( i, j ) = integrator.integrate( F, I.x_l, I.x_u );
-				}
+			BasisTable const& basis = BasisTable::Get( std::max( D.rows(), D.cols() ) - 1 );
+			D = basis.derivativeMatrix().topLeftCorner( D.rows(), D.cols() )/I.h();
 		}
 
-		static void DerivativeMatrix( Interval const& I, Eigen::MatrixXd &D, std::function<double ( double )> const& w ) {
-			for ( Index i = 0 ; i < D.rows(); i++ )
-				for ( Index j = 0 ; j < D.cols(); j++ )
-				{	
-					auto F = [ & ]( double x ) { return w( x )*Basis.Evaluate( I, i, x ) * Basis.Prime( I, j, x ); };
-					D( i, j ) = integrator.integrate( F, I.x_l, I.x_u );
-				}
+		template< typename W > requires std::invocable< W const&, double >
+		static void DerivativeMatrix( Interval const& I, Eigen::MatrixXd &D, W const& w ) {
+			BasisTable const& basis = BasisTable::Get( std::max( D.rows(), D.cols() ) - 1 );
+			D.setZero();
+			for ( Index q = 0; q < basis.nNodes(); ++q )
+			{
+				double wVal = basis.weight( I, q ) * w( basis.x( I, q ) );
+				for ( Index i = 0 ; i < D.rows(); i++ )
+					for ( Index j = 0 ; j < D.cols(); j++ )
+						D( i, j ) += wVal * basis.phi( I, i, q ) * basis.phiPrime( I, j, q );
+			}
 		}
 
 		void zeroCoeffs() {
-			for ( auto pair : coeffs )
-				pair.second = Eigen::VectorXd::Zero( pair.second.size() );
+			coeffs().setZero();
 		}
 
 		/*
@@ -432,39 +585,46 @@ class DGApprox
 
 		void printCoeffs()
 		{
-			for ( auto const& x : coeffs )
+			for ( Index i = 0; i < coeffs().cols(); ++i )
 			{
-				std::cerr << x.second << std::endl;
+				std::cerr << coeffs().col( i ) << std::endl;
 			}
 			std::cerr << std::endl;
 		}
 
+		// Of the largest coefficient on each cell, the one of largest magnitude
 		double maxCoeff()
 		{
 			double coeff = 0.0;
-			for ( auto pair : coeffs )
+			for ( Index i = 0; i < coeffs().cols(); ++i )
 			{
-				if( ::abs(coeff) < ::abs( pair.second.maxCoeff() ) )
-					coeff = pair.second.maxCoeff();
+				double cellMax = coeffs().col( i ).maxCoeff();
+				if( ::abs( coeff ) < ::abs( cellMax ) )
+					coeff = cellMax;
 			}
 			return coeff;
 		}
 
-		using IntegratorType = boost::math::quadrature::gauss<double, 30>;
-		using Coeff_t = std::vector< std::pair< Interval, VectorWrapper > >;
-
-		static const IntegratorType& Integrator() { return integrator; };
+		// Column i holds the coefficients on cell i
+		using CoeffMatrix = Eigen::Map< Matrix, 0, Eigen::OuterStride<> >;
+		using ConstCoeffMatrix = Eigen::Map< const Matrix, 0, Eigen::OuterStride<> >;
+		using Coeff_t = std::pair< Interval const&, VectorWrapper >;
+		using ConstCoeff_t = std::pair< Interval const&, Eigen::Map< const Vector > >;
 
 		unsigned int getOrder() { return k;};
-		Coeff_t const& getCoeffs() { return coeffs; };
-		std::pair< Interval, VectorWrapper > & getCoeff( Index i ) { return coeffs[ i ]; };
-		std::pair< Interval, VectorWrapper > const& getCoeff( Index i ) const { return coeffs[ i ]; };
+		// All the coefficients as one ( k + 1 ) x nCells view, for whole-field operations
+		CoeffMatrix coeffs() { return CoeffMatrix( data, k + 1, grid.getNCells(), Eigen::OuterStride<>( coeffStride ) ); };
+		ConstCoeffMatrix coeffs() const { return ConstCoeffMatrix( data, k + 1, grid.getNCells(), Eigen::OuterStride<>( coeffStride ) ); };
+		// The interval and coefficients of cell i, as views onto the grid and our memory
+		Coeff_t getCoeff( Index i ) { return Coeff_t( grid[ i ], VectorWrapper( data + i*coeffStride, k + 1 ) ); };
+		ConstCoeff_t getCoeff( Index i ) const { return ConstCoeff_t( grid[ i ], Eigen::Map< const Vector >( data + i*coeffStride, k + 1 ) ); };
 	private:
 		const Grid& grid;
 		unsigned int k;
-		Coeff_t coeffs;
+		double* data = nullptr;
+		Index coeffStride = 0;
+		BasisTable const* pBasis;
 		static LegendreBasis Basis;
-		static IntegratorType integrator;
 
 		friend class DGSoln;
 